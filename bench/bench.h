@@ -0,0 +1,145 @@
+/**
+ * @file bench.h
+ * @brief Minimal timing helpers shared by the libd benchmarks.
+ */
+
+#ifndef LIBD_BENCH_H
+#define LIBD_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+#endif
+
+/**
+ * @brief Monotonic timestamp in nanoseconds.
+ */
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Number of online cpus, at least 1.
+ */
+static inline unsigned
+bench_num_cpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n < 1 ? 1 : (unsigned)n;
+}
+
+/**
+ * @brief Prints one result row: total operations, ns/op and Mops/s.
+ */
+static inline void
+bench_report(
+  const char* name,
+  unsigned threads,
+  uint64_t ops,
+  uint64_t elapsed_ns)
+{
+  double ns_per_op = (double)elapsed_ns / (double)ops;
+  double mops      = (double)ops * 1e3 / (double)elapsed_ns;
+  printf(
+    "%-40s threads=%-3u ops=%-12llu %8.2f ns/op %10.2f Mops/s\n",
+    name,
+    threads,
+    (unsigned long long)ops,
+    ns_per_op,
+    mops);
+}
+
+/**
+ * @brief Hardware event counter for the calling thread. Unavailable (fd < 0)
+ * when not on Linux or when perf events are not permitted.
+ */
+struct bench_counter {
+  int fd;
+};
+
+#define BENCH_COUNTER_UNAVAILABLE UINT64_MAX
+
+#if defined(__linux__)
+  #define BENCH_EVENT_CACHE_MISSES PERF_COUNT_HW_CACHE_MISSES
+  #define BENCH_EVENT_DTLB_MISSES                                      \
+    (PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |   \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+  #define BENCH_EVENT_TYPE_HARDWARE PERF_TYPE_HARDWARE
+  #define BENCH_EVENT_TYPE_CACHE    PERF_TYPE_HW_CACHE
+#else
+  #define BENCH_EVENT_CACHE_MISSES  0
+  #define BENCH_EVENT_DTLB_MISSES   0
+  #define BENCH_EVENT_TYPE_HARDWARE 0
+  #define BENCH_EVENT_TYPE_CACHE    0
+#endif
+
+/**
+ * @brief Opens and starts a counter for the given perf event.
+ */
+static inline void
+bench_counter_start(
+  struct bench_counter* c,
+  uint32_t type,
+  uint64_t config)
+{
+  c->fd = -1;
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  c->fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (c->fd >= 0) {
+    ioctl(c->fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(c->fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#else
+  (void)type;
+  (void)config;
+#endif
+}
+
+/**
+ * @brief Stops and closes the counter.
+ * @return The event count, or BENCH_COUNTER_UNAVAILABLE.
+ */
+static inline uint64_t
+bench_counter_stop(struct bench_counter* c)
+{
+  uint64_t count = BENCH_COUNTER_UNAVAILABLE;
+#if defined(__linux__)
+  if (c->fd >= 0) {
+    ioctl(c->fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(c->fd, &count, sizeof(count)) != sizeof(count)) {
+      count = BENCH_COUNTER_UNAVAILABLE;
+    }
+    close(c->fd);
+  }
+#endif
+  c->fd = -1;
+  return count;
+}
+
+/**
+ * @brief Keeps the compiler from optimizing a value away.
+ */
+#define BENCH_DO_NOT_OPTIMIZE(v) __asm__ volatile("" : : "g"(v) : "memory")
+
+#endif  // LIBD_BENCH_H
@@ -0,0 +1,175 @@
+/*
+ * Multi-threaded alloc/free throughput of the magazine-backed concurrent pool
+ * and the lock-free pool against a single pool allocator guarded by a mutex,
+ * with the unsynchronized single-threaded pool as the baseline.
+ *
+ * usage: concurrent_pool_allocator_bench [max_threads]
+ */
+
+#include "../../include/libd/memory.h"
+#include "../bench.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SLOT_SIZE   64
+#define WORKING_SET 16
+#define ROUNDS      200000
+
+enum variant {
+  variant_unlocked,
+  variant_mutex,
+  variant_magazine,
+  variant_lockfree,
+};
+
+struct shared {
+  enum variant variant;
+  libd_pool_allocator_h* pa;
+  pthread_mutex_t lock;
+  libd_concurrent_pool_allocator_h* cpa;
+  libd_lockfree_pool_allocator_h* lfpa;
+  pthread_barrier_t start;
+};
+
+static int
+_alloc(
+  struct shared* s,
+  void** out)
+{
+  int r;
+  switch (s->variant) {
+  case variant_mutex:
+    pthread_mutex_lock(&s->lock);
+    r = libd_pool_allocator_alloc(s->pa, out);
+    pthread_mutex_unlock(&s->lock);
+    return r;
+  case variant_magazine:
+    return libd_concurrent_pool_allocator_alloc(s->cpa, out);
+  case variant_lockfree:
+    return libd_lockfree_pool_allocator_alloc(s->lfpa, out);
+  default:
+    return libd_pool_allocator_alloc(s->pa, out);
+  }
+}
+
+static void
+_free(
+  struct shared* s,
+  void* p)
+{
+  switch (s->variant) {
+  case variant_mutex:
+    pthread_mutex_lock(&s->lock);
+    libd_pool_allocator_free(s->pa, p);
+    pthread_mutex_unlock(&s->lock);
+    break;
+  case variant_magazine:
+    libd_concurrent_pool_allocator_free(s->cpa, p);
+    break;
+  case variant_lockfree:
+    libd_lockfree_pool_allocator_free(s->lfpa, p);
+    break;
+  default:
+    libd_pool_allocator_free(s->pa, p);
+    break;
+  }
+}
+
+static void*
+_worker(void* arg)
+{
+  struct shared* s = arg;
+  void* held[WORKING_SET];
+
+  pthread_barrier_wait(&s->start);
+  for (unsigned round = 0; round < ROUNDS; round += 1) {
+    for (unsigned i = 0; i < WORKING_SET; i += 1) {
+      if (_alloc(s, &held[i]) != libd_ok) {
+        fprintf(stderr, "allocation failed\n");
+        exit(1);
+      }
+      *(volatile u8*)held[i] = (u8)i;
+    }
+    for (unsigned i = 0; i < WORKING_SET; i += 1) {
+      _free(s, held[i]);
+    }
+  }
+
+  return NULL;
+}
+
+static void
+_run(
+  const char* name,
+  enum variant variant,
+  unsigned threads)
+{
+  const u32 magazine_size = 64;
+  const u32 slots         = threads * (WORKING_SET + magazine_size);
+
+  struct shared s = { .variant = variant };
+  if (variant == variant_magazine) {
+    libd_concurrent_pool_allocator_create(
+      &s.cpa, slots, SLOT_SIZE, 16, magazine_size);
+  } else if (variant == variant_lockfree) {
+    libd_lockfree_pool_allocator_create(&s.lfpa, slots, SLOT_SIZE, 16);
+  } else {
+    libd_pool_allocator_create(&s.pa, slots, SLOT_SIZE, 16);
+    pthread_mutex_init(&s.lock, NULL);
+  }
+  pthread_barrier_init(&s.start, NULL, threads + 1);
+
+  pthread_t* tids = malloc(threads * sizeof(*tids));
+  for (unsigned i = 0; i < threads; i += 1) {
+    pthread_create(&tids[i], NULL, _worker, &s);
+  }
+
+  uint64_t start = bench_now_ns();
+  pthread_barrier_wait(&s.start);
+  for (unsigned i = 0; i < threads; i += 1) {
+    pthread_join(tids[i], NULL);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  // one alloc and one free per slot per round.
+  bench_report(
+    name, threads, (uint64_t)threads * ROUNDS * WORKING_SET * 2, elapsed);
+
+  free(tids);
+  pthread_barrier_destroy(&s.start);
+  if (variant == variant_magazine) {
+    libd_concurrent_pool_allocator_destroy(s.cpa);
+  } else if (variant == variant_lockfree) {
+    libd_lockfree_pool_allocator_destroy(s.lfpa);
+  } else {
+    pthread_mutex_destroy(&s.lock);
+    libd_pool_allocator_destroy(s.pa);
+  }
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  unsigned max_threads = bench_num_cpus();
+  if (argc > 1) {
+    max_threads = (unsigned)strtoul(argv[1], NULL, 10);
+  }
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+
+  _run("pool (unsynchronized)", variant_unlocked, 1);
+
+  for (unsigned t = 1; t <= max_threads; t *= 2) {
+    _run("pool + mutex", variant_mutex, t);
+    _run("concurrent pool (magazines)", variant_magazine, t);
+    _run("lock-free pool (treiber)", variant_lockfree, t);
+  }
+
+  return 0;
+}
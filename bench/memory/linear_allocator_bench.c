@@ -0,0 +1,181 @@
+/*
+ * Small scratch allocations from the linear allocator through the
+ * out-of-line call and the inline fast path, resetting every few thousand
+ * allocations the way a per-request arena would.
+ *
+ * Also walks a 64 GiB reservation in 1 MiB allocations, touching one byte of
+ * each, to show that only touched pages become resident.
+ *
+ * Finally times each 4 KiB allocation plus its first write across a 256 MiB
+ * arena and reports the latency percentiles with lazy commit, commit-ahead,
+ * and the whole arena prefaulted before the timed loop.
+ *
+ * usage: linear_allocator_bench [ops] [lazy_commit_gib]
+ */
+
+#include "../../include/libd/memory.h"
+#include "../bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#define ALLOCS_PER_RESET 4096
+#define LATENCY_ALLOCS   65536
+#define LATENCY_SIZE     (4 * KiB)
+
+static void
+_run(
+  const char* name,
+  bool fast,
+  u32 ops)
+{
+  libd_linear_allocator_h* la;
+  if (libd_linear_allocator_create(&la, MiB, 256 * KiB, 8) != libd_ok) {
+    fprintf(stderr, "failed to create linear allocator\n");
+    exit(1);
+  }
+
+  u32 rounds     = ops / ALLOCS_PER_RESET;
+  uint64_t start = bench_now_ns();
+  for (u32 r = 0; r < rounds; r += 1) {
+    for (u32 i = 0; i < ALLOCS_PER_RESET; i += 1) {
+      void* p;
+      u32 size = 8 + (i & 31);
+      if (fast) {
+        libd_linear_allocator_alloc_fast(la, &p, size);
+      } else {
+        libd_linear_allocator_alloc(la, &p, size);
+      }
+      BENCH_DO_NOT_OPTIMIZE(p);
+    }
+    libd_linear_allocator_reset(la);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report(name, 1, (uint64_t)rounds * ALLOCS_PER_RESET, elapsed);
+
+  libd_linear_allocator_destroy(la);
+}
+
+static void
+_run_lazy_commit(usize arena_bytes)
+{
+  const usize reservation = (usize)64 * GiB;
+  const usize chunk       = MiB;
+
+  libd_linear_allocator_h* la;
+  if (libd_linear_allocator_create(&la, reservation, chunk, 16) != libd_ok) {
+    fprintf(stderr, "failed to reserve 64 GiB\n");
+    exit(1);
+  }
+
+  u64 allocs     = arena_bytes / chunk;
+  uint64_t start = bench_now_ns();
+  for (u64 i = 0; i < allocs; i += 1) {
+    u8* p;
+    if (libd_linear_allocator_alloc(la, (void**)&p, chunk) != libd_ok) {
+      fprintf(stderr, "allocation %llu failed\n", (unsigned long long)i);
+      exit(1);
+    }
+    *(volatile u8*)p = (u8)i;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  bench_report("linear 1 MiB allocs (lazy commit)", 1, allocs, elapsed);
+  printf(
+    "%-40s reserved 64 GiB, allocated %llu MiB, max rss %ld MiB\n",
+    "",
+    (unsigned long long)(allocs * chunk / MiB),
+    usage.ru_maxrss / 1024);
+
+  libd_linear_allocator_destroy(la);
+}
+
+static int
+_compare_u64(
+  const void* a,
+  const void* b)
+{
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+static void
+_run_latency(
+  const char* name,
+  usize commit_ahead_bytes,
+  bool prefault)
+{
+  struct libd_linear_allocator_options options = {
+    .commit_ahead_bytes = commit_ahead_bytes,
+  };
+  libd_linear_allocator_h* la;
+  if (
+    libd_linear_allocator_create_with_options(
+      &la, (usize)LATENCY_ALLOCS * LATENCY_SIZE, 64 * KiB, 16, &options) !=
+    libd_ok) {
+    fprintf(stderr, "failed to create linear allocator\n");
+    exit(1);
+  }
+  if (prefault) {
+    libd_linear_allocator_prefault(la, (usize)LATENCY_ALLOCS * LATENCY_SIZE);
+  }
+
+  uint64_t* samples = malloc(LATENCY_ALLOCS * sizeof(*samples));
+  uint64_t total    = 0;
+  for (u32 i = 0; i < LATENCY_ALLOCS; i += 1) {
+    uint64_t start = bench_now_ns();
+    u8* p;
+    if (libd_linear_allocator_alloc(la, (void**)&p, LATENCY_SIZE) != libd_ok) {
+      fprintf(stderr, "allocation %u failed\n", i);
+      exit(1);
+    }
+    *(volatile u8*)p = (u8)i;
+    samples[i]       = bench_now_ns() - start;
+    total           += samples[i];
+  }
+
+  qsort(samples, LATENCY_ALLOCS, sizeof(*samples), _compare_u64);
+  bench_report(name, 1, LATENCY_ALLOCS, total);
+  printf(
+    "%-40s p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+    "",
+    (unsigned long long)samples[LATENCY_ALLOCS / 2],
+    (unsigned long long)samples[LATENCY_ALLOCS * 99 / 100],
+    (unsigned long long)samples[LATENCY_ALLOCS * 999 / 1000],
+    (unsigned long long)samples[LATENCY_ALLOCS - 1]);
+
+  free(samples);
+  libd_linear_allocator_destroy(la);
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  u32 ops         = 50000000;
+  usize arena_gib = 16;
+  if (argc > 1) {
+    ops = (u32)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    arena_gib = (usize)strtoul(argv[2], NULL, 10);
+  }
+
+  _run("linear alloc", false, ops);
+  _run("linear alloc_fast (inline)", true, ops);
+  _run_lazy_commit(arena_gib * GiB);
+
+  _run_latency("linear 4 KiB alloc+touch (lazy)", 0, false);
+  _run_latency("linear 4 KiB alloc+touch (ahead 1 MiB)", MiB, false);
+  _run_latency("linear 4 KiB alloc+touch (prefaulted)", 0, true);
+
+  return 0;
+}
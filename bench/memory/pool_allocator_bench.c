@@ -0,0 +1,222 @@
+/*
+ * Churn workload for the pool allocator free orders and backings: half the
+ * pool stays live while random slots are freed and reallocated. Reports time
+ * and, where perf events are available, cache and dTLB misses per operation.
+ * Also times create and reset of a pool with a few slots in use, which should
+ * not scale with the slot count, and the per-object cost of batched
+ * alloc_n/free_n against single-object calls.
+ *
+ * usage: pool_allocator_bench [slots] [ops]
+ */
+
+#include "../../include/libd/memory.h"
+#include "../bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SLOT_SIZE 64
+
+static uint64_t g_rng = 0x9e3779b97f4a7c15ull;
+
+static inline uint64_t
+_rand(void)
+{
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return g_rng;
+}
+
+static void
+_print_counter(
+  const char* label,
+  uint64_t count,
+  u32 ops)
+{
+  if (count == BENCH_COUNTER_UNAVAILABLE) {
+    printf("%-40s %s: unavailable\n", "", label);
+  } else {
+    printf(
+      "%-40s %s: %llu (%.3f per free+alloc)\n",
+      "",
+      label,
+      (unsigned long long)count,
+      (double)count / ops);
+  }
+}
+
+static void
+_run(
+  const char* name,
+  struct libd_pool_allocator_options options,
+  u32 slots,
+  u32 ops)
+{
+  libd_pool_allocator_h* pa;
+  if (libd_pool_allocator_create_with_options(
+        &pa, slots, SLOT_SIZE, 16, &options) != libd_ok) {
+    fprintf(stderr, "failed to create pool\n");
+    exit(1);
+  }
+
+  // fill the pool, then free a random half to scatter the free list.
+  void** all = malloc(slots * sizeof(void*));
+  for (u32 i = 0; i < slots; i += 1) {
+    libd_pool_allocator_alloc(pa, &all[i]);
+  }
+  for (u32 i = slots - 1; i > 0; i -= 1) {
+    u32 j   = _rand() % (i + 1);
+    void* t = all[i];
+    all[i]  = all[j];
+    all[j]  = t;
+  }
+  u32 live = slots / 2;
+  for (u32 i = live; i < slots; i += 1) {
+    libd_pool_allocator_free(pa, all[i]);
+  }
+
+  struct bench_counter misses;
+  struct bench_counter tlb_misses;
+  bench_counter_start(
+    &misses, BENCH_EVENT_TYPE_HARDWARE, BENCH_EVENT_CACHE_MISSES);
+  bench_counter_start(
+    &tlb_misses, BENCH_EVENT_TYPE_CACHE, BENCH_EVENT_DTLB_MISSES);
+  uint64_t start = bench_now_ns();
+
+  for (u32 i = 0; i < ops; i += 1) {
+    u32 victim = _rand() % live;
+    libd_pool_allocator_free(pa, all[victim]);
+    libd_pool_allocator_alloc(pa, &all[victim]);
+    *(volatile u64*)all[victim] = i;
+  }
+
+  uint64_t elapsed   = bench_now_ns() - start;
+  uint64_t count     = bench_counter_stop(&misses);
+  uint64_t tlb_count = bench_counter_stop(&tlb_misses);
+
+  bench_report(name, 1, (uint64_t)ops * 2, elapsed);
+  _print_counter("cache misses", count, ops);
+  _print_counter("dTLB misses", tlb_count, ops);
+
+  free(all);
+  libd_pool_allocator_destroy(pa);
+}
+
+static void
+_run_create_reset(
+  const char* name,
+  enum libd_pool_allocator_free_order order,
+  u32 slots)
+{
+  struct libd_pool_allocator_options options = { .free_order = order };
+  const u32 rounds                           = 100;
+
+  uint64_t start = bench_now_ns();
+  for (u32 r = 0; r < rounds; r += 1) {
+    libd_pool_allocator_h* pa;
+    if (libd_pool_allocator_create_with_options(
+          &pa, slots, SLOT_SIZE, 16, &options) != libd_ok) {
+      fprintf(stderr, "failed to create pool\n");
+      exit(1);
+    }
+    for (u32 i = 0; i < 64; i += 1) {
+      void* p;
+      libd_pool_allocator_alloc(pa, &p);
+      *(volatile u64*)p = i;
+    }
+    libd_pool_allocator_reset(pa);
+    libd_pool_allocator_destroy(pa);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report(name, 1, rounds, elapsed);
+}
+
+static void
+_run_batch(
+  u32 batch,
+  u32 ops)
+{
+  libd_pool_allocator_h* pa;
+  if (libd_pool_allocator_create(&pa, batch, SLOT_SIZE, 16) != libd_ok) {
+    fprintf(stderr, "failed to create pool\n");
+    exit(1);
+  }
+
+  void** held = malloc(batch * sizeof(void*));
+  u32 rounds  = MAX(ops / batch, 1u);
+  char name[64];
+
+  uint64_t start = bench_now_ns();
+  for (u32 r = 0; r < rounds; r += 1) {
+    for (u32 i = 0; i < batch; i += 1) {
+      libd_pool_allocator_alloc(pa, &held[i]);
+    }
+    BENCH_DO_NOT_OPTIMIZE(held[batch - 1]);
+    for (u32 i = 0; i < batch; i += 1) {
+      libd_pool_allocator_free(pa, held[i]);
+    }
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  snprintf(name, sizeof(name), "pool single x%u", batch);
+  bench_report(name, 1, (uint64_t)rounds * batch * 2, elapsed);
+
+  start = bench_now_ns();
+  for (u32 r = 0; r < rounds; r += 1) {
+    libd_pool_allocator_alloc_n(pa, held, batch);
+    BENCH_DO_NOT_OPTIMIZE(held[batch - 1]);
+    libd_pool_allocator_free_n(pa, held, batch);
+  }
+  elapsed = bench_now_ns() - start;
+  snprintf(name, sizeof(name), "pool alloc_n/free_n x%u", batch);
+  bench_report(name, 1, (uint64_t)rounds * batch * 2, elapsed);
+
+  free(held);
+  libd_pool_allocator_destroy(pa);
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  u32 slots = 1 << 14;
+  u32 ops   = 50000;
+  if (argc > 1) {
+    slots = (u32)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    ops = (u32)strtoul(argv[2], NULL, 10);
+  }
+
+  struct libd_pool_allocator_options lifo    = { 0 };
+  struct libd_pool_allocator_options ordered = {
+    .free_order = libd_pool_free_address_ordered,
+  };
+  struct libd_pool_allocator_options mmap_thp = {
+    .backing    = libd_pool_backing_mmap,
+    .huge_pages = libd_pool_huge_pages_transparent,
+  };
+  struct libd_pool_allocator_options mmap_hugetlb = {
+    .backing    = libd_pool_backing_mmap,
+    .huge_pages = libd_pool_huge_pages_explicit,
+  };
+
+  _run("pool churn (lifo)", lifo, slots, ops);
+  _run("pool churn (address ordered)", ordered, slots, ops);
+  _run("pool churn (lifo, mmap + thp)", mmap_thp, slots, ops);
+  _run("pool churn (lifo, mmap + hugetlb)", mmap_hugetlb, slots, ops);
+
+  _run_create_reset("pool create+reset (lifo)", libd_pool_free_lifo, slots);
+  _run_create_reset(
+    "pool create+reset (address ordered)",
+    libd_pool_free_address_ordered,
+    slots);
+
+  _run_batch(32, ops);
+  _run_batch(256, ops);
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Mixed-size churn against the slab allocator and malloc: a working set of
+ * small objects with random sizes where a random victim is freed and
+ * replaced each step.
+ *
+ * usage: slab_allocator_bench [max_size] [ops]
+ */
+
+#include "../../include/libd/memory.h"
+#include "../bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WORKING_SET 4096
+
+static uint64_t g_rng = 0x9e3779b97f4a7c15ull;
+
+static inline uint64_t
+_rand(void)
+{
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return g_rng;
+}
+
+static void
+_run(
+  const char* name,
+  libd_slab_allocator_h* sa,
+  usize max_size,
+  u32 ops)
+{
+  static void* held[WORKING_SET];
+
+  g_rng = 0x9e3779b97f4a7c15ull;
+  for (u32 i = 0; i < WORKING_SET; i += 1) {
+    usize size = 1 + _rand() % max_size;
+    if (sa != NULL) {
+      libd_slab_allocator_alloc(sa, &held[i], size);
+    } else {
+      held[i] = malloc(size);
+    }
+  }
+
+  uint64_t start = bench_now_ns();
+
+  for (u32 i = 0; i < ops; i += 1) {
+    u64 r      = _rand();
+    u32 victim = r % WORKING_SET;
+    usize size = 1 + (r >> 32) % max_size;
+    if (sa != NULL) {
+      libd_slab_allocator_free(sa, held[victim]);
+      libd_slab_allocator_alloc(sa, &held[victim], size);
+    } else {
+      free(held[victim]);
+      held[victim] = malloc(size);
+    }
+    *(volatile u8*)held[victim] = (u8)i;
+  }
+
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_report(name, 1, (uint64_t)ops * 2, elapsed);
+
+  for (u32 i = 0; i < WORKING_SET; i += 1) {
+    if (sa != NULL) {
+      libd_slab_allocator_free(sa, held[i]);
+    } else {
+      free(held[i]);
+    }
+  }
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  usize max_size = 512;
+  u32 ops        = 5000000;
+  if (argc > 1) {
+    max_size = (usize)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    ops = (u32)strtoul(argv[2], NULL, 10);
+  }
+
+  libd_slab_allocator_h* sa;
+  if (libd_slab_allocator_create(&sa, 64 * MiB) != libd_ok) {
+    fprintf(stderr, "failed to create slab allocator\n");
+    return 1;
+  }
+
+  _run("malloc/free (mixed sizes)", NULL, max_size, ops);
+  _run("slab alloc/free (mixed sizes)", sa, max_size, ops);
+
+  libd_slab_allocator_destroy(sa);
+
+  return 0;
+}
@@ -0,0 +1,327 @@
+/*
+ * Throughput and latency of the ring queues against a mutex and condition
+ * variable queue, the way work items were passed between threads before.
+ * Throughput rows stream items from producers to as many consumers through
+ * one queue, with the blocking operations on single items and on batches.
+ * Latency rows bounce one item between two threads over a pair of queues;
+ * ns/op is the round trip.
+ *
+ * usage: ring_queue_bench [items] [capacity] [max_pairs]
+ */
+
+#include "../../include/libd/utils/ring_queue.h"
+#include "../bench.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+DEFINE_LIBD_RING_QUEUE_HEADER(u64, u64)
+DEFINE_LIBD_RING_QUEUE_IMPL(u64, u64)
+
+#define BATCH 32
+
+enum kind {
+  KIND_SPSC,
+  KIND_SPSC_BATCH,
+  KIND_MPMC,
+  KIND_MPMC_BATCH,
+  KIND_LOCKED,
+};
+
+static const char* g_names[] = {
+  "spsc queue",
+  "spsc queue (batches of 32)",
+  "mpmc queue",
+  "mpmc queue (batches of 32)",
+  "mutex+condvar queue (baseline)",
+};
+
+// The baseline: a ring under one mutex, with a condition variable per side.
+struct locked_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  u64* slots;
+  u64 capacity;
+  u64 head;
+  u64 tail;
+};
+
+static void
+_locked_init(
+  struct locked_queue* q,
+  u64 capacity)
+{
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+  q->slots    = malloc(capacity * sizeof(u64));
+  q->capacity = capacity;
+  q->head     = 0;
+  q->tail     = 0;
+}
+
+static void
+_locked_destroy(struct locked_queue* q)
+{
+  free(q->slots);
+  pthread_cond_destroy(&q->not_full);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_mutex_destroy(&q->lock);
+}
+
+static void
+_locked_enqueue(
+  struct locked_queue* q,
+  u64 item)
+{
+  pthread_mutex_lock(&q->lock);
+  while (q->tail - q->head == q->capacity) {
+    pthread_cond_wait(&q->not_full, &q->lock);
+  }
+  q->slots[q->tail % q->capacity] = item;
+  q->tail += 1;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static u64
+_locked_dequeue(struct locked_queue* q)
+{
+  pthread_mutex_lock(&q->lock);
+  while (q->tail == q->head) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  u64 item = q->slots[q->head % q->capacity];
+  q->head += 1;
+  pthread_cond_signal(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+
+  return item;
+}
+
+struct shared {
+  enum kind kind;
+  u64 items; /**< per producer, and per consumer */
+  libd_u64_spsc_queue_t* spsc;
+  libd_u64_mpmc_queue_t* mpmc;
+  struct locked_queue locked;
+  pthread_barrier_t start;
+};
+
+static void*
+_producer(void* arg)
+{
+  struct shared* s = arg;
+  u64 batch[BATCH];
+
+  pthread_barrier_wait(&s->start);
+  for (u64 i = 0; i < s->items;) {
+    u64 n = MIN((u64)BATCH, s->items - i);
+    switch (s->kind) {
+      case KIND_SPSC:
+        libd_u64_spsc_queue_enqueue(s->spsc, &i);
+        n = 1;
+        break;
+      case KIND_SPSC_BATCH:
+        for (u64 k = 0; k < n; k += 1) {
+          batch[k] = i + k;
+        }
+        libd_u64_spsc_queue_enqueue_n(s->spsc, batch, n);
+        break;
+      case KIND_MPMC:
+        libd_u64_mpmc_queue_enqueue(s->mpmc, &i);
+        n = 1;
+        break;
+      case KIND_MPMC_BATCH:
+        for (u64 k = 0; k < n; k += 1) {
+          batch[k] = i + k;
+        }
+        libd_u64_mpmc_queue_enqueue_n(s->mpmc, batch, n);
+        break;
+      case KIND_LOCKED:
+        _locked_enqueue(&s->locked, i);
+        n = 1;
+        break;
+    }
+    i += n;
+  }
+
+  return NULL;
+}
+
+static void*
+_consumer(void* arg)
+{
+  struct shared* s = arg;
+  u64 batch[BATCH];
+  u64 sum = 0;
+
+  pthread_barrier_wait(&s->start);
+  for (u64 i = 0; i < s->items;) {
+    u64 n    = 1;
+    u64 want = MIN((u64)BATCH, s->items - i);
+    switch (s->kind) {
+      case KIND_SPSC:
+        libd_u64_spsc_queue_dequeue(s->spsc, &batch[0]);
+        break;
+      case KIND_SPSC_BATCH:
+        n = libd_u64_spsc_queue_dequeue_n(s->spsc, batch, want);
+        break;
+      case KIND_MPMC:
+        libd_u64_mpmc_queue_dequeue(s->mpmc, &batch[0]);
+        break;
+      case KIND_MPMC_BATCH:
+        n = libd_u64_mpmc_queue_dequeue_n(s->mpmc, batch, want);
+        break;
+      case KIND_LOCKED:
+        batch[0] = _locked_dequeue(&s->locked);
+        break;
+    }
+    for (u64 k = 0; k < n; k += 1) {
+      sum += batch[k];
+    }
+    i += n;
+  }
+  BENCH_DO_NOT_OPTIMIZE(sum);
+
+  return NULL;
+}
+
+static void
+_run_throughput(
+  enum kind kind,
+  unsigned pairs,
+  u64 items,
+  u64 capacity)
+{
+  struct shared s = { .kind = kind, .items = items };
+  s.spsc          = libd_u64_spsc_queue_create(capacity);
+  s.mpmc          = libd_u64_mpmc_queue_create(capacity);
+  _locked_init(&s.locked, capacity);
+  pthread_barrier_init(&s.start, NULL, 2 * pairs + 1);
+
+  pthread_t* tids = malloc(2 * pairs * sizeof(*tids));
+  for (unsigned i = 0; i < pairs; i += 1) {
+    pthread_create(&tids[2 * i], NULL, _producer, &s);
+    pthread_create(&tids[2 * i + 1], NULL, _consumer, &s);
+  }
+
+  uint64_t start = bench_now_ns();
+  pthread_barrier_wait(&s.start);
+  for (unsigned i = 0; i < 2 * pairs; i += 1) {
+    pthread_join(tids[i], NULL);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_report(g_names[kind], pairs, items * pairs, elapsed);
+
+  free(tids);
+  pthread_barrier_destroy(&s.start);
+  _locked_destroy(&s.locked);
+  libd_u64_mpmc_queue_destroy(s.mpmc);
+  libd_u64_spsc_queue_destroy(s.spsc);
+}
+
+struct ping_pong {
+  enum kind kind;
+  u64 rounds;
+  libd_u64_spsc_queue_t* spsc[2];
+  struct locked_queue locked[2];
+};
+
+static void*
+_echo(void* arg)
+{
+  struct ping_pong* p = arg;
+
+  for (u64 i = 0; i < p->rounds; i += 1) {
+    u64 v;
+    if (p->kind == KIND_SPSC) {
+      libd_u64_spsc_queue_dequeue(p->spsc[0], &v);
+      libd_u64_spsc_queue_enqueue(p->spsc[1], &v);
+    } else {
+      v = _locked_dequeue(&p->locked[0]);
+      _locked_enqueue(&p->locked[1], v);
+    }
+  }
+
+  return NULL;
+}
+
+static void
+_run_latency(
+  enum kind kind,
+  u64 rounds)
+{
+  struct ping_pong p = { .kind = kind, .rounds = rounds };
+  for (u32 i = 0; i < 2; i += 1) {
+    p.spsc[i] = libd_u64_spsc_queue_create(2);
+    _locked_init(&p.locked[i], 2);
+  }
+
+  pthread_t echo;
+  pthread_create(&echo, NULL, _echo, &p);
+
+  uint64_t start = bench_now_ns();
+  for (u64 i = 0; i < rounds; i += 1) {
+    u64 v = i;
+    if (kind == KIND_SPSC) {
+      libd_u64_spsc_queue_enqueue(p.spsc[0], &v);
+      libd_u64_spsc_queue_dequeue(p.spsc[1], &v);
+    } else {
+      _locked_enqueue(&p.locked[0], v);
+      v = _locked_dequeue(&p.locked[1]);
+    }
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  pthread_join(echo, NULL);
+
+  bench_report(
+    kind == KIND_SPSC ? "spsc round trip" : "mutex+condvar round trip",
+    2,
+    rounds,
+    elapsed);
+
+  for (u32 i = 0; i < 2; i += 1) {
+    libd_u64_spsc_queue_destroy(p.spsc[i]);
+    _locked_destroy(&p.locked[i]);
+  }
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  u64 items          = 1000000;
+  u64 capacity       = 1024;
+  unsigned max_pairs = MAX(bench_num_cpus() / 2, 1u);
+  if (argc > 1) {
+    items = strtoull(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    capacity = strtoull(argv[2], NULL, 10);
+  }
+  if (argc > 3) {
+    max_pairs = (unsigned)strtoul(argv[3], NULL, 10);
+  }
+  if (max_pairs == 0) {
+    max_pairs = 1;
+  }
+
+  // one producer and one consumer per pair; the spsc rows only run one pair.
+  _run_throughput(KIND_SPSC, 1, items, capacity);
+  _run_throughput(KIND_SPSC_BATCH, 1, items, capacity);
+  for (unsigned pairs = 1; pairs <= max_pairs; pairs *= 2) {
+    _run_throughput(KIND_MPMC, pairs, items, capacity);
+    _run_throughput(KIND_MPMC_BATCH, pairs, items, capacity);
+    _run_throughput(KIND_LOCKED, pairs, items, capacity);
+  }
+
+  _run_latency(KIND_SPSC, items / 10);
+  _run_latency(KIND_LOCKED, items / 10);
+
+  return 0;
+}
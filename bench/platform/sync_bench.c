@@ -0,0 +1,249 @@
+/*
+ * Contention of the futex-based sync primitives against their pthread
+ * equivalents, from one thread (the uncontended cost) up to one per cpu.
+ * Lock rows time a short critical section followed by a little work outside
+ * of it; the rwlock takes the write side on 1 of every 16 operations.
+ * Barrier rows time whole phases, where every thread arrives once.
+ *
+ * usage: sync_bench [ops_per_thread] [work] [max_threads]
+ */
+
+#include "../../include/libd/platform/sync.h"
+#include "../bench.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WRITE_EVERY 16
+
+enum kind {
+  KIND_LIBD_MUTEX,
+  KIND_PTHREAD_MUTEX,
+  KIND_LIBD_RWLOCK,
+  KIND_PTHREAD_RWLOCK,
+  KIND_LIBD_BARRIER,
+  KIND_PTHREAD_BARRIER,
+};
+
+static const char* g_names[] = {
+  "libd mutex",
+  "pthread mutex",
+  "libd rwlock (1/16 writes)",
+  "pthread rwlock (1/16 writes)",
+  "libd barrier (phases)",
+  "pthread barrier (phases)",
+};
+
+struct shared {
+  pthread_barrier_t start;
+  u32 ops;
+  enum kind kind;
+
+  struct libd_platform_mutex mutex;
+  pthread_mutex_t pmutex;
+  struct libd_platform_rwlock rwlock;
+  pthread_rwlock_t prwlock;
+  struct libd_platform_barrier barrier;
+  pthread_barrier_t pbarrier;
+
+  u64 counter;
+};
+
+static u32 g_work = 32;
+
+static void
+_work(void)
+{
+  u64 x = 0x9e3779b97f4a7c15ull;
+  for (u32 i = 0; i < g_work; i += 1) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  BENCH_DO_NOT_OPTIMIZE(x);
+}
+
+static void
+_mutex_ops(struct shared* s)
+{
+  for (u32 i = 0; i < s->ops; i += 1) {
+    libd_platform_mutex_lock(&s->mutex);
+    s->counter += 1;
+    libd_platform_mutex_unlock(&s->mutex);
+    _work();
+  }
+}
+
+static void
+_pmutex_ops(struct shared* s)
+{
+  for (u32 i = 0; i < s->ops; i += 1) {
+    pthread_mutex_lock(&s->pmutex);
+    s->counter += 1;
+    pthread_mutex_unlock(&s->pmutex);
+    _work();
+  }
+}
+
+static void
+_rwlock_ops(struct shared* s)
+{
+  for (u32 i = 0; i < s->ops; i += 1) {
+    if (i % WRITE_EVERY == 0) {
+      libd_platform_rwlock_write_lock(&s->rwlock);
+      s->counter += 1;
+      libd_platform_rwlock_write_unlock(&s->rwlock);
+    } else {
+      libd_platform_rwlock_read_lock(&s->rwlock);
+      BENCH_DO_NOT_OPTIMIZE(s->counter);
+      libd_platform_rwlock_read_unlock(&s->rwlock);
+    }
+    _work();
+  }
+}
+
+static void
+_prwlock_ops(struct shared* s)
+{
+  for (u32 i = 0; i < s->ops; i += 1) {
+    if (i % WRITE_EVERY == 0) {
+      pthread_rwlock_wrlock(&s->prwlock);
+      s->counter += 1;
+      pthread_rwlock_unlock(&s->prwlock);
+    } else {
+      pthread_rwlock_rdlock(&s->prwlock);
+      BENCH_DO_NOT_OPTIMIZE(s->counter);
+      pthread_rwlock_unlock(&s->prwlock);
+    }
+    _work();
+  }
+}
+
+static void
+_barrier_ops(struct shared* s)
+{
+  for (u32 i = 0; i < s->ops; i += 1) {
+    _work();
+    libd_platform_barrier_wait(&s->barrier);
+  }
+}
+
+static void
+_pbarrier_ops(struct shared* s)
+{
+  for (u32 i = 0; i < s->ops; i += 1) {
+    _work();
+    pthread_barrier_wait(&s->pbarrier);
+  }
+}
+
+static void*
+_worker(void* arg)
+{
+  struct shared* s = arg;
+
+  pthread_barrier_wait(&s->start);
+  switch (s->kind) {
+    case KIND_LIBD_MUTEX:
+      _mutex_ops(s);
+      break;
+    case KIND_PTHREAD_MUTEX:
+      _pmutex_ops(s);
+      break;
+    case KIND_LIBD_RWLOCK:
+      _rwlock_ops(s);
+      break;
+    case KIND_PTHREAD_RWLOCK:
+      _prwlock_ops(s);
+      break;
+    case KIND_LIBD_BARRIER:
+      _barrier_ops(s);
+      break;
+    case KIND_PTHREAD_BARRIER:
+      _pbarrier_ops(s);
+      break;
+  }
+
+  return NULL;
+}
+
+static void
+_run(
+  enum kind kind,
+  unsigned threads,
+  u32 ops)
+{
+  struct shared s = { .ops = ops, .kind = kind };
+  pthread_barrier_init(&s.start, NULL, threads + 1);
+  libd_platform_mutex_init(&s.mutex);
+  pthread_mutex_init(&s.pmutex, NULL);
+  libd_platform_rwlock_init(&s.rwlock);
+  pthread_rwlock_init(&s.prwlock, NULL);
+  libd_platform_barrier_init(&s.barrier, threads);
+  pthread_barrier_init(&s.pbarrier, NULL, threads);
+
+  pthread_t* tids = malloc(threads * sizeof(*tids));
+  for (unsigned i = 0; i < threads; i += 1) {
+    pthread_create(&tids[i], NULL, _worker, &s);
+  }
+
+  uint64_t start = bench_now_ns();
+  pthread_barrier_wait(&s.start);
+  for (unsigned i = 0; i < threads; i += 1) {
+    pthread_join(tids[i], NULL);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  // a barrier phase is one operation however many threads take part.
+  u64 total = kind >= KIND_LIBD_BARRIER ? ops : (u64)ops * threads;
+  bench_report(g_names[kind], threads, total, elapsed);
+
+  free(tids);
+  pthread_barrier_destroy(&s.pbarrier);
+  pthread_rwlock_destroy(&s.prwlock);
+  pthread_mutex_destroy(&s.pmutex);
+  pthread_barrier_destroy(&s.start);
+}
+
+static void
+_run_all(
+  unsigned threads,
+  u32 ops)
+{
+  for (u32 k = KIND_LIBD_MUTEX; k <= KIND_PTHREAD_BARRIER; k += 1) {
+    u32 n = k >= KIND_LIBD_BARRIER ? ops / 16 : ops;
+    _run((enum kind)k, threads, MAX(n, 1u));
+  }
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  u32 ops              = 1000000;
+  unsigned max_threads = bench_num_cpus();
+  if (argc > 1) {
+    ops = (u32)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    g_work = (u32)strtoul(argv[2], NULL, 10);
+  }
+  if (argc > 3) {
+    max_threads = (unsigned)strtoul(argv[3], NULL, 10);
+  }
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+
+  for (unsigned t = 1; t <= max_threads; t *= 2) {
+    _run_all(t, ops);
+  }
+  if ((max_threads & (max_threads - 1)) != 0) {
+    _run_all(max_threads, ops);
+  }
+
+  return 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * get and set throughput of the thread local storage handles on their
+ * compiler TLS fast path, against the handles that only have a pthread key
+ * (every fast slot taken), a bare pthread_getspecific and a bare __thread
+ * load. The fast path get also runs on every cpu at once, where it should
+ * scale linearly since nothing is shared. Finally, the first get of several
+ * handles from a new thread: handles with a slot share one per-thread block,
+ * the others allocate their storage one by one.
+ *
+ * usage: thread_local_storage_bench [ops] [max_threads]
+ */
+
+#include "../../include/libd/platform/threads.h"
+#include "../bench.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N_TOUCHED 8
+
+struct payload {
+  u64 value;
+};
+
+struct touch {
+  libd_platform_thread_local_storage_handle_h** handles;
+  u32 count;
+  uint64_t elapsed;
+};
+
+struct shared {
+  libd_platform_thread_local_storage_handle_h* handle;
+  u32 ops;
+  pthread_barrier_t start;
+};
+
+static __thread struct payload t_payload;
+
+static int
+_set_value(
+  void* dest,
+  void* src)
+{
+  ((struct payload*)dest)->value = *(u64*)src;
+  return 0;
+}
+
+static libd_platform_thread_local_storage_handle_h*
+_create(void)
+{
+  libd_platform_thread_local_storage_handle_h* handle;
+  if (
+    libd_platform_thread_local_storage_create(
+      &handle, NULL, sizeof(struct payload)) != libd_ok) {
+    fprintf(stderr, "failed to create thread local storage\n");
+    exit(1);
+  }
+  return handle;
+}
+
+static void
+_run_get(
+  const char* name,
+  libd_platform_thread_local_storage_handle_h* handle,
+  u32 ops)
+{
+  void* data;
+  libd_platform_thread_local_storage_get(handle, &data);
+
+  uint64_t start = bench_now_ns();
+  for (u32 i = 0; i < ops; i += 1) {
+    libd_platform_thread_local_storage_get(handle, &data);
+    BENCH_DO_NOT_OPTIMIZE(data);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report(name, 1, ops, elapsed);
+}
+
+static void
+_run_set(
+  const char* name,
+  libd_platform_thread_local_storage_handle_h* handle,
+  u32 ops)
+{
+  uint64_t start = bench_now_ns();
+  for (u32 i = 0; i < ops; i += 1) {
+    u64 value = i;
+    libd_platform_thread_local_storage_set(handle, _set_value, &value);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report(name, 1, ops, elapsed);
+}
+
+static void
+_run_pthread_key(u32 ops)
+{
+  pthread_key_t key;
+  pthread_key_create(&key, free);
+  pthread_setspecific(key, calloc(1, sizeof(struct payload)));
+
+  uint64_t start = bench_now_ns();
+  for (u32 i = 0; i < ops; i += 1) {
+    void* data = pthread_getspecific(key);
+    BENCH_DO_NOT_OPTIMIZE(data);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report("pthread_getspecific (baseline)", 1, ops, elapsed);
+
+  free(pthread_getspecific(key));
+  pthread_key_delete(key);
+}
+
+static void
+_run_compiler_tls(u32 ops)
+{
+  uint64_t start = bench_now_ns();
+  for (u32 i = 0; i < ops; i += 1) {
+    struct payload* data = &t_payload;
+    BENCH_DO_NOT_OPTIMIZE(data);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report("__thread address (floor)", 1, ops, elapsed);
+}
+
+static void*
+_worker(void* arg)
+{
+  struct shared* s = arg;
+
+  void* data;
+  libd_platform_thread_local_storage_get(s->handle, &data);
+  pthread_barrier_wait(&s->start);
+  for (u32 i = 0; i < s->ops; i += 1) {
+    libd_platform_thread_local_storage_get(s->handle, &data);
+    BENCH_DO_NOT_OPTIMIZE(data);
+  }
+
+  return NULL;
+}
+
+static void
+_run_threads(
+  libd_platform_thread_local_storage_handle_h* handle,
+  unsigned threads,
+  u32 ops)
+{
+  struct shared s = { .handle = handle, .ops = ops };
+  pthread_barrier_init(&s.start, NULL, threads + 1);
+
+  pthread_t* tids = malloc(threads * sizeof(*tids));
+  for (unsigned i = 0; i < threads; i += 1) {
+    pthread_create(&tids[i], NULL, _worker, &s);
+  }
+
+  uint64_t start = bench_now_ns();
+  pthread_barrier_wait(&s.start);
+  for (unsigned i = 0; i < threads; i += 1) {
+    pthread_join(tids[i], NULL);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report(
+    "tls get (fast path)", threads, (uint64_t)threads * ops, elapsed);
+
+  free(tids);
+  pthread_barrier_destroy(&s.start);
+}
+
+static void*
+_toucher(void* arg)
+{
+  struct touch* t = arg;
+
+  uint64_t start = bench_now_ns();
+  for (u32 i = 0; i < t->count; i += 1) {
+    void* data;
+    libd_platform_thread_local_storage_get(t->handles[i], &data);
+    BENCH_DO_NOT_OPTIMIZE(data);
+  }
+  t->elapsed += bench_now_ns() - start;
+
+  return NULL;
+}
+
+static void
+_run_first_touch(
+  const char* name,
+  libd_platform_thread_local_storage_handle_h** handles,
+  u32 rounds)
+{
+  struct touch t = { .handles = handles, .count = N_TOUCHED };
+
+  // only the gets are timed, not the thread's creation.
+  for (u32 r = 0; r < rounds; r += 1) {
+    pthread_t tid;
+    pthread_create(&tid, NULL, _toucher, &t);
+    pthread_join(tid, NULL);
+  }
+
+  bench_report(name, 1, rounds, t.elapsed);
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  u32 ops              = 50000000;
+  unsigned max_threads = bench_num_cpus();
+  if (argc > 1) {
+    ops = (u32)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    max_threads = (unsigned)strtoul(argv[2], NULL, 10);
+  }
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+
+  _run_compiler_tls(ops);
+  _run_pthread_key(ops);
+
+  libd_platform_thread_local_storage_handle_h* fast = _create();
+  _run_get("tls get (fast path)", fast, ops);
+  _run_set("tls set (fast path)", fast, ops);
+
+  libd_platform_thread_local_storage_handle_h* touched_block[N_TOUCHED];
+  for (u32 i = 0; i < N_TOUCHED; i += 1) {
+    touched_block[i] = _create();
+  }
+
+  // once every fast slot is taken, further handles only have their key.
+  libd_platform_thread_local_storage_handle_h*
+    fillers[LIBD_PLATFORM_TLS_FAST_SLOTS];
+  for (u32 i = 0; i < LIBD_PLATFORM_TLS_FAST_SLOTS; i += 1) {
+    fillers[i] = _create();
+  }
+  libd_platform_thread_local_storage_handle_h* keyed = _create();
+  _run_get("tls get (pthread key only)", keyed, ops);
+  _run_set("tls set (pthread key only)", keyed, ops);
+
+  libd_platform_thread_local_storage_handle_h* touched_keyed[N_TOUCHED];
+  for (u32 i = 0; i < N_TOUCHED; i += 1) {
+    touched_keyed[i] = _create();
+  }
+
+  for (unsigned t = 1; t <= max_threads; t *= 2) {
+    _run_threads(fast, t, ops);
+  }
+
+  u32 rounds = MAX(ops / 5000, 1u);
+  _run_first_touch("first get of 8 handles (block)", touched_block, rounds);
+  _run_first_touch("first get of 8 handles (keys)", touched_keyed, rounds);
+
+  for (u32 i = 0; i < N_TOUCHED; i += 1) {
+    libd_platform_thread_local_storage_destroy(touched_keyed[i]);
+    libd_platform_thread_local_storage_destroy(touched_block[i]);
+  }
+  libd_platform_thread_local_storage_destroy(keyed);
+  for (u32 i = 0; i < LIBD_PLATFORM_TLS_FAST_SLOTS; i += 1) {
+    libd_platform_thread_local_storage_destroy(fillers[i]);
+  }
+  libd_platform_thread_local_storage_destroy(fast);
+
+  return 0;
+}
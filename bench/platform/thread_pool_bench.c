@@ -0,0 +1,168 @@
+/*
+ * Scaling of the work-stealing thread pool on fine-grained tasks, from one
+ * worker up to one per cpu. Two shapes: a binary tree where every task
+ * submits its two children from inside the pool, so the work spreads by
+ * stealing, and flat batches submitted from the main thread through the
+ * shared queue. The same tree is also run as fork/join with task groups, and
+ * the flat work as one parallel_for. Each task does a few hundred nanoseconds
+ * of work; the same work run serially gives the floor.
+ *
+ * usage: thread_pool_bench [tree_depth] [work] [max_threads]
+ */
+
+#include "../../include/libd/platform/threads.h"
+#include "../bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BATCH 1024
+
+static libd_platform_thread_pool_h* g_pool;
+static u32 g_work = 64;
+
+static void
+_work(void)
+{
+  u64 x = 0x9e3779b97f4a7c15ull;
+  for (u32 i = 0; i < g_work; i += 1) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  BENCH_DO_NOT_OPTIMIZE(x);
+}
+
+static void
+_tree_node(void* arg)
+{
+  uintptr_t depth = (uintptr_t)arg;
+
+  _work();
+  if (depth > 0) {
+    libd_platform_thread_pool_submit(g_pool, _tree_node, (void*)(depth - 1));
+    libd_platform_thread_pool_submit(g_pool, _tree_node, (void*)(depth - 1));
+  }
+}
+
+static void
+_group_node(void* arg)
+{
+  uintptr_t depth = (uintptr_t)arg;
+
+  _work();
+  if (depth > 0) {
+    struct libd_platform_task_group group;
+    libd_platform_task_group_init(&group, g_pool);
+    libd_platform_task_group_spawn(&group, _group_node, (void*)(depth - 1));
+    _group_node((void*)(depth - 1));
+    libd_platform_task_group_wait(&group);
+  }
+}
+
+static void
+_flat_task(void* arg)
+{
+  (void)arg;
+  _work();
+}
+
+static void
+_flat_range(
+  struct libd_platform_range range,
+  void* ctx,
+  libd_linear_allocator_h* scratch)
+{
+  (void)ctx;
+  (void)scratch;
+  for (usize i = range.begin; i < range.end; i += 1) {
+    _work();
+  }
+}
+
+static void
+_run_serial(u64 n_tasks)
+{
+  uint64_t start = bench_now_ns();
+  for (u64 i = 0; i < n_tasks; i += 1) {
+    _work();
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  bench_report("serial (floor)", 1, n_tasks, elapsed);
+}
+
+static void
+_run_pool(
+  unsigned threads,
+  u32 depth)
+{
+  if (libd_platform_thread_pool_create(&g_pool, threads) != libd_ok) {
+    fprintf(stderr, "failed to create thread pool\n");
+    exit(1);
+  }
+
+  u64 n_tasks    = (2ull << depth) - 1;
+  uint64_t start = bench_now_ns();
+  libd_platform_thread_pool_submit(g_pool, _tree_node, (void*)(uintptr_t)depth);
+  libd_platform_thread_pool_wait(g_pool);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_report("pool tree (stealing)", threads, n_tasks, elapsed);
+
+  u64 n_batches = MAX(n_tasks / BATCH, 1ull);
+  start         = bench_now_ns();
+  for (u64 b = 0; b < n_batches; b += 1) {
+    for (u32 i = 0; i < BATCH; i += 1) {
+      libd_platform_thread_pool_submit(g_pool, _flat_task, NULL);
+    }
+    libd_platform_thread_pool_wait(g_pool);
+  }
+  elapsed = bench_now_ns() - start;
+  bench_report(
+    "pool flat batches (shared queue)", threads, n_batches * BATCH, elapsed);
+
+  start = bench_now_ns();
+  _group_node((void*)(uintptr_t)depth);
+  elapsed = bench_now_ns() - start;
+  bench_report("task group tree (fork/join)", threads, n_tasks, elapsed);
+
+  struct libd_platform_range range = { .begin = 0, .end = n_tasks };
+  start                            = bench_now_ns();
+  libd_platform_parallel_for(g_pool, range, 0, _flat_range, NULL);
+  elapsed = bench_now_ns() - start;
+  bench_report("parallel_for (auto grain)", threads, n_tasks, elapsed);
+
+  libd_platform_thread_pool_destroy(g_pool);
+}
+
+int
+main(
+  int argc,
+  char* argv[])
+{
+  u32 depth            = 18;
+  unsigned max_threads = bench_num_cpus();
+  if (argc > 1) {
+    depth = (u32)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    g_work = (u32)strtoul(argv[2], NULL, 10);
+  }
+  if (argc > 3) {
+    max_threads = (unsigned)strtoul(argv[3], NULL, 10);
+  }
+  if (max_threads == 0) {
+    max_threads = 1;
+  }
+
+  _run_serial((2ull << depth) - 1);
+  for (unsigned t = 1; t <= max_threads; t *= 2) {
+    _run_pool(t, depth);
+  }
+  if ((max_threads & (max_threads - 1)) != 0) {
+    _run_pool(max_threads, depth);
+  }
+
+  return 0;
+}
@@ -63,6 +63,14 @@ typedef size_t usize;
 #define MiB                           (1 << 20)
 #define GiB                           (1 << 30)
 
+#if defined(__GNUC__) || defined(__clang__)
+  #define LIBD_LIKELY(x)   __builtin_expect(!!(x), 1)
+  #define LIBD_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+  #define LIBD_LIKELY(x)   (x)
+  #define LIBD_UNLIKELY(x) (x)
+#endif
+
 //=============================================================================
 //  Libdane result codes
 //=============================================================================
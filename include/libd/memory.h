@@ -16,6 +16,18 @@
 // Type Definitions
 //==============================================================================
 
+/**
+ * @brief Byte patterns and redzone size of the memory_debug build option. In
+ * debug builds the linear and pool allocators fill released memory with
+ * LIBD_MEMORY_FREED_BYTE, the linear allocator leaves a redzone of at least
+ * LIBD_MEMORY_REDZONE_SIZE bytes filled with LIBD_MEMORY_GUARD_BYTE after
+ * every allocation, and under AddressSanitizer both poison all memory that is
+ * not handed out, so stray accesses are reported where they happen.
+ */
+#define LIBD_MEMORY_FREED_BYTE   0xDD
+#define LIBD_MEMORY_GUARD_BYTE   0xFD
+#define LIBD_MEMORY_REDZONE_SIZE 16
+
 /**
  * @brief Opaque handle for the linear allocator.
  * @note The allocator's data region is aligned to 16 bytes.
@@ -23,15 +35,195 @@
 typedef struct linear_allocator libd_linear_allocator_h;
 
 /**
- * @brief Opaque handle to a linear allocator checkpoint;
+ * @brief Linear allocator checkpoint. Complete so that it can live on the
+ * stack; its fields are private.
  */
 typedef struct linear_allocator_savepoint libd_linear_allocator_savepoint_h;
 
+struct linear_allocator_savepoint {
+  usize data_index;
+  u32 block_index;
+};
+
+/**
+ * @brief Linear allocator counters. Collected only when libd is built with the
+ * memory_stats option.
+ */
+struct libd_linear_allocator_stats {
+  u64 alloc_count;       /**< Successful alloc, alloc_aligned, alloc_fast and
+                            moving resize calls. */
+  u64 bytes_requested;   /**< Sum of the sizes asked for by those calls. */
+  u64 bytes_consumed;    /**< Sum of the arena space they used, including
+                            alignment padding. */
+  usize peak_head_index; /**< Furthest the head has reached in any block. */
+  usize committed_bytes; /**< Memory currently committed, headers included. */
+  u64 grow_count;        /**< mprotect calls that committed more of the
+                            reservation. */
+  u32 chained_blocks;    /**< Blocks currently chained on. */
+};
+
+/**
+ * @brief Creation options for the linear allocator. A zero-initialized struct
+ * selects the defaults.
+ */
+struct libd_linear_allocator_options {
+  /** When the reservation is full, map a new block instead of returning
+   * libd_no_memory. Each block doubles the size of the one before it up to
+   * max_block_size, or is as large as a bigger allocation needs. Reset and
+   * savepoints unmap every block chained on after them. */
+  bool chained;
+  /** Cap on the doubling of chained blocks. 0 selects 256 MiB. */
+  usize max_block_size;
+  /** When non-zero, growth commits this many bytes past the allocation that
+   * triggered it instead of doubling, and prefaults them
+   * (MADV_POPULATE_WRITE), so allocations that follow take no page faults.
+   * The starting capacity is prefaulted at creation. 0 commits lazily. */
+  usize commit_ahead_bytes;
+};
+
 /**
  * @brief Opaque handle for the slab allocator.
  */
 typedef struct pool_allocator libd_pool_allocator_h;
 
+/**
+ * @brief Order in which a pool allocator hands freed slots back out.
+ */
+enum libd_pool_allocator_free_order {
+  libd_pool_free_lifo, /**< Most recently freed slot first. O(1) free. */
+  libd_pool_free_address_ordered, /**< Lowest free slot first, packing live
+                                     slots towards the start of the pool.
+                                     Tracked with a bitmap of max_allocations
+                                     bits; double frees are rejected. */
+};
+
+/**
+ * @brief Where a pool allocator gets its slot memory from.
+ */
+enum libd_pool_allocator_backing {
+  libd_pool_backing_heap, /**< One malloc for the header and every slot. */
+  libd_pool_backing_mmap, /**< Address space for every slot is reserved up
+                             front and committed as slots are first handed
+                             out, so untouched slots cost no memory. */
+};
+
+/**
+ * @brief Huge page request for an mmap-backed pool allocator.
+ */
+enum libd_pool_allocator_huge_pages {
+  libd_pool_huge_pages_none,
+  libd_pool_huge_pages_transparent, /**< Huge page aligned reservation marked
+                                       with madvise(MADV_HUGEPAGE). */
+  libd_pool_huge_pages_explicit, /**< MAP_HUGETLB. Falls back to transparent
+                                    huge pages when the system has none
+                                    reserved. */
+};
+
+/**
+ * @brief Creation options for the pool allocator. A zero-initialized struct
+ * selects the defaults.
+ */
+struct libd_pool_allocator_options {
+  enum libd_pool_allocator_free_order free_order;
+  enum libd_pool_allocator_backing backing;
+  /** Requires libd_pool_backing_mmap. */
+  enum libd_pool_allocator_huge_pages huge_pages;
+  /** When full, chain a new chunk as large as the whole pool so far instead
+   * of returning libd_no_memory. max_allocations is the size of the first
+   * chunk. Existing slots never move. Requires libd_pool_backing_heap and
+   * libd_pool_free_lifo. */
+  bool growable;
+};
+
+/**
+ * @brief Pool allocator counters. Collected only when libd is built with the
+ * memory_stats option.
+ */
+struct libd_pool_allocator_stats {
+  u64 alloc_count;        /**< Slots handed out, one per slot of alloc_n. */
+  u64 free_count;         /**< Slots returned, one per slot of free_n. */
+  u64 failed_alloc_count; /**< alloc and alloc_n calls that ran out of
+                             slots. */
+  u32 live_slots;         /**< Slots currently allocated. */
+  u32 peak_live_slots;    /**< Most slots ever allocated at once. */
+  usize committed_bytes;  /**< Slot memory currently backed, in bytes. */
+};
+
+/**
+ * @brief Opaque handle for the size-class slab allocator.
+ */
+typedef struct slab_allocator libd_slab_allocator_h;
+
+/**
+ * @brief Opaque handle for the thread-safe pool allocator.
+ */
+typedef struct concurrent_pool_allocator libd_concurrent_pool_allocator_h;
+
+/**
+ * @brief Opaque handle for the lock-free pool allocator.
+ */
+typedef struct lockfree_pool_allocator libd_lockfree_pool_allocator_h;
+
+/**
+ * @brief Allocates size bytes from ctx into the out parameter.
+ */
+typedef enum libd_result (*libd_allocator_alloc_f)(
+  void*,
+  void**,
+  usize);
+
+/**
+ * @brief Resizes the allocation (ctx, out, ptr, old_size, new_size). A NULL
+ * ptr allocates.
+ */
+typedef enum libd_result (*libd_allocator_resize_f)(
+  void*,
+  void**,
+  void*,
+  usize,
+  usize);
+
+/**
+ * @brief Frees the allocation (ctx, ptr, size).
+ */
+typedef enum libd_result (*libd_allocator_free_f)(
+  void*,
+  void*,
+  usize);
+
+/**
+ * @brief Frees every allocation made from ctx.
+ */
+typedef enum libd_result (*libd_allocator_reset_f)(void*);
+
+/**
+ * @brief A type-erased allocator: a context pointer and the operations on it.
+ * Containers and routines that take one can run on an arena, a pool, the
+ * system heap, or any caller-supplied memory.
+ */
+struct libd_allocator {
+  void* ctx;
+  libd_allocator_alloc_f alloc;
+  libd_allocator_resize_f resize;
+  libd_allocator_free_f free;
+  libd_allocator_reset_f reset;
+};
+
+/**
+ * @brief Opaque handle for a set of per-thread scratch arenas.
+ */
+typedef struct scratch libd_scratch_h;
+
+/**
+ * @brief A scratch arena checked out by libd_scratch_begin. Allocate from
+ * arena with the linear allocator API and hand the scope back to
+ * libd_scratch_end.
+ */
+struct libd_scratch_scope {
+  libd_linear_allocator_h* arena;
+  libd_linear_allocator_savepoint_h savepoint;
+};
+
 //==============================================================================
 // Linear Allocator API
 //==============================================================================
@@ -50,10 +242,30 @@ typedef struct pool_allocator libd_pool_allocator_h;
 enum libd_result
 libd_linear_allocator_create(
   struct linear_allocator** out,
-  u32 reservation_size_bytes,
-  u32 starting_capacity_bytes,
+  usize reservation_size_bytes,
+  usize starting_capacity_bytes,
   u8 alignment);
 
+/**
+ * @brief Creates a linear allocator.
+ * @param out Out parameter for the allocator.
+ * @param reservation_size_bytes The amount of virtual address space to reserve
+ * for the allocator.
+ * @param starting_capacity_bytes Amount of bytes to initialize. Rounds to page
+ * boundaries.
+ * @param alignment Alignment value for the allocator. Must be a non-zero power
+ * of 2.
+ * @param options Creation options. NULL selects the defaults.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_linear_allocator_create_with_options(
+  struct linear_allocator** out,
+  usize reservation_size_bytes,
+  usize starting_capacity_bytes,
+  u8 alignment,
+  const struct libd_linear_allocator_options* options);
+
 /**
  * @brief Destroys the allocator.
  * @param la Handle for the arena.
@@ -74,7 +286,48 @@ enum libd_result
 libd_linear_allocator_alloc(
   libd_linear_allocator_h* la,
   void** out,
-  u32 size_bytes);
+  usize size_bytes);
+
+/**
+ * @brief Allocates memory in the arena at an alignment other than the one the
+ * allocator was created with, e.g. a cache line or SIMD aligned buffer in an
+ * arena that otherwise packs byte-aligned data.
+ * @param la Handle to the arena.
+ * @param out Out parameter for the pointer to the allocation.
+ * @param size_bytes Size in bytes for the allocation.
+ * @param alignment Alignment of the returned address. Must be a non-zero power
+ * of 2 no larger than the system page size.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_linear_allocator_alloc_aligned(
+  libd_linear_allocator_h* la,
+  void** out,
+  usize size_bytes,
+  u32 alignment);
+
+/**
+ * @brief Resizes an allocation. The most recent allocation is extended or
+ * shrunk in place; any other allocation is shrunk in place or moved to a new
+ * allocation with its contents copied, leaving the old one as waste until the
+ * next reset. Repeatedly growing the newest allocation, as a string builder or
+ * dynamic array does, therefore uses no more of the arena than its final size.
+ * @note A moved allocation gets the allocator's alignment, not the alignment
+ * it was allocated with through libd_linear_allocator_alloc_aligned.
+ * @param la Handle to the arena.
+ * @param out Out parameter for the resized allocation. May equal ptr.
+ * @param ptr The allocation to resize, or NULL to allocate new_size bytes.
+ * @param old_size The size ptr was allocated or last resized with.
+ * @param new_size The new size in bytes.
+ * @return libd_ok on success, non-zero otherwise. ptr is untouched on failure.
+ */
+enum libd_result
+libd_linear_allocator_resize(
+  libd_linear_allocator_h* la,
+  void** out,
+  void* ptr,
+  usize old_size,
+  usize new_size);
 
 /**
  * @brief Sets a savepoint which can be restored to.
@@ -121,11 +374,121 @@ libd_linear_allocator_bytes_free(
   libd_linear_allocator_h* la,
   size_t* out);
 
+/**
+ * @brief Commits and prefaults the next bytes of the arena past the head so
+ * that allocations into them take neither a commit nor a page fault. Meant to
+ * be called off the latency-critical path, e.g. right after a reset between
+ * requests.
+ * @note Clamped to the reservation, or to the current block of a chained
+ * allocator.
+ * @param la Handle to the allocator.
+ * @param bytes Number of bytes past the head to prepare.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_linear_allocator_prefault(
+  libd_linear_allocator_h* la,
+  size_t bytes);
+
+/**
+ * @brief Reads the allocator's counters.
+ * @param la Handle to the allocator.
+ * @param out Out parameter for the counters.
+ * @return libd_ok on success, libd_mem_not_implemented when libd was built
+ * without the memory_stats option, non-zero otherwise.
+ */
+enum libd_result
+libd_linear_allocator_get_stats(
+  libd_linear_allocator_h* la,
+  struct libd_linear_allocator_stats* out);
+
+/**
+ * @brief Returns committed pages beyond the current allocations and the first
+ * keep_bytes of the arena to the system, so a spike in usage does not stay
+ * resident. Trimmed pages are committed again on demand.
+ * @param la Handle to the allocator.
+ * @param keep_bytes Number of bytes to keep committed even if unused.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_linear_allocator_trim(
+  libd_linear_allocator_h* la,
+  size_t keep_bytes);
+
+/**
+ * @brief Makes libd_linear_allocator_reset and
+ * libd_linear_allocator_restore_savepoint trim the arena down to keep_bytes
+ * afterwards. By default nothing is trimmed.
+ * @param la Handle to the allocator.
+ * @param keep_bytes Number of bytes to keep committed, or SIZE_MAX to disable
+ * trimming.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_linear_allocator_set_trim_on_reset(
+  libd_linear_allocator_h* la,
+  size_t keep_bytes);
+
+//==============================================================================
+// Linear Allocator Inline Fast Path
+//==============================================================================
+
+/**
+ * @brief The bump state every linear allocator starts with. Public only so
+ * that libd_linear_allocator_alloc_fast can be inlined; never modify it
+ * directly.
+ */
+struct libd_linear_allocator_bump {
+  u8* data;
+  usize head_index;
+  usize curr_data_size;
+  usize alignment_mask;
+};
+
+/**
+ * @brief Inline equivalent of libd_linear_allocator_alloc. Bumps the head
+ * when the committed region has room and only calls out of line to grow it.
+ * Always calls out of line when LIBD_MEMORY_STATS or LIBD_MEMORY_DEBUG is
+ * defined, so that the allocation is counted and guarded.
+ * @warning Performs no parameter validation; la and out must be valid.
+ * @param la Handle to the allocator.
+ * @param out Out parameter for the pointer to the allocation.
+ * @param size_bytes Size in bytes for the allocation.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+static inline enum libd_result
+libd_linear_allocator_alloc_fast(
+  libd_linear_allocator_h* la,
+  void** out,
+  usize size_bytes)
+{
+#if defined(LIBD_MEMORY_STATS) || defined(LIBD_MEMORY_DEBUG)
+  // counted and guarded out of line.
+  return libd_linear_allocator_alloc(la, out, size_bytes);
+#else
+  struct libd_linear_allocator_bump* bump =
+    (struct libd_linear_allocator_bump*)la;
+
+  usize aligned_size = (size_bytes + bump->alignment_mask) &
+                       ~bump->alignment_mask;
+  if (
+    LIBD_LIKELY(aligned_size >= size_bytes) &&
+    LIBD_LIKELY(aligned_size <= bump->curr_data_size - bump->head_index)) {
+    *out = bump->data + bump->head_index;
+    bump->head_index += aligned_size;
+    return libd_ok;
+  }
+
+  return libd_linear_allocator_alloc(la, out, size_bytes);
+#endif
+}
+
 //==============================================================================
 // Pool Allocator API
 //==============================================================================
 
 /**
+ * @brief Creates a pool allocator with the default options (LIFO free order).
  * @return libd_ok on success, non-zero otherwise
  */
 enum libd_result
@@ -135,6 +498,23 @@ libd_pool_allocator_create(
   u32 bytes_per_alloc,
   u8 alignment);
 
+/**
+ * @brief Creates a pool allocator.
+ * @param pa Out parameter for the allocator.
+ * @param max_allocations Number of slots in the pool.
+ * @param bytes_per_alloc Size of each slot in bytes.
+ * @param alignment Alignment of each slot. Must be a non-zero power of 2.
+ * @param options Creation options. NULL selects the defaults.
+ * @return libd_ok on success, non-zero otherwise
+ */
+enum libd_result
+libd_pool_allocator_create_with_options(
+  libd_pool_allocator_h** pa,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 alignment,
+  const struct libd_pool_allocator_options* options);
+
 /**
  * @return libd_ok on success, non-zero otherwise
  */
@@ -163,6 +543,52 @@ libd_pool_allocator_free(
   libd_pool_allocator_h* pa,
   void* ptr);
 
+/**
+ * @brief Allocates n slots in one pass. Either all n are allocated or none
+ * are. Equivalent to n calls to libd_pool_allocator_alloc.
+ * @param pa Handle for the allocator.
+ * @param out Array of at least n entries receiving the allocations.
+ * @param n Number of slots to allocate.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_pool_allocator_alloc_n(
+  libd_pool_allocator_h* pa,
+  void** out,
+  u32 n);
+
+/**
+ * @brief Frees n allocations in one pass, in array order. Equivalent to n
+ * calls to libd_pool_allocator_free.
+ * @note On an invalid pointer, the allocations before it have been freed and
+ * the rest have not.
+ * @param pa Handle for the allocator.
+ * @param ptrs Array of n allocations to free.
+ * @param n Number of allocations to free.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_pool_allocator_free_n(
+  libd_pool_allocator_h* pa,
+  void** ptrs,
+  u32 n);
+
+/**
+ * @brief Checks whether the pointer is the start of a slot the pool has
+ * handed out since it was created or reset. Slots freed since still count.
+ * May be called while another thread allocates from a pool that does not
+ * grow.
+ * @param pa Handle for the allocator.
+ * @param ptr The pointer to check.
+ * @param out Out parameter set to true if the pool owns ptr, false otherwise.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_pool_allocator_owns(
+  const libd_pool_allocator_h* pa,
+  const void* ptr,
+  bool* out);
+
 /**
  * @brief Resets the pool, freeing all allocations.
  * @param pa Handle for the allocator.
@@ -171,4 +597,377 @@ libd_pool_allocator_free(
 enum libd_result
 libd_pool_allocator_reset(libd_pool_allocator_h* pa);
 
+/**
+ * @brief Reads the allocator's counters.
+ * @param pa Handle for the allocator.
+ * @param out Out parameter for the counters.
+ * @return libd_ok on success, libd_mem_not_implemented when libd was built
+ * without the memory_stats option, non-zero otherwise.
+ */
+enum libd_result
+libd_pool_allocator_get_stats(
+  const libd_pool_allocator_h* pa,
+  struct libd_pool_allocator_stats* out);
+
+//==============================================================================
+// Slab Allocator API
+//==============================================================================
+
+/**
+ * @brief Largest request served from a size class. Larger requests go to
+ * malloc.
+ */
+#define LIBD_SLAB_MAX_SIZE 4096
+
+/**
+ * @brief Creates a slab allocator. Requests are rounded up to one of 28 size
+ * classes: multiples of 16 up to 128, then four classes per power of two
+ * (each 1.25x, 1.2x, 1.17x and 1.14x the last) up to LIBD_SLAB_MAX_SIZE.
+ * Each class is a LIFO pool allocator in its own equally sized range of one
+ * address space reservation, so free finds the class from the pointer with a
+ * subtraction and a shift. Pages are committed as each class grows.
+ * @note Every allocation is aligned to 16 bytes. Not thread-safe.
+ * @param out Out parameter for the allocator.
+ * @param bytes_per_class Address space to reserve for each size class. Rounded
+ * up to a power of 2.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_slab_allocator_create(
+  libd_slab_allocator_h** out,
+  usize bytes_per_class);
+
+/**
+ * @brief Destroys the allocator. Allocations that fell through to malloc are
+ * not tracked and must be freed before this call.
+ * @param sa Handle for the allocator.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_slab_allocator_destroy(libd_slab_allocator_h* sa);
+
+/**
+ * @brief Allocates size bytes from the smallest class that fits, or from
+ * malloc if size exceeds LIBD_SLAB_MAX_SIZE.
+ * @param sa Handle for the allocator.
+ * @param out Out parameter for the pointer to the allocation.
+ * @param size_bytes Size of the allocation. Must be non-zero.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_slab_allocator_alloc(
+  libd_slab_allocator_h* sa,
+  void** out,
+  usize size_bytes);
+
+/**
+ * @brief Frees an allocation made by libd_slab_allocator_alloc. Pointers
+ * outside the reservation are passed to free.
+ * @param sa Handle for the allocator.
+ * @param ptr The allocation to free.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_slab_allocator_free(
+  libd_slab_allocator_h* sa,
+  void* ptr);
+
+/**
+ * @brief Frees every allocation served from a size class. Committed pages are
+ * kept for reuse.
+ * @param sa Handle for the allocator.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_slab_allocator_reset(libd_slab_allocator_h* sa);
+
+//==============================================================================
+// Concurrent Pool Allocator API
+//==============================================================================
+
+/**
+ * @brief Upper bound for the per-thread magazine size.
+ */
+#define LIBD_CONCURRENT_POOL_MAX_MAGAZINE_SIZE 1024
+
+/**
+ * @brief Creates a thread-safe pool allocator. Each thread caches up to
+ * magazine_size free slots, so the common alloc/free path touches no shared
+ * state. Magazines are refilled from, and flushed to, a shared pool in batches
+ * of magazine_size / 2 under a lock.
+ * @note Slots cached in other threads' magazines are not available to the
+ * calling thread, so the pool may report libd_no_memory before all
+ * max_allocations slots are in use.
+ * @param out Out parameter for the allocator.
+ * @param max_allocations Number of slots in the shared pool.
+ * @param bytes_per_alloc Size of each slot in bytes.
+ * @param alignment Alignment of each slot. Must be a non-zero power of 2.
+ * @param magazine_size Number of slots cached per thread. Must be in
+ * [2, LIBD_CONCURRENT_POOL_MAX_MAGAZINE_SIZE].
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_concurrent_pool_allocator_create(
+  libd_concurrent_pool_allocator_h** out,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 alignment,
+  u32 magazine_size);
+
+/**
+ * @brief Destroys the allocator.
+ * @warning Must not be called while other threads are using the allocator.
+ * Threads that exit before this call return their magazines automatically.
+ * @param cpa Handle for the allocator.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_concurrent_pool_allocator_destroy(libd_concurrent_pool_allocator_h* cpa);
+
+/**
+ * @brief Allocates a slot from the calling thread's magazine, refilling it
+ * from the shared pool when empty.
+ * @param cpa Handle for the allocator.
+ * @param out Out parameter for the pointer to the allocation.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_concurrent_pool_allocator_alloc(
+  libd_concurrent_pool_allocator_h* cpa,
+  void** out);
+
+/**
+ * @brief Frees a slot into the calling thread's magazine, flushing a batch to
+ * the shared pool when full. The slot may have been allocated by any thread.
+ * @param cpa Handle for the allocator.
+ * @param ptr The allocation to free.
+ * @return libd_ok on success, libd_invalid_pointer if ptr is not a slot the
+ * pool has handed out, non-zero otherwise.
+ */
+enum libd_result
+libd_concurrent_pool_allocator_free(
+  libd_concurrent_pool_allocator_h* cpa,
+  void* ptr);
+
+/**
+ * @brief Returns every slot cached by the calling thread to the shared pool.
+ * @param cpa Handle for the allocator.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_concurrent_pool_allocator_thread_flush(
+  libd_concurrent_pool_allocator_h* cpa);
+
+//==============================================================================
+// Lock-free Pool Allocator API
+//==============================================================================
+
+/**
+ * @brief Creates a pool allocator whose free list is a lock-free (Treiber)
+ * stack. Any thread may allocate, and any thread may free a slot allocated by
+ * another, without a lock. The list head packs the slot index with a
+ * generation counter in one 64-bit word to defeat ABA.
+ * @param out Out parameter for the allocator.
+ * @param max_allocations Number of slots in the pool.
+ * @param bytes_per_alloc Size of each slot in bytes.
+ * @param alignment Alignment of each slot. Must be a non-zero power of 2.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_lockfree_pool_allocator_create(
+  libd_lockfree_pool_allocator_h** out,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 alignment);
+
+/**
+ * @brief Destroys the allocator.
+ * @param pa Handle for the allocator.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_lockfree_pool_allocator_destroy(libd_lockfree_pool_allocator_h* pa);
+
+/**
+ * @brief Pops a free slot. Safe to call concurrently from any thread.
+ * @param pa Handle for the allocator.
+ * @param out Out parameter for the pointer to the allocation.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_lockfree_pool_allocator_alloc(
+  libd_lockfree_pool_allocator_h* pa,
+  void** out);
+
+/**
+ * @brief Pushes a slot back onto the free list. Safe to call concurrently
+ * from any thread.
+ * @param pa Handle for the allocator.
+ * @param ptr The allocation to free.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_lockfree_pool_allocator_free(
+  libd_lockfree_pool_allocator_h* pa,
+  void* ptr);
+
+/**
+ * @brief Resets the pool, freeing all allocations.
+ * @warning Not thread-safe; no other thread may use the pool during a reset.
+ * @param pa Handle for the allocator.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_lockfree_pool_allocator_reset(libd_lockfree_pool_allocator_h* pa);
+
+//==============================================================================
+// Allocator Interface
+//==============================================================================
+
+/**
+ * @brief Wraps a linear allocator. Free rewinds the head when ptr is the most
+ * recent allocation and does nothing otherwise; resize is
+ * libd_linear_allocator_resize.
+ * @param out Out parameter for the interface.
+ * @param la Handle to the arena. Must outlive the interface.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_allocator_from_linear(
+  struct libd_allocator* out,
+  libd_linear_allocator_h* la);
+
+/**
+ * @brief Wraps a pool allocator. Allocations and resizes larger than a slot
+ * fail with libd_invalid_parameter; anything smaller takes a whole slot.
+ * @param out Out parameter for the interface.
+ * @param pa Handle for the pool. Must outlive the interface.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_allocator_from_pool(
+  struct libd_allocator* out,
+  libd_pool_allocator_h* pa);
+
+/**
+ * @brief The system heap: malloc, realloc and free. Reset returns
+ * libd_mem_not_implemented.
+ * @param out Out parameter for the interface.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_allocator_system(struct libd_allocator* out);
+
+/**
+ * @brief Allocates through the interface.
+ */
+static inline enum libd_result
+libd_allocator_alloc(
+  const struct libd_allocator* a,
+  void** out,
+  usize size_bytes)
+{
+  return a->alloc(a->ctx, out, size_bytes);
+}
+
+/**
+ * @brief Resizes through the interface. out may equal &ptr.
+ */
+static inline enum libd_result
+libd_allocator_resize(
+  const struct libd_allocator* a,
+  void** out,
+  void* ptr,
+  usize old_size_bytes,
+  usize new_size_bytes)
+{
+  return a->resize(a->ctx, out, ptr, old_size_bytes, new_size_bytes);
+}
+
+/**
+ * @brief Frees through the interface.
+ */
+static inline enum libd_result
+libd_allocator_free(
+  const struct libd_allocator* a,
+  void* ptr,
+  usize size_bytes)
+{
+  return a->free(a->ctx, ptr, size_bytes);
+}
+
+/**
+ * @brief Resets through the interface.
+ */
+static inline enum libd_result
+libd_allocator_reset(const struct libd_allocator* a)
+{
+  return a->reset(a->ctx);
+}
+
+//==============================================================================
+// Scratch Arena API
+//==============================================================================
+
+/**
+ * @brief Number of scratch arenas each thread gets.
+ */
+#define LIBD_SCRATCH_ARENAS_PER_THREAD 2
+
+/**
+ * @brief Creates a set of per-thread scratch arenas. Each thread that calls
+ * libd_scratch_begin lazily gets LIBD_SCRATCH_ARENAS_PER_THREAD chained linear
+ * allocators of its own, so scratch allocations never take a lock or call
+ * malloc after the first use.
+ * @param out Out parameter for the handle.
+ * @param reservation_size_bytes Reservation of each arena's first block.
+ * Arenas chain further blocks as needed.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_scratch_create(
+  libd_scratch_h** out,
+  usize reservation_size_bytes);
+
+/**
+ * @brief Destroys the handle and the arenas of every thread that used it.
+ * @warning Must not be called while other threads are using the handle.
+ * Threads that exit before this call release their arenas automatically.
+ * @param s Handle for the scratch arenas.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_scratch_destroy(libd_scratch_h* s);
+
+/**
+ * @brief Checks out one of the calling thread's arenas and records a savepoint
+ * in it. Scopes nest; each must be ended in reverse order of beginning.
+ * @note Pass the arenas a function's results are allocated in as conflicts so
+ * its temporaries land in a different arena. Ending the temporary scope then
+ * cannot free the results, even when the caller's results arena is itself a
+ * scratch arena.
+ * @param s Handle for the scratch arenas.
+ * @param conflicts Arenas the returned scope must not use. May be NULL when
+ * n_conflicts is 0.
+ * @param n_conflicts Number of entries in conflicts.
+ * @param out Out parameter for the scope.
+ * @return libd_ok on success, libd_invalid_parameter when every arena of the
+ * thread conflicts, non-zero otherwise.
+ */
+enum libd_result
+libd_scratch_begin(
+  libd_scratch_h* s,
+  libd_linear_allocator_h* const* conflicts,
+  u32 n_conflicts,
+  struct libd_scratch_scope* out);
+
+/**
+ * @brief Frees everything allocated in the scope's arena since its
+ * libd_scratch_begin, including by nested scopes.
+ * @param scope The scope to end.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_scratch_end(const struct libd_scratch_scope* scope);
+
 #endif  // LIBDANE_MEMORY_H
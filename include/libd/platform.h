@@ -11,6 +11,7 @@
 //==============================================================================
 
 #include "platform/filesystem.h"
+#include "platform/sync.h"
 #include "platform/threads.h"
 
 #endif  // LIBD_PLATFORM_H
@@ -0,0 +1,278 @@
+/**
+ * @file sync.h
+ * @brief Futex-based locks and thread coordination primitives
+ */
+
+#ifndef LIBD_PLATFORM_SYNC_H
+#define LIBD_PLATFORM_SYNC_H
+
+#include "../common.h"
+
+#include <stdbool.h>
+
+//==============================================================================
+// Type Definitions
+//==============================================================================
+
+// Every primitive is a plain struct of 32-bit words that threads sleep on
+// with the futex calls below, so they can be embedded anywhere, need no
+// destroy, and take no syscall unless a thread has to sleep or be woken. The
+// fields are private.
+
+/**
+ * @brief A mutual exclusion lock in one word. Contended lockers spin briefly
+ * before sleeping.
+ */
+struct libd_platform_mutex {
+  u32 state; /**< 0 unlocked, 1 locked, 2 locked with sleepers. */
+};
+
+/**
+ * @brief A reader-writer lock. Once a writer is waiting new readers queue
+ * behind it, so writers are not starved.
+ */
+struct libd_platform_rwlock {
+  u32 state;         /**< Readers or the write lock, and waiting flags. */
+  u32 writer_notify; /**< Bumped to wake sleeping writers. */
+};
+
+/**
+ * @brief A one-shot event. Once set it stays set, and every wait returns.
+ */
+struct libd_platform_event {
+  u32 state; /**< 0 unset, 1 unset with sleepers, 2 set. */
+};
+
+/**
+ * @brief A countdown latch, which doubles as a wait group: waiters block
+ * until the count reaches 0.
+ */
+struct libd_platform_latch {
+  u32 state; /**< Twice the count, plus 1 while a waiter sleeps. */
+};
+
+/**
+ * @brief A reusable barrier for a fixed number of threads.
+ */
+struct libd_platform_barrier {
+  u32 threshold;
+  u32 arrived;
+  u32 generation;
+};
+
+#define LIBD_PLATFORM_MUTEX_INIT  { 0 }
+#define LIBD_PLATFORM_RWLOCK_INIT { 0, 0 }
+#define LIBD_PLATFORM_EVENT_INIT  { 0 }
+
+//==============================================================================
+// Mutex API
+//==============================================================================
+
+/**
+ * @brief Initializes an unlocked mutex. Same as LIBD_PLATFORM_MUTEX_INIT.
+ * @param mutex The mutex.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_mutex_init(struct libd_platform_mutex* mutex);
+
+/**
+ * @brief Acquires the mutex, spinning a little and then sleeping while
+ * another thread holds it. Not recursive.
+ * @param mutex The mutex.
+ */
+void
+libd_platform_mutex_lock(struct libd_platform_mutex* mutex);
+
+/**
+ * @brief Acquires the mutex if it is free.
+ * @param mutex The mutex.
+ * @return true if the mutex was acquired.
+ */
+bool
+libd_platform_mutex_try_lock(struct libd_platform_mutex* mutex);
+
+/**
+ * @brief Releases the mutex held by the calling thread.
+ * @param mutex The mutex.
+ */
+void
+libd_platform_mutex_unlock(struct libd_platform_mutex* mutex);
+
+//==============================================================================
+// Reader-Writer Lock API
+//==============================================================================
+
+/**
+ * @brief Initializes an unlocked rwlock. Same as LIBD_PLATFORM_RWLOCK_INIT.
+ * @param rwlock The lock.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_rwlock_init(struct libd_platform_rwlock* rwlock);
+
+/**
+ * @brief Acquires shared access. Blocks while a writer holds or waits for
+ * the lock.
+ * @warning Not recursive: a thread already reading may deadlock against a
+ * waiting writer.
+ * @param rwlock The lock.
+ */
+void
+libd_platform_rwlock_read_lock(struct libd_platform_rwlock* rwlock);
+
+/**
+ * @brief Releases shared access.
+ * @param rwlock The lock.
+ */
+void
+libd_platform_rwlock_read_unlock(struct libd_platform_rwlock* rwlock);
+
+/**
+ * @brief Acquires exclusive access.
+ * @param rwlock The lock.
+ */
+void
+libd_platform_rwlock_write_lock(struct libd_platform_rwlock* rwlock);
+
+/**
+ * @brief Releases exclusive access.
+ * @param rwlock The lock.
+ */
+void
+libd_platform_rwlock_write_unlock(struct libd_platform_rwlock* rwlock);
+
+//==============================================================================
+// Event API
+//==============================================================================
+
+/**
+ * @brief Initializes an unset event. Same as LIBD_PLATFORM_EVENT_INIT.
+ * @param event The event.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_event_init(struct libd_platform_event* event);
+
+/**
+ * @brief Sets the event and wakes every waiter. Setting it again does
+ * nothing. Writes made before set are visible to threads returning from
+ * wait.
+ * @param event The event.
+ */
+void
+libd_platform_event_set(struct libd_platform_event* event);
+
+/**
+ * @brief Checks whether the event is set, without blocking.
+ * @param event The event.
+ * @return true once the event is set.
+ */
+bool
+libd_platform_event_is_set(struct libd_platform_event* event);
+
+/**
+ * @brief Blocks until the event is set.
+ * @param event The event.
+ */
+void
+libd_platform_event_wait(struct libd_platform_event* event);
+
+//==============================================================================
+// Latch API
+//==============================================================================
+
+/**
+ * @brief Initializes a latch.
+ * @param latch The latch.
+ * @param count The initial count, at most U32_MAX / 2.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_latch_init(
+  struct libd_platform_latch* latch,
+  u32 count);
+
+/**
+ * @brief Raises the count, as a wait group does before starting work.
+ * @param latch The latch.
+ * @param n The amount to add.
+ */
+void
+libd_platform_latch_add(
+  struct libd_platform_latch* latch,
+  u32 n);
+
+/**
+ * @brief Lowers the count, waking the waiters when it reaches 0. Writes made
+ * before count_down are visible to threads returning from wait.
+ * @warning Counting down below 0 is undefined behavior.
+ * @param latch The latch.
+ * @param n The amount to subtract.
+ */
+void
+libd_platform_latch_count_down(
+  struct libd_platform_latch* latch,
+  u32 n);
+
+/**
+ * @brief Blocks until the count is 0. Any number of threads may wait. The
+ * latch can be counted up again once the waiters have returned.
+ * @param latch The latch.
+ */
+void
+libd_platform_latch_wait(struct libd_platform_latch* latch);
+
+//==============================================================================
+// Barrier API
+//==============================================================================
+
+/**
+ * @brief Initializes a barrier.
+ * @param barrier The barrier.
+ * @param threshold The number of threads that meet at it, at least 1.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_barrier_init(
+  struct libd_platform_barrier* barrier,
+  u32 threshold);
+
+/**
+ * @brief Blocks until threshold threads have called wait, then releases
+ * them all and resets for the next phase. Writes made before wait by any of
+ * the threads are visible to all of them afterwards.
+ * @param barrier The barrier.
+ * @return true for exactly one thread of each phase, false for the others.
+ */
+bool
+libd_platform_barrier_wait(struct libd_platform_barrier* barrier);
+
+//==============================================================================
+// Futex API
+//==============================================================================
+
+/**
+ * @brief Blocks the calling thread while *addr holds expected. May return
+ * spuriously, so callers re-check their condition in a loop. Uses a futex on
+ * Linux and hashed condition variables elsewhere.
+ * @param addr The word to wait on.
+ * @param expected The value *addr held when the caller decided to sleep.
+ */
+void
+libd_platform_futex_wait(
+  u32* addr,
+  u32 expected);
+
+/**
+ * @brief Wakes up to n threads blocked on addr. Callers change *addr before
+ * waking.
+ * @param addr The word the threads wait on.
+ * @param n The number of threads to wake, U32_MAX for all of them.
+ */
+void
+libd_platform_futex_wake(
+  u32* addr,
+  u32 n);
+
+#endif  // LIBD_PLATFORM_SYNC_H
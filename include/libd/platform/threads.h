@@ -7,6 +7,7 @@
 #define LIBD_PLATFORM_THREAD_H
 
 #include "../common.h"
+#include "../memory.h"
 
 #include <stddef.h>
 
@@ -27,11 +28,16 @@ typedef int (*libd_platform_thread_local_storage_data_setter_f)(
   void*);
 
 /**
- * @brief The destructor to register for the data being stored. Is called
- * automatically upon thread key destruction.
+ * @brief The cleanup to register for the data being stored. Is called
+ * automatically with each thread's data when that thread exits. The storage
+ * itself belongs to the handle and must not be freed, so the cleanup only
+ * releases what the data refers to.
  * @param arg1 Void pointer to the stored data
+ * @param arg2 The size the handle was created with
  */
-typedef void (*libd_platform_thread_local_storage_destructor_f)(void*);
+typedef void (*libd_platform_thread_local_storage_cleanup_f)(
+  void*,
+  size_t);
 
 /**
  * @brief Opaque handle for thread local storage
@@ -39,6 +45,100 @@ typedef void (*libd_platform_thread_local_storage_destructor_f)(void*);
 typedef struct thread_local_storage_handle
   libd_platform_thread_local_storage_handle_h;
 
+#if defined(__GNUC__) || defined(__clang__)
+  #define LIBD_PLATFORM_THREAD_LOCAL __thread
+#else
+  #define LIBD_PLATFORM_THREAD_LOCAL _Thread_local
+#endif
+
+/**
+ * @brief Number of live handles whose data is found through compiler TLS.
+ * Further handles fall back to a pthread key of their own.
+ */
+#define LIBD_PLATFORM_TLS_FAST_SLOTS 64
+
+/**
+ * @brief The state every thread local storage handle starts with. Public only
+ * so that libd_platform_thread_local_storage_get can be inlined, must not be
+ * touched by callers. Handles without a fast slot use slot
+ * LIBD_PLATFORM_TLS_FAST_SLOTS, whose entry never matches.
+ */
+struct libd_platform_thread_local_storage_prefix {
+  u32 slot;
+  u64 generation;
+};
+
+/**
+ * @brief A thread's cached address for one fast slot, valid while its
+ * generation matches the handle's.
+ */
+struct libd_platform_thread_local_storage_slot {
+  void* data;
+  u64 generation;
+};
+
+/**
+ * @brief The calling thread's fast slots, plus one that is always empty.
+ * Public only for the inline get.
+ */
+extern LIBD_PLATFORM_THREAD_LOCAL struct libd_platform_thread_local_storage_slot
+  libd_platform_tls_slots[LIBD_PLATFORM_TLS_FAST_SLOTS + 1];
+
+/**
+ * @brief A task run by a thread pool worker.
+ * @param arg1 The argument given when the task was submitted
+ */
+typedef void (*libd_platform_thread_pool_task_f)(void*);
+
+/**
+ * @brief Opaque handle for a thread pool
+ */
+typedef struct thread_pool libd_platform_thread_pool_h;
+
+/**
+ * @brief Optional thread pool configuration. Fields left at 0 take their
+ * default.
+ */
+struct libd_platform_thread_pool_options {
+  u32 max_tasks;      /**< Tasks submitted and not yet started, at most. The
+                           default is 4096. */
+  u32 deque_capacity; /**< Tasks each worker can queue for itself. Must be a
+                           power of 2, the default is 1024. */
+  usize scratch_size; /**< Reservation of the first block of each thread's
+                           parallel_for scratch arenas. The default is
+                           256 KiB. */
+};
+
+/**
+ * @brief A set of tasks that can be waited on together. Groups live wherever
+ * the caller puts them, typically on the stack of the function that spawns
+ * and waits. The fields are private.
+ */
+struct libd_platform_task_group {
+  libd_platform_thread_pool_h* pool;
+  u32 state; /**< Twice the running tasks, plus 1 while a waiter sleeps. */
+};
+
+/**
+ * @brief A half-open range of indices.
+ */
+struct libd_platform_range {
+  usize begin;
+  usize end;
+};
+
+/**
+ * @brief The body of a parallel_for, run once per chunk of the range.
+ * @param arg1 The chunk to process
+ * @param arg2 The context given to parallel_for
+ * @param arg3 A scratch arena of the running thread. Everything allocated in
+ * it is freed when the chunk returns.
+ */
+typedef void (*libd_platform_parallel_for_f)(
+  struct libd_platform_range,
+  void*,
+  libd_linear_allocator_h*);
+
 //==============================================================================
 // Thread Local Storage API
 //==============================================================================
@@ -46,16 +146,21 @@ typedef struct thread_local_storage_handle
 /**
  * @brief Creates thread local storage handle once (thread-safe singleton)
  * @param pp_handle Pointer to receive the handle
+ * @param cleanup Called with each thread's data as the thread exits, or NULL
+ * @param size The size of each thread's data
  * @return RESULT_OK on success, error code otherwise
  */
 enum libd_result
 libd_platform_thread_local_storage_create(
   libd_platform_thread_local_storage_handle_h** p_handle,
-  libd_platform_thread_local_storage_destructor_f destructor,
+  libd_platform_thread_local_storage_cleanup_f cleanup,
   size_t size);
 
 /**
- * @brief Destroys thread local storage associated with the provided handle
+ * @brief Destroys thread local storage associated with the provided handle.
+ * Cleanups are not run, callers release what the data of the calling thread
+ * refers to beforehand. Cleanups already running on exiting threads are
+ * waited for, so whatever they use can be freed once this returns.
  * @param p_handle Handle to the data to destroy
  */
 enum libd_result
@@ -63,16 +168,44 @@ libd_platform_thread_local_storage_destroy(
   libd_platform_thread_local_storage_handle_h* handle);
 
 /**
- * @brief Gets data from thread local storage
+ * @brief Out of line part of libd_platform_thread_local_storage_get, for the
+ * first access from a thread and for handles without a fast slot.
  * @param p_handle Storage handle
  * @param data Pointer to receive the data
  * @return RESULT_OK on success, error code otherwise
  */
 enum libd_result
-libd_platform_thread_local_storage_get(
+libd_platform_thread_local_storage_get_slow(
   libd_platform_thread_local_storage_handle_h* handle,
   void** data);
 
+/**
+ * @brief Gets data from thread local storage. The first access from a thread
+ * allocates its storage, zero-initialized. Once it has, a handle with a fast
+ * slot is resolved inline from the calling thread's slot table.
+ * @param p_handle Storage handle
+ * @param data Pointer to receive the data
+ * @return RESULT_OK on success, error code otherwise
+ */
+static inline enum libd_result
+libd_platform_thread_local_storage_get(
+  libd_platform_thread_local_storage_handle_h* handle,
+  void** data)
+{
+  if (LIBD_LIKELY(handle != NULL)) {
+    const struct libd_platform_thread_local_storage_prefix* prefix =
+      (const struct libd_platform_thread_local_storage_prefix*)handle;
+    const struct libd_platform_thread_local_storage_slot* slot =
+      &libd_platform_tls_slots[prefix->slot];
+    if (LIBD_LIKELY(slot->generation == prefix->generation)) {
+      *data = slot->data;
+      return libd_ok;
+    }
+  }
+
+  return libd_platform_thread_local_storage_get_slow(handle, data);
+}
+
 /**
  * @brief Sets data in thread local storage.
  * @param p_handle Storage handle.
@@ -90,14 +223,14 @@ libd_platform_thread_local_storage_set(
  * @brief Initializes the singleton thread-local storage slot (idempotent).
  * @warning Calling init from multiple threads is undefined behavior. Call init
  * first. Note that this API commits the calling process to the registered data
- * size and destructor.
- * @param destructor Registered callback to clean up stored data.
+ * size and cleanup.
+ * @param cleanup Registered callback to clean up stored data.
  * @param size The size to allocate.
  * @return RESULT_OK on success, non-zero otherwise.
  */
 enum libd_result
 libd_platform_thread_local_static_init(
-  libd_platform_thread_local_storage_destructor_f destructor,
+  libd_platform_thread_local_storage_cleanup_f cleanup,
   size_t size);
 
 /**
@@ -126,4 +259,148 @@ libd_platform_thread_local_static_set(
 enum libd_result
 libd_platform_thread_local_static_cleanup(void);
 
+//==============================================================================
+// Thread Pool API
+//==============================================================================
+
+/**
+ * @brief Creates a work-stealing thread pool. Each worker queues the tasks it
+ * submits on its own Chase-Lev deque and runs them newest first, while idle
+ * workers steal the oldest tasks of the others. Tasks submitted from other
+ * threads go through a shared queue. Workers with nothing to run park on a
+ * futex until work arrives.
+ * @param out Out parameter for the pool.
+ * @param n_workers Number of worker threads, 0 for one per online cpu.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_thread_pool_create(
+  libd_platform_thread_pool_h** out,
+  u32 n_workers);
+
+/**
+ * @brief Creates a thread pool with the given options.
+ * @param out Out parameter for the pool.
+ * @param n_workers Number of worker threads, 0 for one per online cpu.
+ * @param options The configuration, NULL for the defaults.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_thread_pool_create_with_options(
+  libd_platform_thread_pool_h** out,
+  u32 n_workers,
+  const struct libd_platform_thread_pool_options* options);
+
+/**
+ * @brief Waits for every submitted task to run, then stops the workers and
+ * destroys the pool.
+ * @warning Must not be called from a task.
+ * @param pool Handle for the pool.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_thread_pool_destroy(libd_platform_thread_pool_h* pool);
+
+/**
+ * @brief Submits a task. Tasks are allocated from a concurrent pool
+ * allocator, so submitting does not touch the heap.
+ * @note Called from a task of the same pool, the task runs inline when it
+ * cannot be queued, so it never fails.
+ * @param pool Handle for the pool.
+ * @param task The function to run.
+ * @param arg Argument passed to task.
+ * @return libd_ok on success, libd_no_memory when max_tasks tasks are waiting
+ * to start, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_thread_pool_submit(
+  libd_platform_thread_pool_h* pool,
+  libd_platform_thread_pool_task_f task,
+  void* arg);
+
+/**
+ * @brief Blocks until every submitted task has run, including the tasks they
+ * submit. The calling thread runs queued tasks while it waits.
+ * @warning Must not be called from a task.
+ * @param pool Handle for the pool.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_thread_pool_wait(libd_platform_thread_pool_h* pool);
+
+/**
+ * @brief Gets the number of worker threads.
+ * @param pool Handle for the pool.
+ * @return The number of workers, 0 if pool is NULL.
+ */
+u32
+libd_platform_thread_pool_worker_count(libd_platform_thread_pool_h* pool);
+
+//==============================================================================
+// Task Group API
+//==============================================================================
+
+/**
+ * @brief Initializes a task group on a pool.
+ * @param group The group to initialize.
+ * @param pool Handle for the pool its tasks run on.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_task_group_init(
+  struct libd_platform_task_group* group,
+  libd_platform_thread_pool_h* pool);
+
+/**
+ * @brief Spawns a task in the group. A task that cannot be queued runs
+ * inline, so spawning never fails for lack of room.
+ * @param group The group.
+ * @param task The function to run.
+ * @param arg Argument passed to task.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_task_group_spawn(
+  struct libd_platform_task_group* group,
+  libd_platform_thread_pool_task_f task,
+  void* arg);
+
+/**
+ * @brief Blocks until every task spawned in the group has run, including the
+ * tasks they spawn in it. The calling thread runs queued tasks while it
+ * waits, so unlike the pool wait this may be called from a task, which is how
+ * fork/join nests. The group can be reused afterwards.
+ * @warning Only one thread may wait on a group at a time.
+ * @param group The group.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_platform_task_group_wait(struct libd_platform_task_group* group);
+
+//==============================================================================
+// Parallel For API
+//==============================================================================
+
+/**
+ * @brief Runs fn over range on the pool and returns once every chunk is done.
+ * The range is split in halves, one spawned and one kept, until the pieces
+ * are no larger than grain, so idle workers steal large pieces first. Each
+ * chunk gets a scratch arena of the thread running it.
+ * @param pool Handle for the pool.
+ * @param range The indices to process.
+ * @param grain Largest chunk handed to fn, 0 to pick one that gives each
+ * worker about 8 chunks.
+ * @param fn The body.
+ * @param ctx Context passed to every call of fn.
+ * @return libd_ok on success, non-zero if a scratch arena could not be
+ * created, in which case the chunks that needed it were skipped.
+ */
+enum libd_result
+libd_platform_parallel_for(
+  libd_platform_thread_pool_h* pool,
+  struct libd_platform_range range,
+  usize grain,
+  libd_platform_parallel_for_f fn,
+  void* ctx);
+
 #endif  // LIBD_PLATFORM_THREAD_H
@@ -219,14 +219,17 @@ libd_assert_op(
 #define ASSERT_GE_S(lhs, rhs, ...)                          \
   ASSERT_OP(ge_s_pred, lhs, rhs, "%" PRId64, ##__VA_ARGS__)
 
-#define ASSERT_EQ_PTR(lhs, rhs, ...)                  \
-  ASSERT_OP(eq_u_pred, lhs, rhs, "%p", ##__VA_ARGS__)
-#define ASSERT_NE_PTR(lhs, rhs, ...)                  \
-  ASSERT_OP(ne_u_pred, lhs, rhs, "%p", ##__VA_ARGS__)
-#define ASSERT_NULL(ptr, ...)                          \
-  ASSERT_OP(eq_u_pred, ptr, NULL, "%p", ##__VA_ARGS__)
-#define ASSERT_NOT_NULL(ptr, ...)                      \
-  ASSERT_OP(ne_u_pred, ptr, NULL, "%p", ##__VA_ARGS__)
+// the predicates compare uintptr_t, so pointers are cast on the way in.
+#define ASSERT_EQ_PTR(lhs, rhs, ...) \
+  ASSERT_OP(                         \
+    eq_u_pred, (uintptr_t)(lhs), (uintptr_t)(rhs), "%p", ##__VA_ARGS__)
+#define ASSERT_NE_PTR(lhs, rhs, ...) \
+  ASSERT_OP(                         \
+    ne_u_pred, (uintptr_t)(lhs), (uintptr_t)(rhs), "%p", ##__VA_ARGS__)
+#define ASSERT_NULL(ptr, ...) \
+  ASSERT_OP(eq_u_pred, (uintptr_t)(ptr), (uintptr_t)NULL, "%p", ##__VA_ARGS__)
+#define ASSERT_NOT_NULL(ptr, ...) \
+  ASSERT_OP(ne_u_pred, (uintptr_t)(ptr), (uintptr_t)NULL, "%p", ##__VA_ARGS__)
 
 // #define ASSERT_EQ_MEM(lhs, rhs, len, ...)
 
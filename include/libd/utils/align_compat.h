@@ -7,21 +7,26 @@
  * Cross-version, cross-compiler alignment compatibility layer.
  * Provides:
  *   - LIBD_ALIGNOF(type): yields the alignment requirement of 'type'
+ *   - LIBD_ALIGNAS(n): aligns a declaration to n bytes
  *   - LIBD_MAX_ALIGN_T: the most strictly aligned scalar type
+ *   - LIBD_CACHE_LINE_SIZE: destructive interference size used for padding
  */
 
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
 /* --- C11 and newer --- */
 #include <stdalign.h>
 #define LIBD_ALIGNOF _Alignof
+#define LIBD_ALIGNAS(n) _Alignas(n)
 #define LIBD_MAX_ALIGN_T max_align_t
 
 #else
 /* --- Pre-C11 (e.g., C99) --- */
 #if defined(__GNUC__) || defined(__clang__)
 #define LIBD_ALIGNOF __alignof__
+#define LIBD_ALIGNAS(n) __attribute__((aligned(n)))
 #elif defined(_MSC_VER)
 #define LIBD_ALIGNOF __alignof
+#define LIBD_ALIGNAS(n) __declspec(align(n))
 #else
 #error "No supported alignof equivalent for this compiler"
 #endif
@@ -39,4 +44,8 @@ typedef union {
 
 #define LIBD_MAX_ALIGN (LIBD_ALIGNOF(LIBD_MAX_ALIGN_T))
 
+#ifndef LIBD_CACHE_LINE_SIZE
+#define LIBD_CACHE_LINE_SIZE 64
+#endif
+
 #endif /* LIBD_ALIGN_COMPAT_H */
@@ -0,0 +1,48 @@
+#ifndef LIBD_ATOMIC_COMPAT_H
+#define LIBD_ATOMIC_COMPAT_H
+
+/*
+ * Atomic operations for C99 builds.
+ * Provides thin wrappers over the GCC/Clang __atomic builtins, which operate
+ * on plain integer and pointer types:
+ *   - LIBD_ATOMIC_LOAD / STORE / EXCHANGE / FETCH_ADD / FETCH_SUB
+ *   - LIBD_ATOMIC_CAS_WEAK / LIBD_ATOMIC_CAS_STRONG
+ *   - LIBD_ATOMIC_FENCE
+ *   - LIBD_CPU_RELAX(): spin-wait hint
+ */
+
+#if defined(__GNUC__) || defined(__clang__)
+
+  #define LIBD_ATOMIC_RELAXED __ATOMIC_RELAXED
+  #define LIBD_ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+  #define LIBD_ATOMIC_RELEASE __ATOMIC_RELEASE
+  #define LIBD_ATOMIC_ACQ_REL __ATOMIC_ACQ_REL
+  #define LIBD_ATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+
+  #define LIBD_ATOMIC_LOAD(ptr, order)       __atomic_load_n(ptr, order)
+  #define LIBD_ATOMIC_STORE(ptr, val, order) __atomic_store_n(ptr, val, order)
+  #define LIBD_ATOMIC_EXCHANGE(ptr, val, order) \
+    __atomic_exchange_n(ptr, val, order)
+  #define LIBD_ATOMIC_FETCH_ADD(ptr, val, order) \
+    __atomic_fetch_add(ptr, val, order)
+  #define LIBD_ATOMIC_FETCH_SUB(ptr, val, order) \
+    __atomic_fetch_sub(ptr, val, order)
+  #define LIBD_ATOMIC_CAS_WEAK(ptr, expected, desired, success, failure) \
+    __atomic_compare_exchange_n(ptr, expected, desired, 1, success, failure)
+  #define LIBD_ATOMIC_CAS_STRONG(ptr, expected, desired, success, failure) \
+    __atomic_compare_exchange_n(ptr, expected, desired, 0, success, failure)
+  #define LIBD_ATOMIC_FENCE(order) __atomic_thread_fence(order)
+
+  #if defined(__x86_64__) || defined(__i386__)
+    #define LIBD_CPU_RELAX() __builtin_ia32_pause()
+  #elif defined(__aarch64__) || defined(__arm__)
+    #define LIBD_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+  #else
+    #define LIBD_CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+  #endif
+
+#else
+  #error "No supported atomic builtins for this compiler"
+#endif
+
+#endif /* LIBD_ATOMIC_COMPAT_H */
@@ -1,20 +1,24 @@
 /**
  * @file utils/darray.h
+ * @note Arrays allocate through a struct libd_allocator; create uses the
+ * system heap and create_with_allocator takes any other, e.g. an arena.
  */
 
 #ifndef LIBD_UTILS_DARRAY_H
 #define LIBD_UTILS_DARRAY_H
 
+#include "../memory.h"
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-
 #define DEFINE_LIBD_DARRAY_HEADER(type)                             \
   typedef struct libd_##type_darray libd_##type_darray_t;           \
                                                                     \
   libd_##type_darray_t* libd_##type_darray_create(size_t capacity); \
+  libd_##type_darray_t* libd_##type_darray_create_with_allocator(   \
+    size_t capacity, const struct libd_allocator* allocator);       \
   void libd_##type_darray_destroy(libd_##type_darray_t* arr);       \
   const type* libd_##type_darray_at(                                \
     const libd_##type_darray_t* arr, size_t i);                     \
@@ -30,27 +34,40 @@
     size_t capacity;                                                    \
     size_t size;                                                        \
     type* dat;                                                          \
+    struct libd_allocator allocator;                                    \
   };                                                                    \
                                                                         \
-  struct libd_##type_darray* libd_##type_darray_create(size_t capacity) \
+  struct libd_##type_darray* libd_##type_darray_create_with_allocator(  \
+    size_t capacity, const struct libd_allocator* allocator)            \
   {                                                                     \
-    if (capacity == 0) {                                                \
+    if (capacity == 0 || allocator == NULL) {                           \
       return NULL;                                                      \
     }                                                                   \
-    struct libd_##type_darray* arr = malloc(sizeof(*arr));              \
-    if (arr == NULL) {                                                  \
+    struct libd_##type_darray* arr;                                     \
+    if (                                                                \
+      libd_allocator_alloc(allocator, (void**)&arr, sizeof(*arr)) !=    \
+      libd_ok) {                                                        \
       return NULL;                                                      \
     }                                                                   \
-    arr->dat = malloc(sizeof(type) * capacity);                         \
-    if (arr->dat == NULL) {                                             \
-      free(arr);                                                        \
+    if (                                                                \
+      libd_allocator_alloc(                                             \
+        allocator, (void**)&arr->dat, sizeof(type) * capacity) !=       \
+      libd_ok) {                                                        \
+      libd_allocator_free(allocator, arr, sizeof(*arr));                \
       return NULL;                                                      \
     }                                                                   \
-    arr->capacity = capacity;                                           \
-    arr->size     = 0;                                                  \
+    arr->capacity  = capacity;                                          \
+    arr->size      = 0;                                                 \
+    arr->allocator = *allocator;                                        \
                                                                         \
     return arr;                                                         \
   }                                                                     \
+  struct libd_##type_darray* libd_##type_darray_create(size_t capacity) \
+  {                                                                     \
+    struct libd_allocator system;                                       \
+    libd_allocator_system(&system);                                     \
+    return libd_##type_darray_create_with_allocator(capacity, &system); \
+  }                                                                     \
   const type* libd_##type_darray_at(                                    \
     const struct libd_##type_darray* arr, size_t i)                     \
   {                                                                     \
@@ -79,15 +96,21 @@
       new_cap *= 2;                                                     \
     }                                                                   \
     if (new_cap != arr->capacity) {                                     \
-      type* r = realloc(arr->dat, new_cap * sizeof(type));              \
-      if (r == NULL) {                                                  \
+      void* r;                                                          \
+      if (                                                              \
+        libd_allocator_resize(                                          \
+          &arr->allocator,                                              \
+          &r,                                                           \
+          arr->dat,                                                     \
+          arr->capacity * sizeof(type),                                 \
+          new_cap * sizeof(type)) != libd_ok) {                         \
         return -1;                                                      \
       }                                                                 \
       arr->dat      = r;                                                \
       arr->capacity = new_cap;                                          \
     }                                                                   \
     memcpy(&arr->dat[i], dat, n * sizeof(type));                        \
-    arr->size = MAX(i + n, arr->size);                                  \
+    arr->size = MAX((i + n), arr->size);                                \
     return 0;                                                           \
   }                                                                     \
   int libd_##type_darray_append_n(                                      \
@@ -111,10 +134,12 @@
   void libd_##type_darray_destroy(struct libd_##type_darray* arr)       \
   {                                                                     \
     if (arr != NULL) {                                                  \
+      struct libd_allocator allocator = arr->allocator;                 \
       if (arr->dat != NULL) {                                           \
-        free(arr->dat);                                                 \
+        libd_allocator_free(                                            \
+          &allocator, arr->dat, arr->capacity * sizeof(type));          \
       }                                                                 \
-      free(arr);                                                        \
+      libd_allocator_free(&allocator, arr, sizeof(*arr));               \
     }                                                                   \
   }
 
@@ -0,0 +1,553 @@
+/**
+ * @file utils/ring_queue.h
+ * @brief Bounded ring queues for passing items between threads.
+ * @note DEFINE_LIBD_RING_QUEUE_IMPL(name, type) defines two queues of type:
+ * libd_<name>_spsc_queue_t, wait-free for one producer and one consumer, and
+ * libd_<name>_mpmc_queue_t, lock-free for any number of both, after Vyukov's
+ * bounded MPMC queue. Both allocate through a struct libd_allocator like
+ * utils/darray.h, round the capacity up to a power of 2, and keep the
+ * producer and consumer indices on separate cache lines.
+ *
+ * The try_ operations never block: try_enqueue_n and try_dequeue_n move as
+ * many items as fit or are available and return the count. enqueue,
+ * dequeue and their _n forms spin briefly and then sleep on a futex until
+ * they can make progress, and wake sleepers of the other side afterwards.
+ * Only these blocking forms wake sleepers, so a queue that has threads
+ * blocked on one side must be driven through the blocking forms on the other.
+ */
+
+#ifndef LIBD_UTILS_RING_QUEUE_H
+#define LIBD_UTILS_RING_QUEUE_H
+
+#include "../memory.h"
+#include "../platform/sync.h"
+#include "./align_compat.h"
+#include "./atomic_compat.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// polls before a blocking operation goes to sleep.
+#define LIBD_RING_QUEUE_SPIN_ROUNDS 64
+
+//==============================================================================
+// Shared helpers
+//==============================================================================
+
+/**
+ * @brief An eventcount for the threads sleeping on one side of a queue.
+ * Private.
+ */
+struct libd_ring_queue_waitlist {
+  u32 epoch; /**< Bumped by 2 on every wake, plus 1 while threads sleep. */
+};
+
+// Flags the caller as about to sleep. The caller re-checks the queue after
+// this and sleeps only if it still cannot make progress. The fence pairs with
+// the one in notify: either the re-check sees the other side's progress, or
+// the other side sees the flag.
+static inline u32
+_libd_ring_queue_prepare_wait(struct libd_ring_queue_waitlist* w)
+{
+  u32 epoch = LIBD_ATOMIC_LOAD(&w->epoch, LIBD_ATOMIC_RELAXED);
+  while (
+    (epoch & 1) == 0 &&
+    !LIBD_ATOMIC_CAS_WEAK(
+      &w->epoch,
+      &epoch,
+      epoch | 1,
+      LIBD_ATOMIC_RELAXED,
+      LIBD_ATOMIC_RELAXED)) {
+  }
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+
+  return epoch | 1;
+}
+
+static inline void
+_libd_ring_queue_wait(
+  struct libd_ring_queue_waitlist* w,
+  u32 epoch)
+{
+  libd_platform_futex_wait(&w->epoch, epoch);
+}
+
+// Clearing the flag hands the wake to this thread, so later notifies are free
+// until someone flags again. Everyone is woken, since the flag was theirs too.
+// A failed CAS means another thread moved the epoch on and wakes instead.
+static inline void
+_libd_ring_queue_notify(struct libd_ring_queue_waitlist* w)
+{
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+  u32 epoch = LIBD_ATOMIC_LOAD(&w->epoch, LIBD_ATOMIC_RELAXED);
+  if (
+    (epoch & 1) != 0 &&
+    LIBD_ATOMIC_CAS_STRONG(
+      &w->epoch,
+      &epoch,
+      (epoch & ~1u) + 2,
+      LIBD_ATOMIC_RELEASE,
+      LIBD_ATOMIC_RELAXED)) {
+    libd_platform_futex_wake(&w->epoch, U32_MAX);
+  }
+}
+
+// The smallest power of 2 >= capacity and >= 2, 0 if there is none.
+static inline usize
+_libd_ring_queue_round_capacity(usize capacity)
+{
+  usize rounded = 2;
+  while (rounded < capacity) {
+    if (rounded > SIZE_MAX / 2) {
+      return 0;
+    }
+    rounded *= 2;
+  }
+
+  return rounded;
+}
+
+// Queues are allocated with a cache line of slack and aligned by hand, since
+// allocators only promise max_align_t. raw is what goes back to free.
+static inline void*
+_libd_ring_queue_alloc_aligned(
+  const struct libd_allocator* allocator,
+  usize size,
+  void** raw)
+{
+  if (
+    libd_allocator_alloc(allocator, raw, size + LIBD_CACHE_LINE_SIZE) !=
+    libd_ok) {
+    return NULL;
+  }
+  uptr addr = ((uptr)*raw + LIBD_CACHE_LINE_SIZE - 1) &
+              ~(uptr)(LIBD_CACHE_LINE_SIZE - 1);
+
+  return memset((void*)addr, 0, size);
+}
+
+//==============================================================================
+// Templates
+//==============================================================================
+
+#define DEFINE_LIBD_RING_QUEUE_HEADER(name, type)                             \
+  typedef struct libd_##name##_spsc_queue libd_##name##_spsc_queue_t;         \
+  typedef struct libd_##name##_mpmc_queue libd_##name##_mpmc_queue_t;         \
+                                                                              \
+  libd_##name##_spsc_queue_t* libd_##name##_spsc_queue_create(                \
+    size_t capacity);                                                         \
+  libd_##name##_spsc_queue_t* libd_##name##_spsc_queue_create_with_allocator( \
+    size_t capacity, const struct libd_allocator* allocator);                 \
+  void libd_##name##_spsc_queue_destroy(libd_##name##_spsc_queue_t* q);       \
+  size_t libd_##name##_spsc_queue_capacity(                                   \
+    const libd_##name##_spsc_queue_t* q);                                     \
+  bool libd_##name##_spsc_queue_try_enqueue(                                  \
+    libd_##name##_spsc_queue_t* q, const type* item);                         \
+  bool libd_##name##_spsc_queue_try_dequeue(                                  \
+    libd_##name##_spsc_queue_t* q, type* out);                                \
+  size_t libd_##name##_spsc_queue_try_enqueue_n(                              \
+    libd_##name##_spsc_queue_t* q, const type* items, size_t n);              \
+  size_t libd_##name##_spsc_queue_try_dequeue_n(                              \
+    libd_##name##_spsc_queue_t* q, type* out, size_t n);                      \
+  void libd_##name##_spsc_queue_enqueue(                                      \
+    libd_##name##_spsc_queue_t* q, const type* item);                         \
+  void libd_##name##_spsc_queue_dequeue(                                      \
+    libd_##name##_spsc_queue_t* q, type* out);                                \
+  void libd_##name##_spsc_queue_enqueue_n(                                    \
+    libd_##name##_spsc_queue_t* q, const type* items, size_t n);              \
+  size_t libd_##name##_spsc_queue_dequeue_n(                                  \
+    libd_##name##_spsc_queue_t* q, type* out, size_t n);                      \
+                                                                              \
+  libd_##name##_mpmc_queue_t* libd_##name##_mpmc_queue_create(                \
+    size_t capacity);                                                         \
+  libd_##name##_mpmc_queue_t* libd_##name##_mpmc_queue_create_with_allocator( \
+    size_t capacity, const struct libd_allocator* allocator);                 \
+  void libd_##name##_mpmc_queue_destroy(libd_##name##_mpmc_queue_t* q);       \
+  size_t libd_##name##_mpmc_queue_capacity(                                   \
+    const libd_##name##_mpmc_queue_t* q);                                     \
+  bool libd_##name##_mpmc_queue_try_enqueue(                                  \
+    libd_##name##_mpmc_queue_t* q, const type* item);                         \
+  bool libd_##name##_mpmc_queue_try_dequeue(                                  \
+    libd_##name##_mpmc_queue_t* q, type* out);                                \
+  size_t libd_##name##_mpmc_queue_try_enqueue_n(                              \
+    libd_##name##_mpmc_queue_t* q, const type* items, size_t n);              \
+  size_t libd_##name##_mpmc_queue_try_dequeue_n(                              \
+    libd_##name##_mpmc_queue_t* q, type* out, size_t n);                      \
+  void libd_##name##_mpmc_queue_enqueue(                                      \
+    libd_##name##_mpmc_queue_t* q, const type* item);                         \
+  void libd_##name##_mpmc_queue_dequeue(                                      \
+    libd_##name##_mpmc_queue_t* q, type* out);                                \
+  void libd_##name##_mpmc_queue_enqueue_n(                                    \
+    libd_##name##_mpmc_queue_t* q, const type* items, size_t n);              \
+  size_t libd_##name##_mpmc_queue_dequeue_n(                                  \
+    libd_##name##_mpmc_queue_t* q, type* out, size_t n);
+
+#define _LIBD_RING_QUEUE_BLOCKING_IMPL(queue, type)                    \
+  void queue##_enqueue(struct queue* q, const type* item)              \
+  {                                                                    \
+    queue##_enqueue_n(q, item, 1);                                     \
+  }                                                                    \
+  void queue##_dequeue(struct queue* q, type* out)                     \
+  {                                                                    \
+    queue##_dequeue_n(q, out, 1);                                      \
+  }                                                                    \
+  void queue##_enqueue_n(struct queue* q, const type* items, size_t n) \
+  {                                                                    \
+    size_t done = 0;                                                   \
+    u32 spins   = 0;                                                   \
+    while (done < n) {                                                 \
+      size_t k = queue##_try_enqueue_n(q, items + done, n - done);     \
+      if (k == 0 && spins < LIBD_RING_QUEUE_SPIN_ROUNDS) {             \
+        spins += 1;                                                    \
+        LIBD_CPU_RELAX();                                              \
+        continue;                                                      \
+      }                                                                \
+      if (k == 0) {                                                    \
+        u32 epoch = _libd_ring_queue_prepare_wait(&q->not_full);       \
+        k         = queue##_try_enqueue_n(q, items + done, n - done);  \
+        if (k == 0) {                                                  \
+          _libd_ring_queue_wait(&q->not_full, epoch);                  \
+          continue;                                                    \
+        }                                                              \
+      }                                                                \
+      done  += k;                                                      \
+      spins  = 0;                                                      \
+      _libd_ring_queue_notify(&q->not_empty);                          \
+    }                                                                  \
+  }                                                                    \
+  size_t queue##_dequeue_n(struct queue* q, type* out, size_t n)       \
+  {                                                                    \
+    if (n == 0) {                                                      \
+      return 0;                                                        \
+    }                                                                  \
+    for (u32 spins = 0;; spins += 1) {                                 \
+      size_t k = queue##_try_dequeue_n(q, out, n);                     \
+      if (k == 0 && spins < LIBD_RING_QUEUE_SPIN_ROUNDS) {             \
+        LIBD_CPU_RELAX();                                              \
+        continue;                                                      \
+      }                                                                \
+      if (k == 0) {                                                    \
+        u32 epoch = _libd_ring_queue_prepare_wait(&q->not_empty);      \
+        k         = queue##_try_dequeue_n(q, out, n);                  \
+        if (k == 0) {                                                  \
+          _libd_ring_queue_wait(&q->not_empty, epoch);                 \
+          continue;                                                    \
+        }                                                              \
+      }                                                                \
+      _libd_ring_queue_notify(&q->not_full);                           \
+      return k;                                                        \
+    }                                                                  \
+  }
+
+#define _LIBD_SPSC_QUEUE_IMPL(name, type)                                      \
+  struct libd_##name##_spsc_queue {                                            \
+    usize mask;                                                                \
+    type* slots;                                                               \
+    struct libd_allocator allocator;                                           \
+    void* raw;                                                                 \
+    /* consumer line: its index and its last look at the producer's */         \
+    LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) usize head;                             \
+    usize cached_tail;                                                         \
+    /* producer line */                                                        \
+    LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) usize tail;                             \
+    usize cached_head;                                                         \
+    LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE)                                         \
+    struct libd_ring_queue_waitlist not_empty;                                 \
+    struct libd_ring_queue_waitlist not_full;                                  \
+  };                                                                           \
+                                                                               \
+  struct libd_##name##_spsc_queue*                                             \
+    libd_##name##_spsc_queue_create_with_allocator(                            \
+      size_t capacity, const struct libd_allocator* allocator)                 \
+  {                                                                            \
+    usize cap = _libd_ring_queue_round_capacity(capacity);                     \
+    if (cap == 0 || allocator == NULL || cap > SIZE_MAX / sizeof(type)) {      \
+      return NULL;                                                             \
+    }                                                                          \
+    void* raw;                                                                 \
+    struct libd_##name##_spsc_queue* q =                                       \
+      _libd_ring_queue_alloc_aligned(allocator, sizeof(*q), &raw);             \
+    if (q == NULL) {                                                           \
+      return NULL;                                                             \
+    }                                                                          \
+    if (                                                                       \
+      libd_allocator_alloc(                                                    \
+        allocator, (void**)&q->slots, cap * sizeof(type)) != libd_ok) {        \
+      libd_allocator_free(allocator, raw, sizeof(*q) + LIBD_CACHE_LINE_SIZE);  \
+      return NULL;                                                             \
+    }                                                                          \
+    q->mask      = cap - 1;                                                    \
+    q->allocator = *allocator;                                                 \
+    q->raw       = raw;                                                        \
+    return q;                                                                  \
+  }                                                                            \
+  struct libd_##name##_spsc_queue* libd_##name##_spsc_queue_create(            \
+    size_t capacity)                                                           \
+  {                                                                            \
+    struct libd_allocator system;                                              \
+    libd_allocator_system(&system);                                            \
+    return libd_##name##_spsc_queue_create_with_allocator(capacity, &system);  \
+  }                                                                            \
+  void libd_##name##_spsc_queue_destroy(struct libd_##name##_spsc_queue* q)    \
+  {                                                                            \
+    if (q != NULL) {                                                           \
+      struct libd_allocator allocator = q->allocator;                          \
+      void* raw                       = q->raw;                                \
+      libd_allocator_free(&allocator, q->slots, (q->mask + 1) * sizeof(type)); \
+      libd_allocator_free(&allocator, raw, sizeof(*q) + LIBD_CACHE_LINE_SIZE); \
+    }                                                                          \
+  }                                                                            \
+  size_t libd_##name##_spsc_queue_capacity(                                    \
+    const struct libd_##name##_spsc_queue* q)                                  \
+  {                                                                            \
+    return q == NULL ? 0 : q->mask + 1;                                        \
+  }                                                                            \
+  /* the producer only re-reads head when its cached copy says full, and */    \
+  /* the consumer only re-reads tail when its copy says empty. */              \
+  bool libd_##name##_spsc_queue_try_enqueue(                                   \
+    struct libd_##name##_spsc_queue* q, const type* item)                      \
+  {                                                                            \
+    usize tail = LIBD_ATOMIC_LOAD(&q->tail, LIBD_ATOMIC_RELAXED);              \
+    if (tail - q->cached_head > q->mask) {                                     \
+      q->cached_head = LIBD_ATOMIC_LOAD(&q->head, LIBD_ATOMIC_ACQUIRE);        \
+      if (tail - q->cached_head > q->mask) {                                   \
+        return false;                                                          \
+      }                                                                        \
+    }                                                                          \
+    q->slots[tail & q->mask] = *item;                                          \
+    LIBD_ATOMIC_STORE(&q->tail, tail + 1, LIBD_ATOMIC_RELEASE);                \
+    return true;                                                               \
+  }                                                                            \
+  bool libd_##name##_spsc_queue_try_dequeue(                                   \
+    struct libd_##name##_spsc_queue* q, type* out)                             \
+  {                                                                            \
+    usize head = LIBD_ATOMIC_LOAD(&q->head, LIBD_ATOMIC_RELAXED);              \
+    if (head == q->cached_tail) {                                              \
+      q->cached_tail = LIBD_ATOMIC_LOAD(&q->tail, LIBD_ATOMIC_ACQUIRE);        \
+      if (head == q->cached_tail) {                                            \
+        return false;                                                          \
+      }                                                                        \
+    }                                                                          \
+    *out = q->slots[head & q->mask];                                           \
+    LIBD_ATOMIC_STORE(&q->head, head + 1, LIBD_ATOMIC_RELEASE);                \
+    return true;                                                               \
+  }                                                                            \
+  size_t libd_##name##_spsc_queue_try_enqueue_n(                               \
+    struct libd_##name##_spsc_queue* q, const type* items, size_t n)           \
+  {                                                                            \
+    usize tail  = LIBD_ATOMIC_LOAD(&q->tail, LIBD_ATOMIC_RELAXED);             \
+    usize space = q->mask + 1 - (tail - q->cached_head);                       \
+    if (space < n) {                                                           \
+      q->cached_head = LIBD_ATOMIC_LOAD(&q->head, LIBD_ATOMIC_ACQUIRE);        \
+      space          = q->mask + 1 - (tail - q->cached_head);                  \
+    }                                                                          \
+    n = MIN(n, space);                                                         \
+    if (n == 0) {                                                              \
+      return 0;                                                                \
+    }                                                                          \
+    usize at    = tail & q->mask;                                              \
+    usize first = MIN(n, q->mask + 1 - at);                                    \
+    memcpy(&q->slots[at], items, first * sizeof(type));                        \
+    memcpy(q->slots, items + first, (n - first) * sizeof(type));               \
+    LIBD_ATOMIC_STORE(&q->tail, tail + n, LIBD_ATOMIC_RELEASE);                \
+    return n;                                                                  \
+  }                                                                            \
+  size_t libd_##name##_spsc_queue_try_dequeue_n(                               \
+    struct libd_##name##_spsc_queue* q, type* out, size_t n)                   \
+  {                                                                            \
+    usize head  = LIBD_ATOMIC_LOAD(&q->head, LIBD_ATOMIC_RELAXED);             \
+    usize avail = q->cached_tail - head;                                       \
+    if (avail < n) {                                                           \
+      q->cached_tail = LIBD_ATOMIC_LOAD(&q->tail, LIBD_ATOMIC_ACQUIRE);        \
+      avail          = q->cached_tail - head;                                  \
+    }                                                                          \
+    n = MIN(n, avail);                                                         \
+    if (n == 0) {                                                              \
+      return 0;                                                                \
+    }                                                                          \
+    usize at    = head & q->mask;                                              \
+    usize first = MIN(n, q->mask + 1 - at);                                    \
+    memcpy(out, &q->slots[at], first * sizeof(type));                          \
+    memcpy(out + first, q->slots, (n - first) * sizeof(type));                 \
+    LIBD_ATOMIC_STORE(&q->head, head + n, LIBD_ATOMIC_RELEASE);                \
+    return n;                                                                  \
+  }                                                                            \
+  _LIBD_RING_QUEUE_BLOCKING_IMPL(libd_##name##_spsc_queue, type)
+
+#define _LIBD_MPMC_QUEUE_IMPL(name, type)                                      \
+  /* a slot is free for position p when seq == p, and holds the item of */     \
+  /* position p when seq == p + 1. */                                          \
+  struct libd_##name##_mpmc_queue_slot {                                       \
+    usize seq;                                                                 \
+    type value;                                                                \
+  };                                                                           \
+  struct libd_##name##_mpmc_queue {                                            \
+    usize mask;                                                                \
+    struct libd_##name##_mpmc_queue_slot* slots;                               \
+    struct libd_allocator allocator;                                           \
+    void* raw;                                                                 \
+    LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) usize head;                             \
+    LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) usize tail;                             \
+    LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE)                                         \
+    struct libd_ring_queue_waitlist not_empty;                                 \
+    struct libd_ring_queue_waitlist not_full;                                  \
+  };                                                                           \
+                                                                               \
+  struct libd_##name##_mpmc_queue*                                             \
+    libd_##name##_mpmc_queue_create_with_allocator(                            \
+      size_t capacity, const struct libd_allocator* allocator)                 \
+  {                                                                            \
+    usize cap = _libd_ring_queue_round_capacity(capacity);                     \
+    if (                                                                       \
+      cap == 0 || allocator == NULL ||                                         \
+      cap > SIZE_MAX / sizeof(struct libd_##name##_mpmc_queue_slot)) {         \
+      return NULL;                                                             \
+    }                                                                          \
+    void* raw;                                                                 \
+    struct libd_##name##_mpmc_queue* q =                                       \
+      _libd_ring_queue_alloc_aligned(allocator, sizeof(*q), &raw);             \
+    if (q == NULL) {                                                           \
+      return NULL;                                                             \
+    }                                                                          \
+    if (                                                                       \
+      libd_allocator_alloc(                                                    \
+        allocator, (void**)&q->slots, cap * sizeof(*q->slots)) != libd_ok) {   \
+      libd_allocator_free(allocator, raw, sizeof(*q) + LIBD_CACHE_LINE_SIZE);  \
+      return NULL;                                                             \
+    }                                                                          \
+    for (usize i = 0; i < cap; i += 1) {                                       \
+      q->slots[i].seq = i;                                                     \
+    }                                                                          \
+    q->mask      = cap - 1;                                                    \
+    q->allocator = *allocator;                                                 \
+    q->raw       = raw;                                                        \
+    return q;                                                                  \
+  }                                                                            \
+  struct libd_##name##_mpmc_queue* libd_##name##_mpmc_queue_create(            \
+    size_t capacity)                                                           \
+  {                                                                            \
+    struct libd_allocator system;                                              \
+    libd_allocator_system(&system);                                            \
+    return libd_##name##_mpmc_queue_create_with_allocator(capacity, &system);  \
+  }                                                                            \
+  void libd_##name##_mpmc_queue_destroy(struct libd_##name##_mpmc_queue* q)    \
+  {                                                                            \
+    if (q != NULL) {                                                           \
+      struct libd_allocator allocator = q->allocator;                          \
+      void* raw                       = q->raw;                                \
+      libd_allocator_free(                                                     \
+        &allocator, q->slots, (q->mask + 1) * sizeof(*q->slots));              \
+      libd_allocator_free(&allocator, raw, sizeof(*q) + LIBD_CACHE_LINE_SIZE); \
+    }                                                                          \
+  }                                                                            \
+  size_t libd_##name##_mpmc_queue_capacity(                                    \
+    const struct libd_##name##_mpmc_queue* q)                                  \
+  {                                                                            \
+    return q == NULL ? 0 : q->mask + 1;                                        \
+  }                                                                            \
+  /* a batch claims the run of ready slots at the index with one CAS. The */   \
+  /* index cannot move past them while the CAS succeeds, so the slots are */   \
+  /* still ready once claimed. */                                              \
+  size_t libd_##name##_mpmc_queue_try_enqueue_n(                               \
+    struct libd_##name##_mpmc_queue* q, const type* items, size_t n)           \
+  {                                                                            \
+    if (n == 0) {                                                              \
+      return 0;                                                                \
+    }                                                                          \
+    usize pos = LIBD_ATOMIC_LOAD(&q->tail, LIBD_ATOMIC_RELAXED);               \
+    for (;;) {                                                                 \
+      usize seq = LIBD_ATOMIC_LOAD(                                            \
+        &q->slots[pos & q->mask].seq, LIBD_ATOMIC_ACQUIRE);                    \
+      intptr_t diff = (intptr_t)(seq - pos);                                   \
+      if (diff < 0) {                                                          \
+        return 0;                                                              \
+      }                                                                        \
+      if (diff > 0) {                                                          \
+        pos = LIBD_ATOMIC_LOAD(&q->tail, LIBD_ATOMIC_RELAXED);                 \
+        continue;                                                              \
+      }                                                                        \
+      usize k = 1;                                                             \
+      while (                                                                  \
+        k < n && LIBD_ATOMIC_LOAD(                                             \
+                   &q->slots[(pos + k) & q->mask].seq, LIBD_ATOMIC_ACQUIRE) == \
+                   pos + k) {                                                  \
+        k += 1;                                                                \
+      }                                                                        \
+      if (LIBD_ATOMIC_CAS_WEAK(                                                \
+            &q->tail,                                                          \
+            &pos,                                                              \
+            pos + k,                                                           \
+            LIBD_ATOMIC_RELAXED,                                               \
+            LIBD_ATOMIC_RELAXED)) {                                            \
+        for (usize i = 0; i < k; i += 1) {                                     \
+          struct libd_##name##_mpmc_queue_slot* slot =                         \
+            &q->slots[(pos + i) & q->mask];                                    \
+          slot->value = items[i];                                              \
+          LIBD_ATOMIC_STORE(&slot->seq, pos + i + 1, LIBD_ATOMIC_RELEASE);     \
+        }                                                                      \
+        return k;                                                              \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  size_t libd_##name##_mpmc_queue_try_dequeue_n(                               \
+    struct libd_##name##_mpmc_queue* q, type* out, size_t n)                   \
+  {                                                                            \
+    if (n == 0) {                                                              \
+      return 0;                                                                \
+    }                                                                          \
+    usize pos = LIBD_ATOMIC_LOAD(&q->head, LIBD_ATOMIC_RELAXED);               \
+    for (;;) {                                                                 \
+      usize seq = LIBD_ATOMIC_LOAD(                                            \
+        &q->slots[pos & q->mask].seq, LIBD_ATOMIC_ACQUIRE);                    \
+      intptr_t diff = (intptr_t)(seq - (pos + 1));                             \
+      if (diff < 0) {                                                          \
+        return 0;                                                              \
+      }                                                                        \
+      if (diff > 0) {                                                          \
+        pos = LIBD_ATOMIC_LOAD(&q->head, LIBD_ATOMIC_RELAXED);                 \
+        continue;                                                              \
+      }                                                                        \
+      usize k = 1;                                                             \
+      while (                                                                  \
+        k < n && LIBD_ATOMIC_LOAD(                                             \
+                   &q->slots[(pos + k) & q->mask].seq, LIBD_ATOMIC_ACQUIRE) == \
+                   pos + k + 1) {                                              \
+        k += 1;                                                                \
+      }                                                                        \
+      if (LIBD_ATOMIC_CAS_WEAK(                                                \
+            &q->head,                                                          \
+            &pos,                                                              \
+            pos + k,                                                           \
+            LIBD_ATOMIC_RELAXED,                                               \
+            LIBD_ATOMIC_RELAXED)) {                                            \
+        for (usize i = 0; i < k; i += 1) {                                     \
+          struct libd_##name##_mpmc_queue_slot* slot =                         \
+            &q->slots[(pos + i) & q->mask];                                    \
+          out[i] = slot->value;                                                \
+          LIBD_ATOMIC_STORE(                                                   \
+            &slot->seq, pos + i + q->mask + 1, LIBD_ATOMIC_RELEASE);           \
+        }                                                                      \
+        return k;                                                              \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  bool libd_##name##_mpmc_queue_try_enqueue(                                   \
+    struct libd_##name##_mpmc_queue* q, const type* item)                      \
+  {                                                                            \
+    return libd_##name##_mpmc_queue_try_enqueue_n(q, item, 1) == 1;            \
+  }                                                                            \
+  bool libd_##name##_mpmc_queue_try_dequeue(                                   \
+    struct libd_##name##_mpmc_queue* q, type* out)                             \
+  {                                                                            \
+    return libd_##name##_mpmc_queue_try_dequeue_n(q, out, 1) == 1;             \
+  }                                                                            \
+  _LIBD_RING_QUEUE_BLOCKING_IMPL(libd_##name##_mpmc_queue, type)
+
+#define DEFINE_LIBD_RING_QUEUE_IMPL(name, type) \
+  _LIBD_SPSC_QUEUE_IMPL(name, type)             \
+  _LIBD_MPMC_QUEUE_IMPL(name, type)
+
+
+#endif  // LIBD_UTILS_RING_QUEUE_H
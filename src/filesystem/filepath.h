@@ -3,7 +3,7 @@
 
 #include "../../include/libd/common.h"
 #include "../../include/libd/filesystem.h"
-#include "./internal/allocator_wrap.h"
+#include "../../include/libd/memory.h"
 
 typedef u8 token_type_e;
 #define eof_type                 (1 << 0)
@@ -19,10 +19,10 @@ typedef u8 token_type_e;
 #define IS_SEGMENT_TYPE(type)    CHECK_AGAINST_MASK(type, segment_type)
 #define IS_COMPONENT_TYPE(type)  CHECK_AGAINST_MASK(type, component_mask)
 
+// An arena for path routines and the interface they allocate through.
 struct filepath_allocator {
-  struct filepath_allocator_wrapper wrapper;
-  alloc_f alloc;
-  reset_f reset;
+  libd_linear_allocator_h* arena;
+  struct libd_allocator allocator;
 };
 
 enum libd_result
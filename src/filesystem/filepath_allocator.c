@@ -6,19 +6,17 @@ libd_filepath_allocator_create(
   u8 alignment)
 {
   enum libd_result r =
-    libd_allocator_wrapper_create(&out_ta->wrapper, 8 * KiB, KiB, alignment);
+    libd_linear_allocator_create(&out_ta->arena, 8 * KiB, KiB, alignment);
   if (r != libd_ok) {
     return libd_no_memory;
   }
 
-  out_ta->alloc = libd_allocator_wrapper_alloc;
-  out_ta->reset = libd_allocator_wrapper_reset;
-
-  return libd_ok;
+  return libd_allocator_from_linear(&out_ta->allocator, out_ta->arena);
 }
 
 void
 libd_filepath_allocator_destroy(struct filepath_allocator* ta)
 {
-  libd_allocator_wrapper_destroy(&ta->wrapper);
+  libd_linear_allocator_destroy(ta->arena);
+  ta->arena = NULL;
 }
@@ -1,46 +0,0 @@
-#include "./allocator_wrap.h"
-
-#include "../../../include/libd/memory.h"
-
-enum libd_result
-libd_allocator_wrapper_create(
-  struct filepath_allocator_wrapper* allocator,
-  u32 reserve,
-  u32 size,
-  uint8_t alignment)
-{
-  enum libd_result r =
-    libd_linear_allocator_create(&allocator->a, reserve, size, alignment);
-  if (r != libd_ok) {
-    return r;
-  }
-
-  return r;
-}
-
-void*
-libd_allocator_wrapper_alloc(
-  struct filepath_allocator_wrapper* allocator,
-  u32 bytes)
-{
-  void* out_ptr;
-  enum libd_result r =
-    libd_linear_allocator_alloc(allocator->a, &out_ptr, bytes);
-  if (r != libd_ok) {
-    return NULL;
-  }
-  return out_ptr;
-}
-
-void
-libd_allocator_wrapper_reset(struct filepath_allocator_wrapper* allocator)
-{
-  libd_linear_allocator_reset(allocator->a);
-}
-
-void
-libd_allocator_wrapper_destroy(struct filepath_allocator_wrapper* allocator)
-{
-  libd_linear_allocator_destroy(allocator->a);
-  allocator->a = NULL;
-}
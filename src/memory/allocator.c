@@ -0,0 +1,297 @@
+#include "../../include/libd/memory.h"
+#include "./internal/pool_allocator.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+static enum libd_result
+_linear_alloc(
+  void* ctx,
+  void** out_ptr,
+  usize size);
+
+static enum libd_result
+_linear_resize(
+  void* ctx,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size);
+
+static enum libd_result
+_linear_free(
+  void* ctx,
+  void* ptr,
+  usize size);
+
+static enum libd_result
+_linear_reset(void* ctx);
+
+static enum libd_result
+_pool_alloc(
+  void* ctx,
+  void** out_ptr,
+  usize size);
+
+static enum libd_result
+_pool_resize(
+  void* ctx,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size);
+
+static enum libd_result
+_pool_free(
+  void* ctx,
+  void* ptr,
+  usize size);
+
+static enum libd_result
+_pool_reset(void* ctx);
+
+static enum libd_result
+_system_alloc(
+  void* ctx,
+  void** out_ptr,
+  usize size);
+
+static enum libd_result
+_system_resize(
+  void* ctx,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size);
+
+static enum libd_result
+_system_free(
+  void* ctx,
+  void* ptr,
+  usize size);
+
+static enum libd_result
+_system_reset(void* ctx);
+
+enum libd_result
+libd_allocator_from_linear(
+  struct libd_allocator* out,
+  libd_linear_allocator_h* la)
+{
+  if (out == NULL || la == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  *out = (struct libd_allocator){
+    .ctx    = la,
+    .alloc  = _linear_alloc,
+    .resize = _linear_resize,
+    .free   = _linear_free,
+    .reset  = _linear_reset,
+  };
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_allocator_from_pool(
+  struct libd_allocator* out,
+  libd_pool_allocator_h* pa)
+{
+  if (out == NULL || pa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  *out = (struct libd_allocator){
+    .ctx    = pa,
+    .alloc  = _pool_alloc,
+    .resize = _pool_resize,
+    .free   = _pool_free,
+    .reset  = _pool_reset,
+  };
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_allocator_system(struct libd_allocator* out)
+{
+  if (out == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  *out = (struct libd_allocator){
+    .ctx    = NULL,
+    .alloc  = _system_alloc,
+    .resize = _system_resize,
+    .free   = _system_free,
+    .reset  = _system_reset,
+  };
+
+  return libd_ok;
+}
+
+static enum libd_result
+_linear_alloc(
+  void* ctx,
+  void** out_ptr,
+  usize size)
+{
+  return libd_linear_allocator_alloc(ctx, out_ptr, size);
+}
+
+static enum libd_result
+_linear_resize(
+  void* ctx,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size)
+{
+  return libd_linear_allocator_resize(ctx, out_ptr, ptr, old_size, new_size);
+}
+
+// shrinking to nothing rewinds the head when ptr is the newest allocation and
+// is a no-op otherwise.
+static enum libd_result
+_linear_free(
+  void* ctx,
+  void* ptr,
+  usize size)
+{
+  if (ptr == NULL) {
+    return libd_ok;
+  }
+
+  void* unused;
+  return libd_linear_allocator_resize(ctx, &unused, ptr, size, 0);
+}
+
+static enum libd_result
+_linear_reset(void* ctx)
+{
+  return libd_linear_allocator_reset(ctx);
+}
+
+static enum libd_result
+_pool_alloc(
+  void* ctx,
+  void** out_ptr,
+  usize size)
+{
+  if (size > libd_pool_allocator_slot_size(ctx)) {
+    return libd_invalid_parameter;
+  }
+
+  return libd_pool_allocator_alloc(ctx, out_ptr);
+}
+
+static enum libd_result
+_pool_resize(
+  void* ctx,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size)
+{
+  (void)old_size;
+
+  if (ptr == NULL) {
+    return _pool_alloc(ctx, out_ptr, new_size);
+  }
+  if (out_ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+  if (new_size > libd_pool_allocator_slot_size(ctx)) {
+    return libd_invalid_parameter;
+  }
+
+  // every allocation already owns a whole slot.
+  *out_ptr = ptr;
+
+  return libd_ok;
+}
+
+static enum libd_result
+_pool_free(
+  void* ctx,
+  void* ptr,
+  usize size)
+{
+  (void)size;
+
+  return libd_pool_allocator_free(ctx, ptr);
+}
+
+static enum libd_result
+_pool_reset(void* ctx)
+{
+  return libd_pool_allocator_reset(ctx);
+}
+
+static enum libd_result
+_system_alloc(
+  void* ctx,
+  void** out_ptr,
+  usize size)
+{
+  (void)ctx;
+
+  if (out_ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  void* ptr = malloc(size);
+  if (ptr == NULL && size != 0) {
+    return libd_no_memory;
+  }
+  *out_ptr = ptr;
+
+  return libd_ok;
+}
+
+static enum libd_result
+_system_resize(
+  void* ctx,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size)
+{
+  (void)ctx;
+  (void)old_size;
+
+  if (out_ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  void* resized = realloc(ptr, new_size);
+  if (resized == NULL && new_size != 0) {
+    return libd_no_memory;
+  }
+  *out_ptr = resized;
+
+  return libd_ok;
+}
+
+static enum libd_result
+_system_free(
+  void* ctx,
+  void* ptr,
+  usize size)
+{
+  (void)ctx;
+  (void)size;
+
+  free(ptr);
+
+  return libd_ok;
+}
+
+static enum libd_result
+_system_reset(void* ctx)
+{
+  (void)ctx;
+
+  return libd_mem_not_implemented;
+}
@@ -0,0 +1,268 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/platform/threads.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Per-thread cache of free slots. Lives in thread-local storage, so it is
+// zero-initialized on the first access from each thread.
+struct magazine {
+  struct concurrent_pool_allocator* owner;
+  u32 count;
+  void* slots[];
+};
+
+struct concurrent_pool_allocator {
+  pthread_mutex_t depot_lock;
+  struct pool_allocator* depot;
+  libd_platform_thread_local_storage_handle_h* magazines;
+  u32 magazine_size;
+  u32 batch_size;
+};
+
+static void
+_magazine_cleanup(
+  void* data,
+  size_t size);
+
+static enum libd_result
+_get_magazine(
+  struct concurrent_pool_allocator* cpa,
+  struct magazine** out_mag);
+
+static u32
+_refill(
+  struct concurrent_pool_allocator* cpa,
+  struct magazine* mag);
+
+static void
+_flush(
+  struct concurrent_pool_allocator* cpa,
+  struct magazine* mag,
+  u32 n);
+
+enum libd_result
+libd_concurrent_pool_allocator_create(
+  struct concurrent_pool_allocator** out_cpa,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 alignment,
+  u32 magazine_size)
+{
+  if (
+    out_cpa == NULL || magazine_size < 2 ||
+    magazine_size > LIBD_CONCURRENT_POOL_MAX_MAGAZINE_SIZE) {
+    return libd_invalid_parameter;
+  }
+
+  struct concurrent_pool_allocator* cpa = malloc(sizeof(*cpa));
+  if (cpa == NULL) {
+    return libd_no_memory;
+  }
+
+  enum libd_result r = libd_pool_allocator_create(
+    &cpa->depot, max_allocations, bytes_per_alloc, alignment);
+  if (r != libd_ok) {
+    free(cpa);
+    return r;
+  }
+
+  r = libd_platform_thread_local_storage_create(
+    &cpa->magazines,
+    _magazine_cleanup,
+    sizeof(struct magazine) + magazine_size * sizeof(void*));
+  if (r != libd_ok) {
+    libd_pool_allocator_destroy(cpa->depot);
+    free(cpa);
+    return r;
+  }
+
+  if (pthread_mutex_init(&cpa->depot_lock, NULL) != 0) {
+    libd_platform_thread_local_storage_destroy(cpa->magazines);
+    libd_pool_allocator_destroy(cpa->depot);
+    free(cpa);
+    return libd_init_failed;
+  }
+
+  cpa->magazine_size = magazine_size;
+  cpa->batch_size    = magazine_size / 2;
+
+  *out_cpa = cpa;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_concurrent_pool_allocator_destroy(struct concurrent_pool_allocator* cpa)
+{
+  if (cpa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  // The slots held by any thread's magazine go away with the depot.
+  libd_platform_thread_local_storage_destroy(cpa->magazines);
+  pthread_mutex_destroy(&cpa->depot_lock);
+  libd_pool_allocator_destroy(cpa->depot);
+  free(cpa);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_concurrent_pool_allocator_alloc(
+  struct concurrent_pool_allocator* cpa,
+  void** out_ptr)
+{
+  if (cpa == NULL || out_ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  struct magazine* mag;
+  enum libd_result r = _get_magazine(cpa, &mag);
+  if (r != libd_ok) {
+    return r;
+  }
+
+  if (mag->count == 0 && _refill(cpa, mag) == 0) {
+    return libd_no_memory;
+  }
+
+  mag->count -= 1;
+  *out_ptr = mag->slots[mag->count];
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_concurrent_pool_allocator_free(
+  struct concurrent_pool_allocator* cpa,
+  void* ptr)
+{
+  if (cpa == NULL || ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  // The depot's bounds never change, and owns reads its high-water mark
+  // atomically, so this needs no lock. Never allocated slots are rejected
+  // here, as a flush could not return them.
+  bool owned;
+  libd_pool_allocator_owns(cpa->depot, ptr, &owned);
+  if (!owned) {
+    return libd_invalid_pointer;
+  }
+
+  struct magazine* mag;
+  enum libd_result r = _get_magazine(cpa, &mag);
+  if (r != libd_ok) {
+    return r;
+  }
+
+  if (mag->count == cpa->magazine_size) {
+    _flush(cpa, mag, cpa->batch_size);
+  }
+
+  mag->slots[mag->count] = ptr;
+  mag->count += 1;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_concurrent_pool_allocator_thread_flush(
+  struct concurrent_pool_allocator* cpa)
+{
+  if (cpa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  struct magazine* mag;
+  enum libd_result r = _get_magazine(cpa, &mag);
+  if (r != libd_ok) {
+    return r;
+  }
+
+  _flush(cpa, mag, mag->count);
+
+  return libd_ok;
+}
+
+static void
+_magazine_cleanup(
+  void* data,
+  size_t size)
+{
+  (void)size;
+  struct magazine* mag = data;
+  if (mag->owner != NULL) {
+    _flush(mag->owner, mag, mag->count);
+  }
+}
+
+static enum libd_result
+_get_magazine(
+  struct concurrent_pool_allocator* cpa,
+  struct magazine** out_mag)
+{
+  struct magazine* mag;
+  enum libd_result r =
+    libd_platform_thread_local_storage_get(cpa->magazines, (void**)&mag);
+  if (r != libd_ok) {
+    return r;
+  }
+
+  if (mag->owner == NULL) {
+    mag->owner = cpa;
+  }
+  *out_mag = mag;
+
+  return libd_ok;
+}
+
+static u32
+_refill(
+  struct concurrent_pool_allocator* cpa,
+  struct magazine* mag)
+{
+  pthread_mutex_lock(&cpa->depot_lock);
+  u32 wanted = cpa->batch_size - mag->count;
+  if (
+    libd_pool_allocator_alloc_n(
+      cpa->depot, &mag->slots[mag->count], wanted) == libd_ok) {
+    mag->count += wanted;
+  } else {
+    // fewer than a batch left; take what there is.
+    while (mag->count < cpa->batch_size) {
+      void** slot = &mag->slots[mag->count];
+      if (libd_pool_allocator_alloc(cpa->depot, slot) != libd_ok) {
+        break;
+      }
+      mag->count += 1;
+    }
+  }
+  pthread_mutex_unlock(&cpa->depot_lock);
+
+  return mag->count;
+}
+
+// Returns the n coldest (bottom) slots of the magazine to the depot, keeping
+// the recently freed ones cached. Slots are freed one by one rather than with
+// free_n, which stops at the first slot the depot rejects: such a slot is
+// dropped, and the slots after it still go back.
+static void
+_flush(
+  struct concurrent_pool_allocator* cpa,
+  struct magazine* mag,
+  u32 n)
+{
+  pthread_mutex_lock(&cpa->depot_lock);
+  for (u32 i = 0; i < n; i += 1) {
+    libd_pool_allocator_free(cpa->depot, mag->slots[i]);
+  }
+  pthread_mutex_unlock(&cpa->depot_lock);
+
+  mag->count -= n;
+  memmove(&mag->slots[0], &mag->slots[n], mag->count * sizeof(void*));
+}
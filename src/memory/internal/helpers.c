@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 /**
  * @brief Check whether or not the given offset is a power of 2.
@@ -45,3 +46,45 @@ libd_memory_align_up(
 {
   return ((value + alignment - 1) & ~(uptr)(alignment - 1));
 }
+
+u32
+libd_memory_count_trailing_zeros(u64 value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (u32)__builtin_ctzll(value);
+#else
+  u32 count = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    count += 1;
+  }
+  return count;
+#endif
+}
+
+u32
+libd_memory_count_leading_zeros(u64 value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (u32)__builtin_clzll(value);
+#else
+  u32 count = 0;
+  while ((value & ((u64)1 << 63)) == 0) {
+    value <<= 1;
+    count += 1;
+  }
+  return count;
+#endif
+}
+
+#ifdef LIBD_MEMORY_DEBUG
+void
+libd_memory_debug_fill(
+  void* ptr,
+  usize size,
+  u8 byte)
+{
+  LIBD_MEMORY_UNPOISON(ptr, size);
+  memset(ptr, byte, size);
+}
+#endif
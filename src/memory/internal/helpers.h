@@ -32,3 +32,88 @@ uptr
 libd_memory_align_up(
   uptr value,
   uptr alignment);
+
+/**
+ * @brief Counts the trailing zero bits of a value.
+ * @warning value must be non-zero.
+ * @param value The value to inspect.
+ * @return The index of the lowest set bit.
+ */
+u32
+libd_memory_count_trailing_zeros(u64 value);
+
+/**
+ * @brief Counts the leading zero bits of a value.
+ * @warning value must be non-zero.
+ * @param value The value to inspect.
+ * @return 63 minus the index of the highest set bit.
+ */
+u32
+libd_memory_count_leading_zeros(u64 value);
+
+/**
+ * @brief Expands to its arguments only when the library is built with the
+ * memory_stats option, so allocator statistics cost nothing otherwise.
+ */
+#ifdef LIBD_MEMORY_STATS
+  #define LIBD_MEMORY_STAT(...) __VA_ARGS__
+#else
+  #define LIBD_MEMORY_STAT(...)
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+  #define LIBD_HAS_ASAN
+#elif defined(__has_feature)
+  #if __has_feature(address_sanitizer)
+    #define LIBD_HAS_ASAN
+  #endif
+#endif
+
+/**
+ * @brief Leaves a function uninstrumented by AddressSanitizer, for code that
+ * deliberately touches memory the allocators have poisoned.
+ */
+#ifdef LIBD_HAS_ASAN
+  #define LIBD_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+  #define LIBD_NO_SANITIZE_ADDRESS
+#endif
+
+/**
+ * @brief Hooks for the memory_debug option. LIBD_MEMORY_DEBUG_ONLY expands to
+ * its arguments only in debug builds, and LIBD_MEMORY_REDZONE is the gap left
+ * after each linear allocation, 0 otherwise. LIBD_MEMORY_POISON and
+ * LIBD_MEMORY_UNPOISON mark a region for AddressSanitizer and do nothing
+ * unless the build is both a debug and an ASan one.
+ */
+#ifdef LIBD_MEMORY_DEBUG
+  #define LIBD_MEMORY_DEBUG_ONLY(...) __VA_ARGS__
+  #define LIBD_MEMORY_REDZONE         LIBD_MEMORY_REDZONE_SIZE
+#else
+  #define LIBD_MEMORY_DEBUG_ONLY(...)
+  #define LIBD_MEMORY_REDZONE 0
+#endif
+
+#if defined(LIBD_MEMORY_DEBUG) && defined(LIBD_HAS_ASAN)
+  #include <sanitizer/asan_interface.h>
+  #define LIBD_MEMORY_POISON(ptr, size)   ASAN_POISON_MEMORY_REGION(ptr, size)
+  #define LIBD_MEMORY_UNPOISON(ptr, size) ASAN_UNPOISON_MEMORY_REGION(ptr, size)
+#else
+  #define LIBD_MEMORY_POISON(ptr, size)   ((void)(ptr), (void)(size))
+  #define LIBD_MEMORY_UNPOISON(ptr, size) ((void)(ptr), (void)(size))
+#endif
+
+#ifdef LIBD_MEMORY_DEBUG
+/**
+ * @brief Fills a region with a debug pattern, unpoisoning it first so the
+ * write itself is not reported. The region is left unpoisoned.
+ * @param ptr Start of the region.
+ * @param size Size of the region in bytes.
+ * @param byte Pattern to fill with.
+ */
+void
+libd_memory_debug_fill(
+  void* ptr,
+  usize size,
+  u8 byte);
+#endif
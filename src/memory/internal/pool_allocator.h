@@ -0,0 +1,43 @@
+/**
+ * @file
+ * @brief internal pool allocator entry points shared with other allocators
+ */
+
+#ifndef LIBD_MEMORY_INTERNAL_POOL_ALLOCATOR_H
+#define LIBD_MEMORY_INTERNAL_POOL_ALLOCATOR_H
+
+#include "../../../include/libd/memory.h"
+
+#include <stddef.h>
+
+/**
+ * @brief Creates a LIFO pool inside an address range reserved by the caller.
+ * The pool header is placed at the start of the range and pages are committed
+ * with mprotect as slots are first handed out. Destroying the pool leaves the
+ * range mapped; the caller unmaps it.
+ * @param out_pa Out parameter for the allocator.
+ * @param reservation Start of a page aligned PROT_NONE mapping.
+ * @param reservation_size Size of the mapping in bytes. Every slot that fits
+ * after the header is available.
+ * @param bytes_per_alloc Size of each slot in bytes.
+ * @param alignment Alignment of each slot. Must be a non-zero power of 2.
+ * @return libd_ok on success, non-zero otherwise.
+ */
+enum libd_result
+libd_pool_allocator_create_in_place(
+  libd_pool_allocator_h** out_pa,
+  void* reservation,
+  usize reservation_size,
+  u32 bytes_per_alloc,
+  u8 alignment);
+
+/**
+ * @brief Size of each slot after alignment, i.e. the largest allocation the
+ * pool can satisfy.
+ * @param pa Handle for the allocator.
+ * @return The slot size in bytes.
+ */
+u32
+libd_pool_allocator_slot_size(const libd_pool_allocator_h* pa);
+
+#endif  // LIBD_MEMORY_INTERNAL_POOL_ALLOCATOR_H
@@ -1,21 +1,44 @@
 #include "../../include/libd/memory.h"
+#include "../../include/libd/utils/align_compat.h"
 #include "./internal/helpers.h"
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
-// field order matters for 16byte data alignment
+#define _DEFAULT_MAX_BLOCK_SIZE (256 * MiB)
+
+// Extra block chained on by a chained allocator once the space before it is
+// full. Blocks are mapped read/write whole and unmapped whole.
+struct linear_allocator_block {
+  struct linear_allocator_block* prev;
+  usize mapping_size;
+  usize prev_data_size;   // bump.curr_data_size of the block before this one
+  usize prev_head_index;  // and its bump.head_index when this one was chained
+  LIBD_ALIGNAS(LIBD_MAX_ALIGN) u8 data[];
+};
+
+// bump must stay first: libd_linear_allocator_alloc_fast in memory.h reads
+// it straight through the handle. bump.data points at data, or at the data
+// of tail once blocks have been chained on.
 struct linear_allocator {
-  usize curr_data_size;
-  usize head_index;
-  u8 alignment;
-  u8 header_size;
+  struct libd_linear_allocator_bump bump;
+  u32 header_size;
   u32 sys_page_size;
+  u32 n_blocks;
+  bool chained;
   usize data_reservation_size;
-  u8 data[];
+  usize reset_keep_bytes;
+  usize max_block_size;
+  usize commit_ahead_bytes;
+  struct linear_allocator_block* tail;
+#ifdef LIBD_MEMORY_STATS
+  struct libd_linear_allocator_stats stats;
+#endif
+  LIBD_ALIGNAS(LIBD_MAX_ALIGN) u8 data[];
 };
 
 static inline usize
@@ -25,26 +48,177 @@ _total_reservation_size(struct linear_allocator* la)
     la->header_size + la->data_reservation_size, la->sys_page_size);
 }
 
-struct linear_allocator_savepoint {
-  u32 data_index;
-};
+static inline usize
+_total_committed_size(struct linear_allocator* la)
+{
+  return libd_memory_align_up(
+    la->header_size + la->bump.curr_data_size, la->sys_page_size);
+}
+
+// Largest single allocation. Chained allocators are only bounded by keeping
+// every head + size sum clear of overflow.
+static inline usize
+_max_alloc_size(struct linear_allocator* la)
+{
+  return la->chained ? SIZE_MAX / 4 : la->data_reservation_size;
+}
+
+static enum libd_result
+_trim(
+  struct linear_allocator* la,
+  usize keep_bytes);
+
+static enum libd_result
+_chain(
+  struct linear_allocator* la,
+  usize min_data_size);
+
+static enum libd_result
+_pop_block(struct linear_allocator* la);
+
+static enum libd_result
+_commit(
+  struct linear_allocator* la,
+  usize data_size);
+
+static void
+_prefault(
+  struct linear_allocator* la,
+  u8* start,
+  usize size);
+
+#ifdef LIBD_MEMORY_DEBUG
+static void
+_debug_place(
+  u8* start,
+  usize size,
+  u8* end);
+
+static void
+_debug_release(
+  u8* from,
+  u8* to);
+#endif
+
+#ifdef LIBD_MEMORY_STATS
+static inline void
+_stat_alloc(
+  struct linear_allocator* la,
+  usize requested,
+  usize consumed);
+
+static inline void
+_stat_peak(struct linear_allocator* la);
+#endif
+
+static void
+_place_aligned(
+  struct linear_allocator* la,
+  usize size,
+  u32 alignment,
+  usize* out_start_index,
+  usize* out_new_head);
+
+// Makes room for the current block to reach data index new_head: commits more
+// of the first reservation, doubling the committed region to amortize future
+// large allocations. In commit-ahead mode it instead commits and prefaults
+// commit_ahead_bytes past new_head, so every committed page is already
+// resident. Past the reservation a chained allocator moves on to a new block
+// of at least min_block_size bytes, leaving the head at its start.
+static enum libd_result
+_grow(
+  struct linear_allocator* la,
+  usize new_head,
+  usize min_block_size)
+{
+  if (la->tail != NULL || la->data_reservation_size < new_head) {
+    if (!la->chained) {
+      return libd_no_memory;
+    }
+    return _chain(la, min_block_size);
+  }
+
+  if (la->commit_ahead_bytes == 0) {
+    return _commit(la, MAX(new_head, la->bump.curr_data_size * 2));
+  }
+
+  usize old_data_size     = la->bump.curr_data_size;
+  enum libd_result result = _commit(la, new_head + la->commit_ahead_bytes);
+  if (result != libd_ok) {
+    return result;
+  }
+  _prefault(
+    la, &la->data[old_data_size], la->bump.curr_data_size - old_data_size);
+
+  return libd_ok;
+}
+
+// Commits the first reservation up to at least data_size bytes, clamped to
+// the reservation.
+static enum libd_result
+_commit(
+  struct linear_allocator* la,
+  usize data_size)
+{
+  // Ensure total allocation (header + data) is page-aligned for mprotect
+  usize new_total_size =
+    libd_memory_align_up(la->header_size + data_size, la->sys_page_size);
+
+  new_total_size = MIN(new_total_size, _total_reservation_size(la));
+
+  if (mprotect(la, new_total_size, PROT_READ | PROT_WRITE) != 0) {
+    return libd_no_memory;
+  }
+  la->bump.curr_data_size = new_total_size - la->header_size;
+  LIBD_MEMORY_STAT(la->stats.grow_count += 1);
+
+  return libd_ok;
+}
 
 enum libd_result
 libd_linear_allocator_create(
   struct linear_allocator** out,
-  u32 data_reservation_size,
-  u32 starting_capacity,
+  usize data_reservation_size,
+  usize starting_capacity,
   u8 alignment)
 {
+  return libd_linear_allocator_create_with_options(
+    out, data_reservation_size, starting_capacity, alignment, NULL);
+}
+
+enum libd_result
+libd_linear_allocator_create_with_options(
+  struct linear_allocator** out,
+  usize data_reservation_size,
+  usize starting_capacity,
+  u8 alignment,
+  const struct libd_linear_allocator_options* options)
+{
+  static const struct libd_linear_allocator_options default_options = {
+    .chained = false,
+  };
+  if (options == NULL) {
+    options = &default_options;
+  }
+
   if (out == NULL || starting_capacity == 0) {
     return libd_invalid_parameter;
   }
+  if (
+    options->max_block_size > SIZE_MAX / 4 ||
+    options->commit_ahead_bytes > SIZE_MAX / 4) {
+    return libd_invalid_parameter;
+  }
 
   if (!libd_memory_is_valid_alignment(alignment)) {
     return libd_invalid_alignment;
   }
+  // keeps every head + size sum below overflow.
+  if (data_reservation_size > SIZE_MAX / 2) {
+    return libd_no_memory;
+  }
 
-  u8 header_size = sizeof(struct linear_allocator);
+  u32 header_size = sizeof(struct linear_allocator);
 
   s64 page_size = sysconf(_SC_PAGE_SIZE);
   if (page_size == -1) {
@@ -72,12 +246,28 @@ libd_linear_allocator_create(
     return libd_err;
   }
 
-  la->curr_data_size        = curr_data_size;
-  la->head_index            = 0;
-  la->alignment             = alignment;
+  la->bump.data             = la->data;
+  la->bump.curr_data_size   = curr_data_size;
+  la->bump.head_index       = 0;
+  la->bump.alignment_mask   = alignment - 1;
   la->data_reservation_size = data_reservation_size;
+  la->reset_keep_bytes      = SIZE_MAX;
   la->sys_page_size         = page_size;
   la->header_size           = header_size;
+  la->chained               = options->chained;
+  la->max_block_size        = options->max_block_size != 0
+                                ? options->max_block_size
+                                : _DEFAULT_MAX_BLOCK_SIZE;
+  la->n_blocks              = 0;
+  la->tail                  = NULL;
+  la->commit_ahead_bytes    = options->commit_ahead_bytes;
+  LIBD_MEMORY_STAT(la->stats = (struct libd_linear_allocator_stats){ 0 });
+
+  LIBD_MEMORY_POISON(la->data, _total_reservation_size(la) - header_size);
+
+  if (la->commit_ahead_bytes != 0) {
+    _prefault(la, la->data, la->bump.curr_data_size);
+  }
 
   *out = la;
 
@@ -91,6 +281,15 @@ libd_linear_allocator_destroy(struct linear_allocator* la)
     return libd_invalid_parameter;
   }
 
+  while (la->tail != NULL) {
+    enum libd_result result = _pop_block(la);
+    if (result != libd_ok) {
+      return result;
+    }
+  }
+
+  // the shadow outlives the mapping, so the range is handed back clean.
+  LIBD_MEMORY_UNPOISON(la, _total_reservation_size(la));
   if (munmap(la, _total_reservation_size(la)) != 0) {
     return libd_err;
   }
@@ -102,35 +301,149 @@ enum libd_result
 libd_linear_allocator_alloc(
   struct linear_allocator* la,
   void** out_ptr,
-  u32 size)
+  usize size)
 {
   if (la == NULL || out_ptr == NULL) {
     return libd_invalid_parameter;
   }
+  if (size > _max_alloc_size(la)) {
+    return libd_no_memory;
+  }
 
-  if (la->curr_data_size < la->head_index + size) {
-    if (la->data_reservation_size < la->head_index + size) {
-      return libd_no_memory;
+  usize aligned_size = libd_memory_align_up(
+    size + LIBD_MEMORY_REDZONE, la->bump.alignment_mask + 1);
+  usize new_head = la->bump.head_index + aligned_size;
+
+  if (la->bump.curr_data_size < new_head) {
+    enum libd_result result = _grow(la, new_head, aligned_size);
+    if (result != libd_ok) {
+      return result;
     }
-    // Round to next multiple of data_size * 2 to amortize future large
-    // allocations
-    usize new_data_size =
-      libd_memory_align_up(la->head_index + size, la->curr_data_size * 2);
+    new_head = la->bump.head_index + aligned_size;
+  }
 
-    // Ensure total allocation (header + data) is page-aligned for mprotect
-    usize new_total_size =
-      libd_memory_align_up(la->header_size + new_data_size, la->sys_page_size);
+  LIBD_MEMORY_DEBUG_ONLY(_debug_place(
+    &la->bump.data[la->bump.head_index], size, &la->bump.data[new_head]));
+  *out_ptr            = &la->bump.data[la->bump.head_index];
+  la->bump.head_index = new_head;
+  LIBD_MEMORY_STAT(_stat_alloc(la, size, aligned_size));
 
-    new_total_size = MIN(new_total_size, _total_reservation_size(la));
+  return libd_ok;
+}
+
+enum libd_result
+libd_linear_allocator_alloc_aligned(
+  struct linear_allocator* la,
+  void** out_ptr,
+  usize size,
+  u32 alignment)
+{
+  if (la == NULL || out_ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+  if (
+    alignment == 0 || !libd_memory_is_power_of_two(alignment) ||
+    alignment > la->sys_page_size) {
+    return libd_invalid_alignment;
+  }
+  if (size > _max_alloc_size(la)) {
+    return libd_no_memory;
+  }
 
-    if (mprotect(la, new_total_size, PROT_READ | PROT_WRITE) != 0) {
-      // TODO:
+  usize padded_size = size + LIBD_MEMORY_REDZONE;
+  usize start_index;
+  usize new_head;
+  _place_aligned(la, padded_size, alignment, &start_index, &new_head);
+
+  if (la->bump.curr_data_size < new_head) {
+    // a fresh block has room for the size rounded up plus the worst case
+    // padding in front of it.
+    usize min_block_size =
+      libd_memory_align_up(padded_size, la->bump.alignment_mask + 1) +
+      alignment;
+    enum libd_result result = _grow(la, new_head, min_block_size);
+    if (result != libd_ok) {
+      return result;
     }
-    la->curr_data_size = new_total_size - la->header_size;
+    _place_aligned(la, padded_size, alignment, &start_index, &new_head);
   }
 
-  *out_ptr = &la->data[la->head_index];
-  la->head_index += libd_memory_align_up(size, la->alignment);
+  LIBD_MEMORY_DEBUG_ONLY(_debug_place(
+    &la->bump.data[start_index], size, &la->bump.data[new_head]));
+  LIBD_MEMORY_STAT(_stat_alloc(la, size, new_head - la->bump.head_index));
+  *out_ptr            = &la->bump.data[start_index];
+  la->bump.head_index = new_head;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_linear_allocator_resize(
+  struct linear_allocator* la,
+  void** out_ptr,
+  void* ptr,
+  usize old_size,
+  usize new_size)
+{
+  if (la == NULL || out_ptr == NULL) {
+    return libd_invalid_parameter;
+  }
+  if (ptr == NULL) {
+    return libd_linear_allocator_alloc(la, out_ptr, new_size);
+  }
+  if (new_size > _max_alloc_size(la)) {
+    return libd_no_memory;
+  }
+
+  // the most recent allocation ends exactly at the head of the current block,
+  // so it can move its end freely.
+  usize alignment = la->bump.alignment_mask + 1;
+  usize head      = la->bump.head_index;
+  uptr data       = (uptr)la->bump.data;
+  usize ptr_index = (uptr)ptr - data;
+
+  bool is_top = (uptr)ptr >= data && ptr_index <= head &&
+                old_size <= head - ptr_index &&
+                ptr_index + libd_memory_align_up(
+                              old_size + LIBD_MEMORY_REDZONE, alignment) ==
+                  head;
+
+  if (is_top) {
+    // resizing to nothing gives the redzone back too.
+    usize new_head =
+      new_size == 0
+        ? ptr_index
+        : ptr_index +
+            libd_memory_align_up(new_size + LIBD_MEMORY_REDZONE, alignment);
+    bool fits = new_head <= la->bump.curr_data_size;
+    if (
+      !fits && la->tail == NULL && new_head <= la->data_reservation_size) {
+      fits = _grow(la, new_head, 0) == libd_ok;
+    }
+    if (fits) {
+      LIBD_MEMORY_STAT(_stat_peak(la));
+      LIBD_MEMORY_DEBUG_ONLY(
+        _debug_release(&la->bump.data[new_head], &la->bump.data[head]));
+      LIBD_MEMORY_DEBUG_ONLY(
+        _debug_place(ptr, new_size, &la->bump.data[new_head]));
+      la->bump.head_index = new_head;
+      *out_ptr            = ptr;
+      return libd_ok;
+    }
+  } else if (new_size <= old_size) {
+    LIBD_MEMORY_DEBUG_ONLY(
+      _debug_release((u8*)ptr + new_size, (u8*)ptr + old_size));
+    *out_ptr = ptr;
+    return libd_ok;
+  }
+
+  void* moved;
+  enum libd_result result = libd_linear_allocator_alloc(la, &moved, new_size);
+  if (result != libd_ok) {
+    return result;
+  }
+  memcpy(moved, ptr, MIN(old_size, new_size));
+  *out_ptr = moved;
 
   return libd_ok;
 }
@@ -145,7 +458,8 @@ libd_linear_allocator_set_savepoint(
   }
 
   *out_sp = (struct linear_allocator_savepoint){
-    .data_index = la->head_index,
+    .data_index  = la->bump.head_index,
+    .block_index = la->n_blocks,
   };
 
   return libd_ok;
@@ -160,7 +474,20 @@ libd_linear_allocator_restore_savepoint(
     return libd_invalid_parameter;
   }
 
-  la->head_index = sp->data_index;
+  LIBD_MEMORY_STAT(_stat_peak(la));
+  while (la->n_blocks > sp->block_index) {
+    enum libd_result result = _pop_block(la);
+    if (result != libd_ok) {
+      return result;
+    }
+  }
+  LIBD_MEMORY_DEBUG_ONLY(_debug_release(
+    &la->bump.data[sp->data_index], &la->bump.data[la->bump.head_index]));
+  la->bump.head_index = sp->data_index;
+
+  if (la->reset_keep_bytes != SIZE_MAX) {
+    return _trim(la, la->reset_keep_bytes);
+  }
 
   return libd_ok;
 }
@@ -172,7 +499,20 @@ libd_linear_allocator_reset(struct linear_allocator* la)
     return libd_invalid_parameter;
   }
 
-  la->head_index = 0;
+  LIBD_MEMORY_STAT(_stat_peak(la));
+  while (la->tail != NULL) {
+    enum libd_result result = _pop_block(la);
+    if (result != libd_ok) {
+      return result;
+    }
+  }
+  LIBD_MEMORY_DEBUG_ONLY(
+    _debug_release(la->bump.data, &la->bump.data[la->bump.head_index]));
+  la->bump.head_index = 0;
+
+  if (la->reset_keep_bytes != SIZE_MAX) {
+    return _trim(la, la->reset_keep_bytes);
+  }
 
   return libd_ok;
 }
@@ -186,7 +526,311 @@ libd_linear_allocator_bytes_free(
     return libd_invalid_parameter;
   }
 
-  *out_size_bytes = la->curr_data_size - la->head_index;
+  *out_size_bytes = la->bump.curr_data_size - la->bump.head_index;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_linear_allocator_prefault(
+  struct linear_allocator* la,
+  usize bytes)
+{
+  if (la == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  usize head  = la->bump.head_index;
+  usize limit = la->tail != NULL ? la->bump.curr_data_size
+                                 : la->data_reservation_size;
+  limit       = MAX(limit, head);
+  usize end   = bytes > limit - head ? limit : head + bytes;
+
+  if (la->bump.curr_data_size < end) {
+    enum libd_result result = _commit(la, end);
+    if (result != libd_ok) {
+      return result;
+    }
+  }
+  _prefault(la, &la->bump.data[head], end - head);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_linear_allocator_get_stats(
+  struct linear_allocator* la,
+  struct libd_linear_allocator_stats* out_stats)
+{
+  if (la == NULL || out_stats == NULL) {
+    return libd_invalid_parameter;
+  }
+
+#ifdef LIBD_MEMORY_STATS
+  _stat_peak(la);
+  *out_stats = la->stats;
+
+  // the first reservation's committed size is parked in the oldest block.
+  struct linear_allocator_block* block = la->tail;
+  usize committed                      = 0;
+  usize first_data_size                = la->bump.curr_data_size;
+  while (block != NULL) {
+    committed       += block->mapping_size;
+    first_data_size  = block->prev_data_size;
+    block            = block->prev;
+  }
+  committed += libd_memory_align_up(
+    la->header_size + first_data_size, la->sys_page_size);
+
+  out_stats->committed_bytes = committed;
+  out_stats->chained_blocks  = la->n_blocks;
+
+  return libd_ok;
+#else
+  return libd_mem_not_implemented;
+#endif
+}
+
+enum libd_result
+libd_linear_allocator_trim(
+  struct linear_allocator* la,
+  usize keep_bytes)
+{
+  if (la == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  return _trim(la, keep_bytes);
+}
+
+enum libd_result
+libd_linear_allocator_set_trim_on_reset(
+  struct linear_allocator* la,
+  usize keep_bytes)
+{
+  if (la == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  la->reset_keep_bytes = keep_bytes;
+
+  return libd_ok;
+}
+
+// Returns the committed pages past both the head and keep_bytes to the
+// system. MADV_DONTNEED drops them from the resident set and PROT_NONE puts
+// them back in the state _grow expects to find them in. Only the first
+// reservation is trimmed; chained blocks are unmapped whole on reset.
+static enum libd_result
+_trim(
+  struct linear_allocator* la,
+  usize keep_bytes)
+{
+  if (la->tail != NULL) {
+    return libd_ok;
+  }
+
+  usize keep_data_size = MAX(la->bump.head_index, keep_bytes);
+  if (keep_data_size >= la->bump.curr_data_size) {
+    return libd_ok;
+  }
+
+  usize keep_total_size =
+    libd_memory_align_up(la->header_size + keep_data_size, la->sys_page_size);
+  usize committed_total_size = _total_committed_size(la);
+  if (keep_total_size >= committed_total_size) {
+    return libd_ok;
+  }
+
+  u8* trim_start  = (u8*)la + keep_total_size;
+  usize trim_size = committed_total_size - keep_total_size;
+  if (
+    madvise(trim_start, trim_size, MADV_DONTNEED) != 0 ||
+    mprotect(trim_start, trim_size, PROT_NONE) != 0) {
+    return libd_err;
+  }
+  la->bump.curr_data_size = keep_total_size - la->header_size;
+
+  return libd_ok;
+}
+
+// The data region of every block is only aligned to LIBD_MAX_ALIGN, so align
+// the address rather than the index. The end is rounded back up to the
+// allocator's alignment so the next plain alloc stays aligned.
+static void
+_place_aligned(
+  struct linear_allocator* la,
+  usize size,
+  u32 alignment,
+  usize* out_start_index,
+  usize* out_new_head)
+{
+  uptr start =
+    libd_memory_align_up((uptr)&la->bump.data[la->bump.head_index], alignment);
+  usize start_index = start - (uptr)la->bump.data;
+
+  *out_start_index = start_index;
+  *out_new_head =
+    libd_memory_align_up(start_index + size, la->bump.alignment_mask + 1);
+}
+
+// Maps a new block, doubling the size of the one before it up to
+// max_block_size, and moves the bump state over to it. Whatever was left in
+// the previous block is abandoned until a reset or savepoint unwinds to it.
+static enum libd_result
+_chain(
+  struct linear_allocator* la,
+  usize min_data_size)
+{
+  if (la->n_blocks == U32_MAX) {
+    return libd_no_memory;
+  }
+
+  usize prev_data_size = la->tail != NULL
+                           ? la->tail->mapping_size - sizeof(*la->tail)
+                           : la->data_reservation_size;
+  usize data_size      = prev_data_size >= la->max_block_size / 2
+                           ? la->max_block_size
+                           : prev_data_size * 2;
+  data_size            = MAX(data_size, min_data_size);
+
+  usize mapping_size = libd_memory_align_up(
+    sizeof(struct linear_allocator_block) + data_size, la->sys_page_size);
+
+  struct linear_allocator_block* block = mmap(
+    NULL,
+    mapping_size,
+    PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+    -1,
+    0);
+  if (block == MAP_FAILED) {
+    return libd_no_memory;
+  }
+
+  LIBD_MEMORY_STAT(_stat_peak(la));
+  LIBD_MEMORY_POISON(block->data, mapping_size - sizeof(*block));
+  block->prev            = la->tail;
+  block->mapping_size    = mapping_size;
+  block->prev_data_size  = la->bump.curr_data_size;
+  block->prev_head_index = la->bump.head_index;
+
+  la->tail                 = block;
+  la->n_blocks            += 1;
+  la->bump.data            = block->data;
+  la->bump.head_index      = 0;
+  la->bump.curr_data_size  = mapping_size - sizeof(*block);
+
+  // blocks are mapped whole, so only the part about to be used is prefaulted.
+  if (la->commit_ahead_bytes != 0) {
+    usize ahead = MIN(
+      min_data_size + la->commit_ahead_bytes, la->bump.curr_data_size);
+    _prefault(la, block->data, ahead);
+  }
 
   return libd_ok;
 }
+
+// Unmaps the newest block and moves the bump state back to where the block
+// before it was left. The caller sets the head.
+static enum libd_result
+_pop_block(struct linear_allocator* la)
+{
+  struct linear_allocator_block* block = la->tail;
+
+  la->tail                 = block->prev;
+  la->n_blocks            -= 1;
+  la->bump.data            = la->tail != NULL ? la->tail->data : la->data;
+  la->bump.head_index      = block->prev_head_index;
+  la->bump.curr_data_size  = block->prev_data_size;
+
+  LIBD_MEMORY_UNPOISON(block, block->mapping_size);
+  if (munmap(block, block->mapping_size) != 0) {
+    return libd_err;
+  }
+
+  return libd_ok;
+}
+
+// Faults in every page overlapping [start, start + size) for writing, so the
+// allocations that land there take no first-touch faults. The pages may be
+// poisoned in debug builds, hence no instrumentation.
+LIBD_NO_SANITIZE_ADDRESS static void
+_prefault(
+  struct linear_allocator* la,
+  u8* start,
+  usize size)
+{
+  if (size == 0) {
+    return;
+  }
+
+  uptr first = (uptr)start & ~((uptr)la->sys_page_size - 1);
+  uptr end   = libd_memory_align_up((uptr)start + size, la->sys_page_size);
+
+#ifdef MADV_POPULATE_WRITE
+  if (madvise((void*)first, end - first, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  // kernels before 5.14 reject MADV_POPULATE_WRITE; touch the pages instead.
+  // Reading and writing back keeps whatever is already there intact.
+  for (uptr page = first; page < end; page += la->sys_page_size) {
+    volatile u8* p = (volatile u8*)page;
+    *p             = *p;
+  }
+}
+
+#ifdef LIBD_MEMORY_DEBUG
+// Hands out [start, start + size) and turns the rest of the span up to end,
+// alignment padding included, into the allocation's redzone.
+static void
+_debug_place(
+  u8* start,
+  usize size,
+  u8* end)
+{
+  LIBD_MEMORY_UNPOISON(start, size);
+  if (start + size < end) {
+    libd_memory_debug_fill(
+      start + size, end - start - size, LIBD_MEMORY_GUARD_BYTE);
+    LIBD_MEMORY_POISON(start + size, end - start - size);
+  }
+}
+
+// Fills [from, to) with the freed pattern and poisons it, so stale pointers
+// into released memory read garbage or, under ASan, fault.
+static void
+_debug_release(
+  u8* from,
+  u8* to)
+{
+  if (from < to) {
+    libd_memory_debug_fill(from, to - from, LIBD_MEMORY_FREED_BYTE);
+    LIBD_MEMORY_POISON(from, to - from);
+  }
+}
+#endif
+
+#ifdef LIBD_MEMORY_STATS
+static inline void
+_stat_alloc(
+  struct linear_allocator* la,
+  usize requested,
+  usize consumed)
+{
+  la->stats.alloc_count     += 1;
+  la->stats.bytes_requested += requested;
+  la->stats.bytes_consumed  += consumed;
+}
+
+// The head only moves down on reset, savepoint restore, in-place shrink and
+// when moving to another block, so recording the peak there (and when the
+// stats are read) catches allocations made through the inline fast path too.
+static inline void
+_stat_peak(struct linear_allocator* la)
+{
+  la->stats.peak_head_index =
+    MAX(la->stats.peak_head_index, la->bump.head_index);
+}
+#endif
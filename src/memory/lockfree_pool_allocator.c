@@ -0,0 +1,177 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/utils/align_compat.h"
+#include "../../include/libd/utils/atomic_compat.h"
+#include "./internal/helpers.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// The free list head packs the slot index into the low 32 bits and a
+// generation counter into the high 32 bits. Every successful push/pop bumps
+// the generation, so a CAS against a stale head fails even when the same
+// index has been popped and pushed back in between (ABA).
+#define _TAG_INDEX(tag)             ((u32)((tag) & U32_MAX))
+#define _TAG_GENERATION(tag)        ((u32)((tag) >> 32))
+#define _TAG_MAKE(generation, index) (((u64)(generation) << 32) | (u64)(index))
+
+// field order matters: the contended head gets a cache line to itself so the
+// read-only geometry and the slot data never share it.
+struct lockfree_pool_allocator {
+  u32 max_allocations;
+  u32 bytes_per_alloc;
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) u64 head;
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) u8 data[];
+};
+
+static inline u32*
+_next_of(
+  struct lockfree_pool_allocator* pa,
+  u32 i)
+{
+  return (u32*)&pa->data[(usize)i * pa->bytes_per_alloc];
+}
+
+static inline u32
+_terminal_index(struct lockfree_pool_allocator* pa)
+{
+  return pa->max_allocations;
+}
+
+static void
+_initialize_free_list(struct lockfree_pool_allocator* pa);
+
+enum libd_result
+libd_lockfree_pool_allocator_create(
+  struct lockfree_pool_allocator** out_pa,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 alignment)
+{
+  if (out_pa == NULL || max_allocations == 0 || bytes_per_alloc == 0) {
+    return libd_invalid_parameter;
+  }
+  if (!libd_memory_is_valid_alignment(alignment)) {
+    return libd_invalid_alignment;
+  }
+  // checking that there is room for the terminal index
+  if (max_allocations == U32_MAX) {
+    return libd_no_memory;
+  }
+
+  // every slot must hold an aligned u32 link.
+  u32 aligned_bytes_per_alloc = libd_memory_align_up(
+    bytes_per_alloc, MAX(alignment, (u8)LIBD_ALIGNOF(u32)));
+
+  usize total_size = sizeof(struct lockfree_pool_allocator) +
+                     (usize)max_allocations * aligned_bytes_per_alloc;
+
+  void* mem;
+  if (posix_memalign(&mem, LIBD_CACHE_LINE_SIZE, total_size) != 0) {
+    return libd_no_memory;
+  }
+
+  struct lockfree_pool_allocator* pa = mem;
+  pa->max_allocations                = max_allocations;
+  pa->bytes_per_alloc                = aligned_bytes_per_alloc;
+  _initialize_free_list(pa);
+
+  *out_pa = pa;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_lockfree_pool_allocator_destroy(struct lockfree_pool_allocator* pa)
+{
+  if (pa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  free(pa);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_lockfree_pool_allocator_alloc(
+  struct lockfree_pool_allocator* pa,
+  void** out_pointer)
+{
+  if (pa == NULL || out_pointer == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  u64 head = LIBD_ATOMIC_LOAD(&pa->head, LIBD_ATOMIC_ACQUIRE);
+  u64 new_head;
+  u32 index;
+  do {
+    index = _TAG_INDEX(head);
+    if (index == _terminal_index(pa)) {
+      return libd_no_memory;
+    }
+    // The slot may be popped and written by another thread before the CAS
+    // below, in which case this read is stale and the CAS fails on the
+    // generation. The slot memory itself is always valid to read.
+    u32 next = LIBD_ATOMIC_LOAD(_next_of(pa, index), LIBD_ATOMIC_RELAXED);
+    new_head = _TAG_MAKE(_TAG_GENERATION(head) + 1, next);
+  } while (!LIBD_ATOMIC_CAS_WEAK(
+    &pa->head, &head, new_head, LIBD_ATOMIC_ACQUIRE, LIBD_ATOMIC_ACQUIRE));
+
+  *out_pointer = _next_of(pa, index);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_lockfree_pool_allocator_free(
+  struct lockfree_pool_allocator* pa,
+  void* p_to_free)
+{
+  if (pa == NULL || p_to_free == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  ptrdiff_t byte_offset = (u8*)p_to_free - pa->data;
+  if (byte_offset < 0 || byte_offset % pa->bytes_per_alloc != 0) {
+    return libd_invalid_pointer;  // below bounds or not block aligned
+  }
+
+  u32 free_index = byte_offset / pa->bytes_per_alloc;
+  if (free_index >= pa->max_allocations) {
+    return libd_invalid_pointer;  // above bounds
+  }
+
+  u64 head = LIBD_ATOMIC_LOAD(&pa->head, LIBD_ATOMIC_RELAXED);
+  u64 new_head;
+  do {
+    LIBD_ATOMIC_STORE(
+      _next_of(pa, free_index), _TAG_INDEX(head), LIBD_ATOMIC_RELAXED);
+    new_head = _TAG_MAKE(_TAG_GENERATION(head) + 1, free_index);
+  } while (!LIBD_ATOMIC_CAS_WEAK(
+    &pa->head, &head, new_head, LIBD_ATOMIC_RELEASE, LIBD_ATOMIC_RELAXED));
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_lockfree_pool_allocator_reset(struct lockfree_pool_allocator* pa)
+{
+  if (pa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  _initialize_free_list(pa);
+
+  return libd_ok;
+}
+
+static void
+_initialize_free_list(struct lockfree_pool_allocator* pa)
+{
+  for (u32 i = 0; i < pa->max_allocations; i += 1) {
+    *_next_of(pa, i) = i + 1;
+  }
+
+  LIBD_ATOMIC_STORE(&pa->head, _TAG_MAKE(0, 0), LIBD_ATOMIC_RELEASE);
+}
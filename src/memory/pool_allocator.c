@@ -1,29 +1,108 @@
 #include "../../include/libd/memory.h"
 #include "../../include/libd/utils/align_compat.h"
+#include "../../include/libd/utils/atomic_compat.h"
 #include "./internal/helpers.h"
+#include "./internal/pool_allocator.h"
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+// Slots at or above next_unused_index have never been handed out and are
+// free without being linked, so create and reset never touch the slot data.
+// It only changes with atomic stores once the pool is created, so owns can
+// read it while another thread allocates.
+//
+// In address-ordered mode the free slots below next_unused_index are tracked
+// by a two-level bitmap instead of the in-slot free list, and head_index holds
+// the lowest summary word that may contain a set bit.
+//
+// Slots below committed_allocations are backed by readable memory. A heap
+// backed pool commits everything up front; an mmap backed pool has the header
+// at the start of its reservation and commits more of it as
+// next_unused_index reaches the end of the committed range.
+//
+// A growable pool chains heap chunks. Chunk 0 is data and holds
+// first_chunk_allocations slots; chunk k > 0 holds
+// first_chunk_allocations << (k - 1) slots starting at that same index, so
+// each chunk doubles the pool and an index maps to its chunk with one clz.
+// max_allocations is the capacity across every chunk. Only growable pools
+// allocate the chunk table; the others have chunks NULL and n_chunks 1.
 struct pool_allocator {
+  u64* free_bitmap;
   u32 max_allocations;
   u32 bytes_per_alloc;
   u32 head_index;
-  u32 tail_index;
-  u8 data[];
+  u32 next_unused_index;
+  u32 committed_allocations;
+  u32 first_chunk_allocations;
+  u8 free_order;
+  u8 backing;
+  u8 growable;
+  u8 n_chunks;
+  usize committed_size;
+  usize reservation_size;
+  usize commit_granularity;
+#ifdef LIBD_MEMORY_STATS
+  struct libd_pool_allocator_stats stats;
+#endif
+  u8** chunks;
+  LIBD_ALIGNAS(LIBD_MAX_ALIGN) u8 data[];
 };
 
-static inline u32
+#define _BITMAP_WORD_BITS       64
+#define _DEFAULT_HUGE_PAGE_SIZE ((usize)2 * MiB)
+#define _HEADER_SIZE            offsetof(struct pool_allocator, data)
+#define _MAX_CHUNKS             32
+
+// where the kernel reports its huge page sizes.
+#define _HUGETLB_SIZE_PATH "/proc/meminfo"
+#define _THP_SIZE_PATH     "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"
+
+// backing for pools created inside a reservation owned by someone else. They
+// commit like mmap backed pools but never unmap.
+#define _BACKING_IN_PLACE (libd_pool_backing_mmap + 1)
+
+static u32
+_slot_size(
+  u32 bytes_per_alloc,
+  u8 alignment);
+
+static void
+_init_header(
+  struct pool_allocator* pa,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 backing,
+  const struct libd_pool_allocator_options* options,
+  usize reservation_size,
+  usize commit_granularity);
+
+static inline usize
 _byte_index(
   struct pool_allocator* pa,
   u32 i);
 
-static inline u32
-_head_byte_index(struct pool_allocator* pa);
+#ifdef LIBD_MEMORY_STATS
+static inline void
+_stat_alloc(
+  struct pool_allocator* pa,
+  enum libd_result result,
+  u32 n);
 
-static inline u32
-_tail_byte_index(struct pool_allocator* pa);
+static inline void
+_stat_free(
+  struct pool_allocator* pa,
+  u32 n);
+#endif
+
+static inline usize
+_head_byte_index(struct pool_allocator* pa);
 
 static inline u32
 _terminal_index(struct pool_allocator* pa);
@@ -33,9 +112,76 @@ _ptr_to_index(
   struct pool_allocator* pa,
   u32 i);
 
+static u8*
+_chunk_ptr_to_index(
+  struct pool_allocator* pa,
+  u32 i);
+
+static bool
+_index_of_ptr(
+  const struct pool_allocator* pa,
+  const void* ptr,
+  u32* out_index);
+
 enum libd_result
 _initialize_free_list(struct pool_allocator* pa);
 
+static inline u32
+_words_for_bits(u32 n_bits);
+
+static inline u32
+_bitmap_words(struct pool_allocator* pa);
+
+static inline u64*
+_summary_bitmap(struct pool_allocator* pa);
+
+static inline void
+_free_lifo(
+  struct pool_allocator* pa,
+  u32 free_index);
+
+#ifdef LIBD_MEMORY_DEBUG
+static void
+_debug_release_slot(
+  struct pool_allocator* pa,
+  u8* slot);
+#endif
+
+static enum libd_result
+_alloc_address_ordered(
+  struct pool_allocator* pa,
+  void** out_pointer);
+
+static enum libd_result
+_free_address_ordered(
+  struct pool_allocator* pa,
+  u32 free_index);
+
+static enum libd_result
+_bump_unused(
+  struct pool_allocator* pa,
+  void** out_pointer);
+
+static enum libd_result
+_commit_more(struct pool_allocator* pa);
+
+static enum libd_result
+_add_chunk(struct pool_allocator* pa);
+
+static struct pool_allocator*
+_reserve(
+  usize size,
+  enum libd_pool_allocator_huge_pages huge_pages,
+  usize* out_reservation_size,
+  usize* out_commit_granularity);
+
+static usize
+_huge_page_size(enum libd_pool_allocator_huge_pages huge_pages);
+
+// huge page sizes read from the kernel, 0 until first use.
+static usize g_hugetlb_page_size = 0;
+static usize g_thp_page_size     = 0;
+
 // NOTE: not used in the code, but here for size and alignment calculations,
 // with the possibility of future extension.
 typedef struct {
@@ -54,9 +200,50 @@ libd_pool_allocator_create(
   u32 bytes_per_alloc,
   u8 alignment)
 {
+  return libd_pool_allocator_create_with_options(
+    out_pa, max_allocations, bytes_per_alloc, alignment, NULL);
+}
+
+enum libd_result
+libd_pool_allocator_create_with_options(
+  struct pool_allocator** out_pa,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 alignment,
+  const struct libd_pool_allocator_options* options)
+{
+  static const struct libd_pool_allocator_options default_options = {
+    .free_order = libd_pool_free_lifo,
+  };
+  if (options == NULL) {
+    options = &default_options;
+  }
+
   if (out_pa == NULL || max_allocations == 0 || bytes_per_alloc == 0) {
     return libd_invalid_parameter;
   }
+  if (
+    options->free_order != libd_pool_free_lifo &&
+    options->free_order != libd_pool_free_address_ordered) {
+    return libd_invalid_parameter;
+  }
+  if (
+    options->backing != libd_pool_backing_heap &&
+    options->backing != libd_pool_backing_mmap) {
+    return libd_invalid_parameter;
+  }
+  if (
+    options->huge_pages != libd_pool_huge_pages_none &&
+    (options->backing != libd_pool_backing_mmap ||
+     (options->huge_pages != libd_pool_huge_pages_transparent &&
+      options->huge_pages != libd_pool_huge_pages_explicit))) {
+    return libd_invalid_parameter;
+  }
+  if (
+    options->growable && (options->backing != libd_pool_backing_heap ||
+                          options->free_order != libd_pool_free_lifo)) {
+    return libd_invalid_parameter;
+  }
   if (!libd_memory_is_valid_alignment(alignment)) {
     return libd_invalid_alignment;
   }
@@ -65,29 +252,118 @@ libd_pool_allocator_create(
     return libd_no_memory;
   }
 
-  u32 aligned_bytes_per_alloc =
-    libd_memory_align_up(bytes_per_alloc, alignment);
+  u32 aligned_bytes_per_alloc = _slot_size(bytes_per_alloc, alignment);
 
-  // Ensure there is enough space for the free list nodes.
-  if (aligned_bytes_per_alloc < _aligned_sizeof_free_node()) {
-    aligned_bytes_per_alloc = _aligned_sizeof_free_node();
-  }
+  usize data_size  = (usize)max_allocations * aligned_bytes_per_alloc;
+  usize total_size = _HEADER_SIZE + data_size;
 
-  usize data_size  = (max_allocations + 1) * aligned_bytes_per_alloc;
-  usize total_size = sizeof(struct pool_allocator) + data_size + alignment - 1;
-  struct pool_allocator* pa = malloc(total_size);
+  struct pool_allocator* pa;
+  usize reservation_size;
+  usize commit_granularity;
+  if (options->backing == libd_pool_backing_mmap) {
+    pa = _reserve(
+      total_size,
+      options->huge_pages,
+      &reservation_size,
+      &commit_granularity);
+  } else {
+    pa                 = malloc(total_size);
+    reservation_size   = total_size;
+    commit_granularity = total_size;
+  }
   if (pa == NULL) {
     return libd_no_memory;
   }
 
-  pa->max_allocations = max_allocations;
-  pa->bytes_per_alloc = aligned_bytes_per_alloc;
+  _init_header(
+    pa,
+    max_allocations,
+    aligned_bytes_per_alloc,
+    options->backing,
+    options,
+    reservation_size,
+    commit_granularity);
+
+  if (options->growable) {
+    pa->chunks = calloc(_MAX_CHUNKS, sizeof(u8*));
+    if (pa->chunks == NULL) {
+      libd_pool_allocator_destroy(pa);
+      return libd_no_memory;
+    }
+    pa->chunks[0] = pa->data;
+  }
 
-  if (_initialize_free_list(pa) != libd_ok) {
-    free(pa);
-    return libd_free_list_failure;
+  // calloc hands back untouched zero pages for large sizes, so the bitmap
+  // costs nothing until slots are actually freed into it.
+  if (options->free_order == libd_pool_free_address_ordered) {
+    u32 words       = _words_for_bits(max_allocations);
+    pa->free_bitmap = calloc(words + _words_for_bits(words), sizeof(u64));
+    if (pa->free_bitmap == NULL) {
+      libd_pool_allocator_destroy(pa);
+      return libd_no_memory;
+    }
   }
 
+  pa->next_unused_index = 0;
+  _initialize_free_list(pa);
+  LIBD_MEMORY_POISON(pa->data, _byte_index(pa, pa->first_chunk_allocations));
+
+  *out_pa = pa;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_pool_allocator_create_in_place(
+  struct pool_allocator** out_pa,
+  void* reservation,
+  usize reservation_size,
+  u32 bytes_per_alloc,
+  u8 alignment)
+{
+  static const struct libd_pool_allocator_options options = {
+    .free_order = libd_pool_free_lifo,
+  };
+
+  if (out_pa == NULL || reservation == NULL || bytes_per_alloc == 0) {
+    return libd_invalid_parameter;
+  }
+  if (!libd_memory_is_valid_alignment(alignment)) {
+    return libd_invalid_alignment;
+  }
+
+  s64 page_size = sysconf(_SC_PAGE_SIZE);
+  if (page_size == -1) {
+    return libd_err;
+  }
+  usize header_commit = libd_memory_align_up(_HEADER_SIZE, page_size);
+  if (reservation_size <= header_commit) {
+    return libd_no_memory;
+  }
+
+  u32 aligned_bytes_per_alloc = _slot_size(bytes_per_alloc, alignment);
+  usize max_allocations =
+    (reservation_size - _HEADER_SIZE) / aligned_bytes_per_alloc;
+  max_allocations = MIN(max_allocations, (usize)U32_MAX - 1);
+
+  if (mprotect(reservation, header_commit, PROT_READ | PROT_WRITE) != 0) {
+    return libd_no_memory;
+  }
+
+  struct pool_allocator* pa = reservation;
+  _init_header(
+    pa,
+    max_allocations,
+    aligned_bytes_per_alloc,
+    _BACKING_IN_PLACE,
+    &options,
+    reservation_size,
+    page_size);
+
+  pa->next_unused_index = 0;
+  _initialize_free_list(pa);
+  LIBD_MEMORY_POISON(pa->data, _byte_index(pa, pa->first_chunk_allocations));
+
   *out_pa = pa;
 
   return libd_ok;
@@ -100,6 +376,25 @@ libd_pool_allocator_destroy(struct pool_allocator* pa)
     return libd_invalid_parameter;
   }
 
+  free(pa->free_bitmap);
+  for (u8 k = 1; k < pa->n_chunks; k += 1) {
+    LIBD_MEMORY_UNPOISON(
+      pa->chunks[k], _byte_index(pa, pa->first_chunk_allocations << (k - 1)));
+    free(pa->chunks[k]);
+  }
+  free(pa->chunks);
+  LIBD_MEMORY_UNPOISON(pa->data, _byte_index(pa, pa->first_chunk_allocations));
+
+  if (pa->backing == libd_pool_backing_mmap) {
+    if (munmap(pa, pa->reservation_size) != 0) {
+      return libd_err;
+    }
+    return libd_ok;
+  }
+  if (pa->backing == _BACKING_IN_PLACE) {
+    return libd_ok;
+  }
+
   free(pa);
 
   return libd_ok;
@@ -114,22 +409,24 @@ libd_pool_allocator_alloc(
     return libd_invalid_parameter;
   }
 
-  if (pa->head_index == _terminal_index(pa)) {
-    return libd_no_memory;
-  }
+  enum libd_result result;
+  if (pa->free_order == libd_pool_free_address_ordered) {
+    result = _alloc_address_ordered(pa, out_pointer);
+  } else if (pa->head_index != _terminal_index(pa)) {
+    // setting the out pointer to the allocated region.
+    *out_pointer = _ptr_to_index(pa, pa->head_index);
+    LIBD_MEMORY_UNPOISON(*out_pointer, pa->bytes_per_alloc);
 
-  // setting the out pointer to the allocated region.
-  *out_pointer = _ptr_to_index(pa, pa->head_index);
+    // copying the next index into head.
+    memcpy(&pa->head_index, *out_pointer, sizeof(free_node));
 
-  // copying the next index into head.
-  memcpy(&pa->head_index, *out_pointer, sizeof(free_node));
-
-  // If the last slot was just allocated, move the tail as well.
-  if (pa->head_index == _terminal_index(pa)) {
-    pa->tail_index = _terminal_index(pa);
+    result = libd_ok;
+  } else {
+    result = _bump_unused(pa, out_pointer);
   }
+  LIBD_MEMORY_STAT(_stat_alloc(pa, result, 1));
 
-  return libd_ok;
+  return result;
 }
 
 enum libd_result
@@ -141,88 +438,585 @@ libd_pool_allocator_free(
     return libd_invalid_parameter;
   }
 
-  ptrdiff_t byte_offset = (u8*)p_to_free - pa->data;
-  if (byte_offset < 0 || byte_offset % pa->bytes_per_alloc != 0) {
-    return libd_invalid_pointer;  // below bounds or not block aligned
+  u32 free_index;
+  if (!_index_of_ptr(pa, p_to_free, &free_index)) {
+    return libd_invalid_pointer;  // out of bounds or not block aligned
+  }
+  if (free_index >= pa->next_unused_index) {
+    return libd_invalid_pointer;  // never allocated
   }
 
-  u32 free_index = byte_offset / pa->bytes_per_alloc;
-  if (free_index >= pa->max_allocations) {
-    return libd_invalid_pointer;  // above bounds
+  if (pa->free_order == libd_pool_free_address_ordered) {
+    enum libd_result result = _free_address_ordered(pa, free_index);
+    if (result != libd_ok) {
+      return result;
+    }
+    LIBD_MEMORY_DEBUG_ONLY(_debug_release_slot(pa, p_to_free));
+  } else {
+    _free_lifo(pa, free_index);
   }
+  LIBD_MEMORY_STAT(_stat_free(pa, 1));
 
-  if (free_index < pa->head_index) {
-    // linking the new head to the previous head index.
-    memcpy(_ptr_to_index(pa, free_index), &pa->head_index, sizeof(free_node));
+  return libd_ok;
+}
 
-    // updating the head to point at the new index.
-    pa->head_index = free_index;
-  } else {
-    // update the old tail with the index of the newly freed slot.
-    memcpy(_ptr_to_index(pa, pa->tail_index), &free_index, sizeof(free_node));
-    // update the tail index
-    pa->tail_index = free_index;
+// Pops the free list with the head kept in a local, then carves whatever is
+// still needed off the never-used slots. On failure head_index and
+// next_unused_index are restored, which undoes every pop and bump; chunks or
+// pages committed along the way stay.
+enum libd_result
+libd_pool_allocator_alloc_n(
+  struct pool_allocator* pa,
+  void** out_pointers,
+  u32 n)
+{
+  if (pa == NULL || out_pointers == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  if (pa->free_order == libd_pool_free_address_ordered) {
+    for (u32 i = 0; i < n; i += 1) {
+      enum libd_result result = _alloc_address_ordered(pa, &out_pointers[i]);
+      if (result != libd_ok) {
+        // counted as allocated so that the rollback's frees balance out.
+        LIBD_MEMORY_STAT(_stat_alloc(pa, libd_ok, i));
+        libd_pool_allocator_free_n(pa, out_pointers, i);
+        LIBD_MEMORY_STAT(_stat_alloc(pa, result, 0));
+        return result;
+      }
+    }
+    LIBD_MEMORY_STAT(_stat_alloc(pa, libd_ok, n));
+    return libd_ok;
+  }
+
+  u32 saved_head        = pa->head_index;
+  u32 saved_next_unused = pa->next_unused_index;
 
-    // point the new tail to the terminal index
-    u32 temp = _terminal_index(pa);
-    memcpy(_ptr_to_index(pa, pa->tail_index), &temp, sizeof(free_node));
+  u32 i    = 0;
+  u32 head = pa->head_index;
+  for (; i < n && head != _terminal_index(pa); i += 1) {
+    out_pointers[i] = _ptr_to_index(pa, head);
+    LIBD_MEMORY_UNPOISON(out_pointers[i], pa->bytes_per_alloc);
+    memcpy(&head, out_pointers[i], sizeof(free_node));
   }
+  pa->head_index = head;
 
-  // if we just free'd out of a full allocator, move the tail as well.
-  if (pa->tail_index == _terminal_index(pa)) {
-    pa->tail_index = pa->head_index;
+  for (; i < n; i += 1) {
+    enum libd_result result = _bump_unused(pa, &out_pointers[i]);
+    if (result != libd_ok) {
+      // the popped slots' links were only read, so the list is intact.
+      for (u32 j = 0; j < i; j += 1) {
+        LIBD_MEMORY_POISON(out_pointers[j], pa->bytes_per_alloc);
+      }
+      pa->head_index        = saved_head;
+      LIBD_ATOMIC_STORE(
+        &pa->next_unused_index, saved_next_unused, LIBD_ATOMIC_RELAXED);
+      LIBD_MEMORY_STAT(_stat_alloc(pa, result, 0));
+      return result;
+    }
   }
+  LIBD_MEMORY_STAT(_stat_alloc(pa, libd_ok, n));
 
   return libd_ok;
 }
 
+// Links the freed slots to each other as it goes and publishes the new head
+// once, after the last valid pointer.
+enum libd_result
+libd_pool_allocator_free_n(
+  struct pool_allocator* pa,
+  void** ptrs,
+  u32 n)
+{
+  if (pa == NULL || ptrs == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  if (pa->free_order == libd_pool_free_address_ordered) {
+    for (u32 i = 0; i < n; i += 1) {
+      enum libd_result result = libd_pool_allocator_free(pa, ptrs[i]);
+      if (result != libd_ok) {
+        return result;
+      }
+    }
+    return libd_ok;
+  }
+
+  enum libd_result result = libd_ok;
+  u32 head                = pa->head_index;
+  u32 i                   = 0;
+  for (; i < n; i += 1) {
+    u32 free_index;
+    if (
+      ptrs[i] == NULL || !_index_of_ptr(pa, ptrs[i], &free_index) ||
+      free_index >= pa->next_unused_index) {
+      result = ptrs[i] == NULL ? libd_invalid_parameter : libd_invalid_pointer;
+      break;
+    }
+    LIBD_MEMORY_DEBUG_ONLY(
+      libd_memory_debug_fill(
+        ptrs[i], pa->bytes_per_alloc, LIBD_MEMORY_FREED_BYTE));
+    memcpy(ptrs[i], &head, sizeof(free_node));
+    LIBD_MEMORY_POISON(ptrs[i], pa->bytes_per_alloc);
+    head = free_index;
+  }
+  pa->head_index = head;
+  LIBD_MEMORY_STAT(_stat_free(pa, i));
+
+  return result;
+}
+
+enum libd_result
+libd_pool_allocator_owns(
+  const struct pool_allocator* pa,
+  const void* ptr,
+  bool* out_owns)
+{
+  if (pa == NULL || out_owns == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  u32 index;
+  *out_owns =
+    _index_of_ptr(pa, ptr, &index) &&
+    index < LIBD_ATOMIC_LOAD(&pa->next_unused_index, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+u32
+libd_pool_allocator_slot_size(const struct pool_allocator* pa)
+{
+  return pa->bytes_per_alloc;
+}
+
 enum libd_result
 libd_pool_allocator_reset(struct pool_allocator* pa)
 {
+  LIBD_MEMORY_STAT(pa->stats.live_slots = 0);
+#ifdef LIBD_MEMORY_DEBUG
+  // every slot that was ever handed out, so O(n) in debug builds.
+  for (u32 i = 0; i < pa->next_unused_index; i += 1) {
+    _debug_release_slot(pa, _ptr_to_index(pa, i));
+  }
+#endif
+
   return _initialize_free_list(pa);
 }
 
+enum libd_result
+libd_pool_allocator_get_stats(
+  const struct pool_allocator* pa,
+  struct libd_pool_allocator_stats* out_stats)
+{
+  if (pa == NULL || out_stats == NULL) {
+    return libd_invalid_parameter;
+  }
+
+#ifdef LIBD_MEMORY_STATS
+  *out_stats = pa->stats;
+  out_stats->committed_bytes =
+    (usize)pa->committed_allocations * pa->bytes_per_alloc;
+
+  return libd_ok;
+#else
+  return libd_mem_not_implemented;
+#endif
+}
+
+// O(1) in LIFO mode. In address-ordered mode only the bitmap words covering
+// slots that have been handed out need clearing.
 enum libd_result
 _initialize_free_list(struct pool_allocator* pa)
 {
-  pa->head_index = 0;
-  pa->tail_index = _terminal_index(pa) - 1;
-  u32 next_index;
-  for (u32 i = 0; i < pa->tail_index; i += 1) {
-    next_index = i + 1;
-    memcpy(_ptr_to_index(pa, i), &next_index, sizeof(free_node));
+  if (pa->free_order == libd_pool_free_address_ordered) {
+    u32 used_words = _words_for_bits(pa->next_unused_index);
+    memset(pa->free_bitmap, 0, used_words * sizeof(u64));
+    memset(
+      _summary_bitmap(pa), 0, _words_for_bits(used_words) * sizeof(u64));
+    pa->head_index = 0;
+  } else {
+    pa->head_index = _terminal_index(pa);
   }
 
-  next_index = _terminal_index(pa);
-  memcpy(_ptr_to_index(pa, pa->tail_index), &next_index, sizeof(free_node));
+  LIBD_ATOMIC_STORE(&pa->next_unused_index, 0, LIBD_ATOMIC_RELAXED);
 
   return libd_ok;
 }
 
-static inline u32
-_byte_index(
+// Pushes the slot onto the front of the list: one write to the freed slot,
+// which is likely still in cache, and it is the next one handed out.
+static inline void
+_free_lifo(
   struct pool_allocator* pa,
-  u32 i)
+  u32 free_index)
+{
+  u8* slot = _ptr_to_index(pa, free_index);
+  LIBD_MEMORY_DEBUG_ONLY(
+    libd_memory_debug_fill(slot, pa->bytes_per_alloc, LIBD_MEMORY_FREED_BYTE));
+  memcpy(slot, &pa->head_index, sizeof(free_node));
+  LIBD_MEMORY_POISON(slot, pa->bytes_per_alloc);
+  pa->head_index = free_index;
+}
+
+#ifdef LIBD_MEMORY_DEBUG
+// Fills a slot that holds no free list link with the freed pattern and
+// poisons it.
+static void
+_debug_release_slot(
+  struct pool_allocator* pa,
+  u8* slot)
+{
+  libd_memory_debug_fill(slot, pa->bytes_per_alloc, LIBD_MEMORY_FREED_BYTE);
+  LIBD_MEMORY_POISON(slot, pa->bytes_per_alloc);
+}
+#endif
+
+// Hands out the lowest free slot so live slots pack towards the start of the
+// pool. The summary bitmap has one bit per non-empty free_bitmap word, so the
+// scan skips 4096 allocated slots per summary word it passes over. Only the
+// words below the high-water mark can hold set bits; past them every slot is
+// free and the lowest is next_unused_index.
+static enum libd_result
+_alloc_address_ordered(
+  struct pool_allocator* pa,
+  void** out_pointer)
+{
+  u64* summary      = _summary_bitmap(pa);
+  u32 summary_words = _words_for_bits(_words_for_bits(pa->next_unused_index));
+  for (u32 s = pa->head_index; s < summary_words; s += 1) {
+    if (summary[s] == 0) {
+      continue;
+    }
+
+    u32 w =
+      s * _BITMAP_WORD_BITS + libd_memory_count_trailing_zeros(summary[s]);
+    u64 bits = pa->free_bitmap[w];
+    u32 index =
+      w * _BITMAP_WORD_BITS + libd_memory_count_trailing_zeros(bits);
+
+    pa->free_bitmap[w] = bits & (bits - 1);
+    if (pa->free_bitmap[w] == 0) {
+      summary[s] &= ~((u64)1 << (w % _BITMAP_WORD_BITS));
+    }
+    pa->head_index = s;
+    *out_pointer   = _ptr_to_index(pa, index);
+    LIBD_MEMORY_UNPOISON(*out_pointer, pa->bytes_per_alloc);
+
+    return libd_ok;
+  }
+
+  pa->head_index = summary_words;
+
+  return _bump_unused(pa, out_pointer);
+}
+
+static enum libd_result
+_free_address_ordered(
+  struct pool_allocator* pa,
+  u32 free_index)
+{
+  u32 w   = free_index / _BITMAP_WORD_BITS;
+  u64 bit = (u64)1 << (free_index % _BITMAP_WORD_BITS);
+  if (CHECK_AGAINST_MASK(pa->free_bitmap[w], bit)) {
+    return libd_invalid_free;  // already free
+  }
+
+  u32 s = w / _BITMAP_WORD_BITS;
+  pa->free_bitmap[w] |= bit;
+  _summary_bitmap(pa)[s] |= (u64)1 << (w % _BITMAP_WORD_BITS);
+  if (s < pa->head_index) {
+    pa->head_index = s;
+  }
+
+  return libd_ok;
+}
+
+// Rounds the slot up to the alignment and to at least one free list node.
+static u32
+_slot_size(
+  u32 bytes_per_alloc,
+  u8 alignment)
+{
+  u32 aligned_bytes_per_alloc =
+    libd_memory_align_up(bytes_per_alloc, alignment);
+
+  // Ensure there is enough space for the free list nodes.
+  if (aligned_bytes_per_alloc < _aligned_sizeof_free_node()) {
+    aligned_bytes_per_alloc = _aligned_sizeof_free_node();
+  }
+
+  return aligned_bytes_per_alloc;
+}
+
+// Fills in everything but the free list. A heap backed pool is committed in
+// full; the others have only the header pages committed so far.
+static void
+_init_header(
+  struct pool_allocator* pa,
+  u32 max_allocations,
+  u32 bytes_per_alloc,
+  u8 backing,
+  const struct libd_pool_allocator_options* options,
+  usize reservation_size,
+  usize commit_granularity)
+{
+  pa->max_allocations         = max_allocations;
+  pa->first_chunk_allocations = max_allocations;
+  pa->bytes_per_alloc         = bytes_per_alloc;
+  pa->free_order              = options->free_order;
+  pa->backing                 = backing;
+  pa->growable                = options->growable;
+  pa->n_chunks                = 1;
+  pa->chunks                  = NULL;
+  pa->free_bitmap             = NULL;
+  pa->reservation_size        = reservation_size;
+  pa->commit_granularity      = commit_granularity;
+  pa->committed_allocations   = max_allocations;
+  LIBD_MEMORY_STAT(pa->stats = (struct libd_pool_allocator_stats){ 0 });
+  if (backing != libd_pool_backing_heap) {
+    pa->committed_size = libd_memory_align_up(_HEADER_SIZE, commit_granularity);
+    pa->committed_allocations =
+      MIN((pa->committed_size - _HEADER_SIZE) / bytes_per_alloc,
+          (usize)max_allocations);
+  }
+}
+
+// Hands out the lowest never-used slot, committing more of the reservation
+// first if the high-water mark has reached the end of the committed range.
+static enum libd_result
+_bump_unused(
+  struct pool_allocator* pa,
+  void** out_pointer)
+{
+  if (pa->next_unused_index == pa->committed_allocations) {
+    enum libd_result result =
+      pa->growable ? _add_chunk(pa) : _commit_more(pa);
+    if (result != libd_ok) {
+      return result;
+    }
+  }
+
+  *out_pointer = _ptr_to_index(pa, pa->next_unused_index);
+  LIBD_MEMORY_UNPOISON(*out_pointer, pa->bytes_per_alloc);
+  LIBD_ATOMIC_STORE(
+    &pa->next_unused_index, pa->next_unused_index + 1, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+// Doubles the committed range, rounded to the commit granularity, to amortize
+// the mprotect calls.
+static enum libd_result
+_commit_more(struct pool_allocator* pa)
+{
+  if (pa->committed_allocations == pa->max_allocations) {
+    return libd_no_memory;
+  }
+
+  usize needed = _HEADER_SIZE + _byte_index(pa, pa->committed_allocations + 1);
+  usize new_committed_size = libd_memory_align_up(
+    MAX(needed, pa->committed_size * 2), pa->commit_granularity);
+  new_committed_size = MIN(new_committed_size, pa->reservation_size);
+
+  if (mprotect(pa, new_committed_size, PROT_READ | PROT_WRITE) != 0) {
+    return libd_no_memory;
+  }
+
+  pa->committed_size = new_committed_size;
+  pa->committed_allocations =
+    MIN((new_committed_size - _HEADER_SIZE) / pa->bytes_per_alloc,
+        (usize)pa->max_allocations);
+
+  return libd_ok;
+}
+
+// Chains a chunk holding as many slots as the pool so far. The free list is
+// empty whenever this runs, so growing max_allocations leaves no stale links.
+static enum libd_result
+_add_chunk(struct pool_allocator* pa)
+{
+  u64 first             = pa->first_chunk_allocations;
+  u64 chunk_allocations = first << (pa->n_chunks - 1);
+  if (
+    pa->n_chunks == _MAX_CHUNKS ||
+    pa->max_allocations + chunk_allocations >= U32_MAX) {
+    return libd_no_memory;
+  }
+
+  u8* chunk = malloc(chunk_allocations * pa->bytes_per_alloc);
+  if (chunk == NULL) {
+    return libd_no_memory;
+  }
+  LIBD_MEMORY_POISON(chunk, chunk_allocations * pa->bytes_per_alloc);
+
+  pa->chunks[pa->n_chunks] = chunk;
+  pa->n_chunks += 1;
+  pa->max_allocations += chunk_allocations;
+  pa->committed_allocations = pa->max_allocations;
+
+  return libd_ok;
+}
+
+// Reserves address space for the pool and commits the pages holding the
+// header. Huge page reservations start on a huge page boundary and are
+// committed in huge page steps so the kernel can back them with huge pages.
+static struct pool_allocator*
+_reserve(
+  usize size,
+  enum libd_pool_allocator_huge_pages huge_pages,
+  usize* out_reservation_size,
+  usize* out_commit_granularity)
+{
+  const int prot  = PROT_NONE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+  s64 page_size = sysconf(_SC_PAGE_SIZE);
+  if (page_size == -1) {
+    return NULL;
+  }
+
+  u8* base                 = MAP_FAILED;
+  usize reservation_size   = libd_memory_align_up(size, page_size);
+  usize commit_granularity = page_size;
+
+#ifdef MAP_HUGETLB
+  // without MAP_NORESERVE the mapping fails up front when the system has too
+  // few huge pages reserved, instead of raising SIGBUS on first touch.
+  if (huge_pages == libd_pool_huge_pages_explicit) {
+    const int hugetlb_flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+    usize huge_page_size    = _huge_page_size(huge_pages);
+    reservation_size        = libd_memory_align_up(size, huge_page_size);
+    commit_granularity      = huge_page_size;
+    base = mmap(NULL, reservation_size, prot, hugetlb_flags, -1, 0);
+  }
+#endif
+
+  // no explicit huge pages available, fall back to transparent ones.
+  if (base == MAP_FAILED && huge_pages != libd_pool_huge_pages_none) {
+    usize huge_page_size =
+      _huge_page_size(libd_pool_huge_pages_transparent);
+    reservation_size   = libd_memory_align_up(size, huge_page_size);
+    commit_granularity = huge_page_size;
+
+    // over-reserve by one huge page and trim both ends to align the start.
+    usize raw_size = reservation_size + huge_page_size;
+    u8* raw        = mmap(NULL, raw_size, prot, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+      return NULL;
+    }
+    base            = (u8*)libd_memory_align_up((uptr)raw, huge_page_size);
+    usize tail_size = (raw + raw_size) - (base + reservation_size);
+    if (base != raw) {
+      munmap(raw, base - raw);
+    }
+    if (tail_size != 0) {
+      munmap(base + reservation_size, tail_size);
+    }
+#ifdef MADV_HUGEPAGE
+    // advisory only; transparent huge pages may be disabled system wide.
+    madvise(base, reservation_size, MADV_HUGEPAGE);
+#endif
+  }
+
+  if (base == MAP_FAILED) {
+    base = mmap(NULL, reservation_size, prot, flags, -1, 0);
+    if (base == MAP_FAILED) {
+      return NULL;
+    }
+  }
+
+  usize header_commit = libd_memory_align_up(_HEADER_SIZE, commit_granularity);
+  if (mprotect(base, header_commit, PROT_READ | PROT_WRITE) != 0) {
+    munmap(base, reservation_size);
+    return NULL;
+  }
+
+  *out_reservation_size   = reservation_size;
+  *out_commit_granularity = commit_granularity;
+
+  return (struct pool_allocator*)base;
+}
+
+// Explicit huge pages come in the default hugetlbfs size, transparent ones in
+// the PMD size. Both are 2 MiB on x86-64, but e.g. 512 MiB on arm64 kernels
+// with 64 KiB pages. Each is read once; threads racing on the first read
+// store the same value, so the cache needs no lock.
+static usize
+_huge_page_size(enum libd_pool_allocator_huge_pages huge_pages)
 {
-  return i * pa->bytes_per_alloc;
+  bool explicit = huge_pages == libd_pool_huge_pages_explicit;
+  usize* cached = explicit ? &g_hugetlb_page_size : &g_thp_page_size;
+  usize size    = LIBD_ATOMIC_LOAD(cached, LIBD_ATOMIC_RELAXED);
+  if (size != 0) {
+    return size;
+  }
+
+  unsigned long value = 0;
+  FILE* f = fopen(explicit ? _HUGETLB_SIZE_PATH : _THP_SIZE_PATH, "r");
+  if (f != NULL) {
+    if (explicit) {
+      char line[128];
+      while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &value) == 1) {
+          value *= KiB;
+          break;
+        }
+      }
+    } else if (fscanf(f, "%lu", &value) != 1) {
+      value = 0;
+    }
+    fclose(f);
+  }
+
+  size = value;
+  if (size == 0 || !libd_memory_is_power_of_two(size)) {
+    size = _DEFAULT_HUGE_PAGE_SIZE;
+  }
+  LIBD_ATOMIC_STORE(cached, size, LIBD_ATOMIC_RELAXED);
+
+  return size;
 }
 
 static inline u32
-_head_byte_index(struct pool_allocator* pa)
+_words_for_bits(u32 n_bits)
 {
-  return pa->head_index * pa->bytes_per_alloc;
+  return (n_bits + _BITMAP_WORD_BITS - 1) / _BITMAP_WORD_BITS;
 }
 
 static inline u32
-_tail_byte_index(struct pool_allocator* pa)
+_bitmap_words(struct pool_allocator* pa)
 {
-  return pa->tail_index * pa->bytes_per_alloc;
+  return _words_for_bits(pa->max_allocations);
 }
 
+static inline u64*
+_summary_bitmap(struct pool_allocator* pa)
+{
+  return pa->free_bitmap + _bitmap_words(pa);
+}
+
+static inline usize
+_byte_index(
+  struct pool_allocator* pa,
+  u32 i)
+{
+  return (usize)i * pa->bytes_per_alloc;
+}
+
+static inline usize
+_head_byte_index(struct pool_allocator* pa)
+{
+  return (usize)pa->head_index * pa->bytes_per_alloc;
+}
+
+// U32_MAX rather than max_allocations so that it stays put when a growable
+// pool adds a chunk.
 static inline u32
 _terminal_index(struct pool_allocator* pa)
 {
-  return pa->max_allocations;
+  (void)pa;
+  return U32_MAX;
 }
 
 static inline u8*
@@ -230,5 +1024,84 @@ _ptr_to_index(
   struct pool_allocator* pa,
   u32 i)
 {
-  return &pa->data[_byte_index(pa, i)];
+  if (i < pa->first_chunk_allocations) {
+    return &pa->data[_byte_index(pa, i)];
+  }
+  return _chunk_ptr_to_index(pa, i);
+}
+
+static u8*
+_chunk_ptr_to_index(
+  struct pool_allocator* pa,
+  u32 i)
+{
+  u32 first = pa->first_chunk_allocations;
+  u32 k     = 64 - libd_memory_count_leading_zeros(i / first);
+  u32 start = first << (k - 1);
+
+  return &pa->chunks[k][_byte_index(pa, i - start)];
+}
+
+// Constant time in practice: the first chunk is checked directly, then the
+// chained ones from largest (holding half the slots) to smallest.
+static bool
+_index_of_ptr(
+  const struct pool_allocator* pa,
+  const void* ptr,
+  u32* out_index)
+{
+  u32 first   = pa->first_chunk_allocations;
+  u32 start   = 0;
+  u8* chunk   = (u8*)pa->data;
+  u32 chunk_n = first;
+
+  for (u8 k = pa->n_chunks; k > 0; k -= 1) {
+    ptrdiff_t byte_offset = (const u8*)ptr - chunk;
+    if (
+      byte_offset >= 0 &&
+      (usize)byte_offset < (usize)chunk_n * pa->bytes_per_alloc) {
+      if (byte_offset % pa->bytes_per_alloc != 0) {
+        return false;
+      }
+      *out_index = start + byte_offset / pa->bytes_per_alloc;
+      return true;
+    }
+
+    if (k > 1) {
+      start   = first << (k - 2);
+      chunk   = pa->chunks[k - 1];
+      chunk_n = start;
+    }
+  }
+
+  return false;
+}
+
+#ifdef LIBD_MEMORY_STATS
+// n slots were handed out on success; a failure counts once however many
+// slots the call asked for.
+static inline void
+_stat_alloc(
+  struct pool_allocator* pa,
+  enum libd_result result,
+  u32 n)
+{
+  if (result != libd_ok) {
+    pa->stats.failed_alloc_count += result == libd_no_memory;
+    return;
+  }
+  pa->stats.alloc_count     += n;
+  pa->stats.live_slots      += n;
+  pa->stats.peak_live_slots  = MAX(pa->stats.peak_live_slots,
+                                  pa->stats.live_slots);
+}
+
+static inline void
+_stat_free(
+  struct pool_allocator* pa,
+  u32 n)
+{
+  pa->stats.free_count += n;
+  pa->stats.live_slots -= n;
 }
+#endif
@@ -0,0 +1,243 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/platform/threads.h"
+#include "../../include/libd/utils/align_compat.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Per-thread arenas. Thread-local storage only holds a pointer to them, set on
+// the first begin from each thread. Every set is also linked into the scratch,
+// so destroy releases the arenas of threads that are still running, and the
+// cleanup of an exiting thread unlinks its own.
+struct scratch_arenas {
+  libd_linear_allocator_h* arenas[LIBD_SCRATCH_ARENAS_PER_THREAD];
+  struct scratch* owner;
+  struct scratch_arenas* prev;
+  struct scratch_arenas* next;
+};
+
+struct scratch {
+  libd_platform_thread_local_storage_handle_h* arenas;
+  usize reservation_size;
+  pthread_mutex_t lock;
+  struct scratch_arenas* live;
+};
+
+static void
+_arenas_cleanup(
+  void* data,
+  size_t size);
+
+static void
+_destroy_arenas(struct scratch_arenas* arenas);
+
+static enum libd_result
+_get_arenas(
+  struct scratch* s,
+  struct scratch_arenas** out_arenas);
+
+static bool
+_conflicts(
+  libd_linear_allocator_h* arena,
+  libd_linear_allocator_h* const* conflicts,
+  u32 n_conflicts);
+
+enum libd_result
+libd_scratch_create(
+  struct scratch** out_s,
+  usize reservation_size)
+{
+  if (out_s == NULL || reservation_size == 0) {
+    return libd_invalid_parameter;
+  }
+
+  struct scratch* s = malloc(sizeof(*s));
+  if (s == NULL) {
+    return libd_no_memory;
+  }
+
+  if (pthread_mutex_init(&s->lock, NULL) != 0) {
+    free(s);
+    return libd_no_memory;
+  }
+
+  enum libd_result r = libd_platform_thread_local_storage_create(
+    &s->arenas, _arenas_cleanup, sizeof(struct scratch_arenas*));
+  if (r != libd_ok) {
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    return r;
+  }
+
+  s->reservation_size = reservation_size;
+  s->live             = NULL;
+
+  *out_s = s;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_scratch_destroy(struct scratch* s)
+{
+  if (s == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  // Once the handle is gone no cleanup is running or will run, so whatever is
+  // still linked belongs to threads that are alive and is released here.
+  libd_platform_thread_local_storage_destroy(s->arenas);
+
+  struct scratch_arenas* arenas = s->live;
+  while (arenas != NULL) {
+    struct scratch_arenas* next = arenas->next;
+    _destroy_arenas(arenas);
+    arenas = next;
+  }
+
+  pthread_mutex_destroy(&s->lock);
+  free(s);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_scratch_begin(
+  struct scratch* s,
+  libd_linear_allocator_h* const* conflicts,
+  u32 n_conflicts,
+  struct libd_scratch_scope* out_scope)
+{
+  if (
+    s == NULL || out_scope == NULL || (conflicts == NULL && n_conflicts > 0)) {
+    return libd_invalid_parameter;
+  }
+
+  struct scratch_arenas* arenas;
+  enum libd_result r = _get_arenas(s, &arenas);
+  if (r != libd_ok) {
+    return r;
+  }
+
+  for (u32 i = 0; i < LIBD_SCRATCH_ARENAS_PER_THREAD; i += 1) {
+    if (arenas->arenas[i] == NULL) {
+      struct libd_linear_allocator_options options = { .chained = true };
+      r = libd_linear_allocator_create_with_options(
+        &arenas->arenas[i], s->reservation_size, 1, LIBD_MAX_ALIGN, &options);
+      if (r != libd_ok) {
+        arenas->arenas[i] = NULL;
+        return r;
+      }
+    }
+
+    if (_conflicts(arenas->arenas[i], conflicts, n_conflicts)) {
+      continue;
+    }
+
+    out_scope->arena = arenas->arenas[i];
+    return libd_linear_allocator_set_savepoint(
+      out_scope->arena, &out_scope->savepoint);
+  }
+
+  return libd_invalid_parameter;
+}
+
+enum libd_result
+libd_scratch_end(const struct libd_scratch_scope* scope)
+{
+  if (scope == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  return libd_linear_allocator_restore_savepoint(
+    scope->arena, &scope->savepoint);
+}
+
+static void
+_arenas_cleanup(
+  void* data,
+  size_t size)
+{
+  (void)size;
+  struct scratch_arenas* arenas = *(struct scratch_arenas**)data;
+  if (arenas == NULL) {
+    return;
+  }
+
+  struct scratch* s = arenas->owner;
+  pthread_mutex_lock(&s->lock);
+  if (arenas->prev != NULL) {
+    arenas->prev->next = arenas->next;
+  } else {
+    s->live = arenas->next;
+  }
+  if (arenas->next != NULL) {
+    arenas->next->prev = arenas->prev;
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  _destroy_arenas(arenas);
+}
+
+static void
+_destroy_arenas(struct scratch_arenas* arenas)
+{
+  for (u32 i = 0; i < LIBD_SCRATCH_ARENAS_PER_THREAD; i += 1) {
+    if (arenas->arenas[i] != NULL) {
+      libd_linear_allocator_destroy(arenas->arenas[i]);
+    }
+  }
+  free(arenas);
+}
+
+static enum libd_result
+_get_arenas(
+  struct scratch* s,
+  struct scratch_arenas** out_arenas)
+{
+  struct scratch_arenas** p_arenas;
+  enum libd_result r =
+    libd_platform_thread_local_storage_get(s->arenas, (void**)&p_arenas);
+  if (r != libd_ok) {
+    return r;
+  }
+
+  if (*p_arenas == NULL) {
+    struct scratch_arenas* arenas = calloc(1, sizeof(*arenas));
+    if (arenas == NULL) {
+      return libd_no_memory;
+    }
+    arenas->owner = s;
+
+    pthread_mutex_lock(&s->lock);
+    arenas->next = s->live;
+    if (s->live != NULL) {
+      s->live->prev = arenas;
+    }
+    s->live = arenas;
+    pthread_mutex_unlock(&s->lock);
+
+    *p_arenas = arenas;
+  }
+
+  *out_arenas = *p_arenas;
+
+  return libd_ok;
+}
+
+static bool
+_conflicts(
+  libd_linear_allocator_h* arena,
+  libd_linear_allocator_h* const* conflicts,
+  u32 n_conflicts)
+{
+  for (u32 i = 0; i < n_conflicts; i += 1) {
+    if (conflicts[i] == arena) {
+      return true;
+    }
+  }
+
+  return false;
+}
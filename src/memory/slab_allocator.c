@@ -0,0 +1,187 @@
+#include "../../include/libd/memory.h"
+#include "./internal/helpers.h"
+#include "./internal/pool_allocator.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define _SMALL_CLASS_STEP  16
+#define _SMALL_CLASS_LIMIT 128
+#define _SMALL_CLASSES     (_SMALL_CLASS_LIMIT / _SMALL_CLASS_STEP)
+#define _CLASS_ALIGNMENT   16
+
+static const u16 _class_sizes[] = {
+  16,   32,   48,   64,   80,   96,   112,  128,  160,  192,
+  224,  256,  320,  384,  448,  512,  640,  768,  896,  1024,
+  1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096,
+};
+
+#define _N_CLASSES ARR_LEN(_class_sizes)
+
+// Class k owns [base + (k << region_shift), base + ((k + 1) << region_shift)),
+// with its pool header at the start of the range.
+struct slab_allocator {
+  u8* base;
+  u32 region_shift;
+  libd_pool_allocator_h* classes[_N_CLASSES];
+};
+
+static inline u32
+_size_class(usize size);
+
+static inline usize
+_reservation_size(struct slab_allocator* sa);
+
+enum libd_result
+libd_slab_allocator_create(
+  struct slab_allocator** out,
+  usize bytes_per_class)
+{
+  if (out == NULL || bytes_per_class == 0) {
+    return libd_invalid_parameter;
+  }
+
+  s64 page_size = sysconf(_SC_PAGE_SIZE);
+  if (page_size == -1) {
+    return libd_err;
+  }
+
+  u32 region_shift = 0;
+  while (((usize)1 << region_shift) < MAX(bytes_per_class, (usize)page_size)) {
+    region_shift += 1;
+  }
+  if (region_shift >= sizeof(usize) * 8 - 5) {
+    return libd_no_memory;
+  }
+
+  struct slab_allocator* sa = malloc(sizeof(*sa));
+  if (sa == NULL) {
+    return libd_no_memory;
+  }
+  sa->region_shift = region_shift;
+
+  sa->base = mmap(
+    NULL,
+    _reservation_size(sa),
+    PROT_NONE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+    -1,
+    0);
+  if (sa->base == MAP_FAILED) {
+    free(sa);
+    return libd_no_memory;
+  }
+
+  for (u32 k = 0; k < _N_CLASSES; k += 1) {
+    enum libd_result result = libd_pool_allocator_create_in_place(
+      &sa->classes[k],
+      sa->base + ((usize)k << region_shift),
+      (usize)1 << region_shift,
+      _class_sizes[k],
+      _CLASS_ALIGNMENT);
+    if (result != libd_ok) {
+      LIBD_MEMORY_UNPOISON(sa->base, _reservation_size(sa));
+      munmap(sa->base, _reservation_size(sa));
+      free(sa);
+      return result;
+    }
+  }
+
+  *out = sa;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_slab_allocator_destroy(struct slab_allocator* sa)
+{
+  if (sa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  // the class pools live inside the reservation, and may have poisoned it.
+  LIBD_MEMORY_UNPOISON(sa->base, _reservation_size(sa));
+  if (munmap(sa->base, _reservation_size(sa)) != 0) {
+    return libd_err;
+  }
+  free(sa);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_slab_allocator_alloc(
+  struct slab_allocator* sa,
+  void** out_pointer,
+  usize size)
+{
+  if (sa == NULL || out_pointer == NULL || size == 0) {
+    return libd_invalid_parameter;
+  }
+
+  if (size > LIBD_SLAB_MAX_SIZE) {
+    *out_pointer = malloc(size);
+    return *out_pointer == NULL ? libd_no_memory : libd_ok;
+  }
+
+  return libd_pool_allocator_alloc(sa->classes[_size_class(size)], out_pointer);
+}
+
+enum libd_result
+libd_slab_allocator_free(
+  struct slab_allocator* sa,
+  void* p_to_free)
+{
+  if (sa == NULL || p_to_free == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  // pointers below base wrap around to a large offset.
+  uptr offset = (uptr)p_to_free - (uptr)sa->base;
+  if (offset >= _reservation_size(sa)) {
+    free(p_to_free);
+    return libd_ok;
+  }
+
+  return libd_pool_allocator_free(
+    sa->classes[offset >> sa->region_shift], p_to_free);
+}
+
+enum libd_result
+libd_slab_allocator_reset(struct slab_allocator* sa)
+{
+  if (sa == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  for (u32 k = 0; k < _N_CLASSES; k += 1) {
+    libd_pool_allocator_reset(sa->classes[k]);
+  }
+
+  return libd_ok;
+}
+
+// Multiples of 16 up to 128. Past that, the bits below the leading one pick
+// one of four classes per power of two, e.g. 129..256 map to 160, 192, 224
+// and 256.
+static inline u32
+_size_class(usize size)
+{
+  if (size <= _SMALL_CLASS_LIMIT) {
+    return (size - 1) / _SMALL_CLASS_STEP;
+  }
+
+  u32 shift = 63 - libd_memory_count_leading_zeros(size - 1);
+  u32 group = shift - 7;  // log2(_SMALL_CLASS_LIMIT)
+  u32 step  = ((size - 1) >> (shift - 2)) & 3;
+
+  return _SMALL_CLASSES + group * 4 + step;
+}
+
+static inline usize
+_reservation_size(struct slab_allocator* sa)
+{
+  return _N_CLASSES << sa->region_shift;
+}
@@ -0,0 +1,108 @@
+#include "../../../include/libd/platform/sync.h"
+#include "../../../include/libd/utils/atomic_compat.h"
+
+#if defined(__linux__)
+  #include <limits.h>
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#else
+  #include <pthread.h>
+#endif
+
+#if defined(__linux__)
+
+void
+libd_platform_futex_wait(
+  u32* addr,
+  u32 expected)
+{
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+void
+libd_platform_futex_wake(
+  u32* addr,
+  u32 n)
+{
+  syscall(
+    SYS_futex,
+    addr,
+    FUTEX_WAKE_PRIVATE,
+    n > INT_MAX ? INT_MAX : (int)n,
+    NULL,
+    NULL,
+    0);
+}
+
+#else
+
+// Without a futex, waiters sleep on a condition variable picked by hashing
+// the address. The value is checked under the bucket lock and wakers take
+// the same lock, so a wake between the check and the sleep is not lost.
+  #define _N_BUCKETS 64
+
+struct bucket {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static struct bucket g_buckets[_N_BUCKETS];
+static pthread_once_t g_buckets_once = PTHREAD_ONCE_INIT;
+
+static void
+_init_buckets(void);
+
+static struct bucket*
+_bucket_of(u32* addr);
+
+void
+libd_platform_futex_wait(
+  u32* addr,
+  u32 expected)
+{
+  struct bucket* b = _bucket_of(addr);
+
+  pthread_mutex_lock(&b->lock);
+  if (LIBD_ATOMIC_LOAD(addr, LIBD_ATOMIC_SEQ_CST) == expected) {
+    pthread_cond_wait(&b->cond, &b->lock);
+  }
+  pthread_mutex_unlock(&b->lock);
+}
+
+void
+libd_platform_futex_wake(
+  u32* addr,
+  u32 n)
+{
+  (void)n;
+
+  // threads hashed to the same bucket wake up too, and re-check.
+  struct bucket* b = _bucket_of(addr);
+
+  pthread_mutex_lock(&b->lock);
+  pthread_cond_broadcast(&b->cond);
+  pthread_mutex_unlock(&b->lock);
+}
+
+static void
+_init_buckets(void)
+{
+  for (u32 i = 0; i < _N_BUCKETS; i += 1) {
+    pthread_mutex_init(&g_buckets[i].lock, NULL);
+    pthread_cond_init(&g_buckets[i].cond, NULL);
+  }
+}
+
+static struct bucket*
+_bucket_of(u32* addr)
+{
+  pthread_once(&g_buckets_once, _init_buckets);
+
+  uptr h = (uptr)addr >> 2;
+  h ^= h >> 7;
+
+  return &g_buckets[h % _N_BUCKETS];
+}
+
+#endif
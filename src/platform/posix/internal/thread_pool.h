@@ -0,0 +1,20 @@
+/**
+ * @file
+ * @brief internal thread pool entry points shared with parallel_for
+ */
+
+#ifndef LIBD_PLATFORM_INTERNAL_THREAD_POOL_H
+#define LIBD_PLATFORM_INTERNAL_THREAD_POOL_H
+
+#include "../../../../include/libd/memory.h"
+#include "../../../../include/libd/platform/threads.h"
+
+/**
+ * @brief The scratch arenas the pool hands to parallel_for bodies.
+ * @param pool Handle for the pool.
+ * @return The pool's scratch handle.
+ */
+libd_scratch_h*
+libd_platform_thread_pool_scratch(libd_platform_thread_pool_h* pool);
+
+#endif  // LIBD_PLATFORM_INTERNAL_THREAD_POOL_H
@@ -0,0 +1,164 @@
+#include "../../../include/libd/memory.h"
+#include "../../../include/libd/platform/threads.h"
+#include "../../../include/libd/utils/atomic_compat.h"
+#include "./internal/thread_pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// chunks each worker gets when the caller leaves the grain to us.
+#define _CHUNKS_PER_WORKER 8
+
+// The range is cut into n_chunks chunks of grain indices, and tasks cover
+// spans of whole chunks. A task splitting [lo, hi) spawns [mid, hi) and keeps
+// [lo, mid), so every spawned span starts at a different chunk and spans[lo]
+// is free to describe it. spans lives in a scratch arena of the calling
+// thread for the duration of the call.
+struct parallel_for {
+  struct libd_platform_task_group group;
+  struct libd_platform_range range;
+  usize grain;
+  libd_platform_parallel_for_f fn;
+  void* ctx;
+  libd_scratch_h* scratch;
+  libd_linear_allocator_h* spans_arena;
+  struct span* spans;
+  u32 result;
+};
+
+struct span {
+  struct parallel_for* pf;
+  usize lo;
+  usize hi;
+};
+
+static void
+_split(
+  struct parallel_for* pf,
+  usize lo,
+  usize hi);
+
+static void
+_span_task(void* arg);
+
+static void
+_run_chunk(
+  struct parallel_for* pf,
+  usize chunk);
+
+enum libd_result
+libd_platform_parallel_for(
+  libd_platform_thread_pool_h* pool,
+  struct libd_platform_range range,
+  usize grain,
+  libd_platform_parallel_for_f fn,
+  void* ctx)
+{
+  if (pool == NULL || fn == NULL || range.end < range.begin) {
+    return libd_invalid_parameter;
+  }
+  if (range.end == range.begin) {
+    return libd_ok;
+  }
+
+  usize n = range.end - range.begin;
+  if (grain == 0) {
+    usize target = (usize)libd_platform_thread_pool_worker_count(pool) *
+                   _CHUNKS_PER_WORKER;
+    grain        = MAX(n / target, (usize)1);
+  }
+  usize n_chunks = n / grain + (n % grain != 0);
+
+  struct parallel_for pf = {
+    .range   = range,
+    .grain   = grain,
+    .fn      = fn,
+    .ctx     = ctx,
+    .scratch = libd_platform_thread_pool_scratch(pool),
+    .result  = libd_ok,
+  };
+
+  if (n_chunks == 1) {
+    _run_chunk(&pf, 0);
+    return pf.result;
+  }
+
+  if (n_chunks > SIZE_MAX / sizeof(struct span)) {
+    return libd_no_memory;
+  }
+
+  struct libd_scratch_scope scope;
+  enum libd_result r = libd_scratch_begin(pf.scratch, NULL, 0, &scope);
+  if (r != libd_ok) {
+    return r;
+  }
+  r = libd_linear_allocator_alloc(
+    scope.arena, (void**)&pf.spans, n_chunks * sizeof(struct span));
+  if (r != libd_ok) {
+    libd_scratch_end(&scope);
+    return r;
+  }
+  pf.spans_arena = scope.arena;
+
+  libd_platform_task_group_init(&pf.group, pool);
+  _split(&pf, 0, n_chunks);
+  libd_platform_task_group_wait(&pf.group);
+
+  libd_scratch_end(&scope);
+
+  return pf.result;
+}
+
+static void
+_split(
+  struct parallel_for* pf,
+  usize lo,
+  usize hi)
+{
+  while (hi - lo > 1) {
+    usize mid      = lo + (hi - lo) / 2;
+    pf->spans[mid] = (struct span){ .pf = pf, .lo = mid, .hi = hi };
+    libd_platform_task_group_spawn(&pf->group, _span_task, &pf->spans[mid]);
+    hi = mid;
+  }
+
+  _run_chunk(pf, lo);
+}
+
+static void
+_span_task(void* arg)
+{
+  struct span* span = arg;
+  _split(span->pf, span->lo, span->hi);
+}
+
+// The chunk's temporaries go in a different arena than the spans, which only
+// matters on the calling thread.
+static void
+_run_chunk(
+  struct parallel_for* pf,
+  usize chunk)
+{
+  // begin + grain can wrap for a huge grain, the distance to the end can't.
+  usize begin                    = pf->range.begin + chunk * pf->grain;
+  usize length                   = MIN(pf->grain, pf->range.end - begin);
+  struct libd_platform_range sub = {
+    .begin = begin,
+    .end   = begin + length,
+  };
+
+  u32 n_conflicts = pf->spans_arena != NULL;
+  struct libd_scratch_scope scope;
+  enum libd_result r =
+    libd_scratch_begin(pf->scratch, &pf->spans_arena, n_conflicts, &scope);
+  if (r != libd_ok) {
+    u32 expected = libd_ok;
+    LIBD_ATOMIC_CAS_STRONG(
+      &pf->result, &expected, r, LIBD_ATOMIC_RELAXED, LIBD_ATOMIC_RELAXED);
+    return;
+  }
+
+  pf->fn(sub, pf->ctx, scope.arena);
+
+  libd_scratch_end(&scope);
+}
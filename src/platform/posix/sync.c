@@ -0,0 +1,618 @@
+#include "../../../include/libd/platform/sync.h"
+#include "../../../include/libd/utils/atomic_compat.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// polls of a contended word, with a pause in between, before going to sleep.
+// Long enough to cover a short critical section on another cpu, short enough
+// that a lock held across a sleep costs little extra. With a single cpu the
+// holder cannot run while we spin, so we go straight to sleep.
+#define _SPIN_ROUNDS 100
+#define _SPIN_UNKNOWN U32_MAX
+
+static u32 g_spin_rounds = _SPIN_UNKNOWN;
+
+#define _MUTEX_UNLOCKED  0
+#define _MUTEX_LOCKED    1
+#define _MUTEX_CONTENDED 2
+
+// The low 30 bits of the rwlock state count the readers, or are all set
+// while a writer holds it. Readers that find a writer holding or waiting set
+// READERS_WAITING and sleep on state, writers set WRITERS_WAITING and sleep on
+// writer_notify.
+#define _RW_READ_LOCKED     1u
+#define _RW_MASK            ((1u << 30) - 1)
+#define _RW_WRITE_LOCKED    _RW_MASK
+#define _RW_MAX_READERS     (_RW_MASK - 1)
+#define _RW_READERS_WAITING (1u << 30)
+#define _RW_WRITERS_WAITING (1u << 31)
+#define _RW_WAITING         (_RW_READERS_WAITING | _RW_WRITERS_WAITING)
+
+#define _EVENT_UNSET   0
+#define _EVENT_WAITING 1
+#define _EVENT_SET     2
+
+#define _LATCH_ONE      2
+#define _LATCH_SLEEPING 1
+
+// the generation counts phases in steps of 2, the low bit is set while a
+// thread sleeps on it.
+#define _BARRIER_PHASE       2
+#define _BARRIER_SLEEPING    1
+#define _PHASE_OF(generation) ((generation) & ~(u32)_BARRIER_SLEEPING)
+
+static u32
+_spin_rounds(void);
+
+static void
+_mutex_lock_contended(struct libd_platform_mutex* mutex);
+
+static u32
+_mutex_spin(struct libd_platform_mutex* mutex);
+
+static bool
+_rw_can_read(u32 state);
+
+static void
+_rwlock_read_contended(struct libd_platform_rwlock* rwlock);
+
+static void
+_rwlock_write_contended(struct libd_platform_rwlock* rwlock);
+
+static u32
+_rwlock_spin(
+  struct libd_platform_rwlock* rwlock,
+  bool reader);
+
+static void
+_rwlock_wake(
+  struct libd_platform_rwlock* rwlock,
+  u32 state);
+
+//==============================================================================
+// Spinning
+//==============================================================================
+
+// Racing threads may both compute the value, they store the same one.
+static u32
+_spin_rounds(void)
+{
+  u32 rounds = LIBD_ATOMIC_LOAD(&g_spin_rounds, LIBD_ATOMIC_RELAXED);
+  if (rounds == _SPIN_UNKNOWN) {
+    rounds = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? _SPIN_ROUNDS : 0;
+    LIBD_ATOMIC_STORE(&g_spin_rounds, rounds, LIBD_ATOMIC_RELAXED);
+  }
+
+  return rounds;
+}
+
+//==============================================================================
+// Mutex
+//==============================================================================
+
+enum libd_result
+libd_platform_mutex_init(struct libd_platform_mutex* mutex)
+{
+  if (mutex == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  LIBD_ATOMIC_STORE(&mutex->state, _MUTEX_UNLOCKED, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+void
+libd_platform_mutex_lock(struct libd_platform_mutex* mutex)
+{
+  u32 expected = _MUTEX_UNLOCKED;
+  if (LIBD_ATOMIC_CAS_STRONG(
+        &mutex->state,
+        &expected,
+        _MUTEX_LOCKED,
+        LIBD_ATOMIC_ACQUIRE,
+        LIBD_ATOMIC_RELAXED)) {
+    return;
+  }
+
+  _mutex_lock_contended(mutex);
+}
+
+bool
+libd_platform_mutex_try_lock(struct libd_platform_mutex* mutex)
+{
+  u32 expected = _MUTEX_UNLOCKED;
+  return LIBD_ATOMIC_CAS_STRONG(
+    &mutex->state,
+    &expected,
+    _MUTEX_LOCKED,
+    LIBD_ATOMIC_ACQUIRE,
+    LIBD_ATOMIC_RELAXED);
+}
+
+void
+libd_platform_mutex_unlock(struct libd_platform_mutex* mutex)
+{
+  u32 prev =
+    LIBD_ATOMIC_EXCHANGE(&mutex->state, _MUTEX_UNLOCKED, LIBD_ATOMIC_RELEASE);
+  if (prev == _MUTEX_CONTENDED) {
+    libd_platform_futex_wake(&mutex->state, 1);
+  }
+}
+
+// Drepper's "Futexes Are Tricky" mutex: a thread that may sleep marks the
+// lock contended, so only unlocks that can have sleepers make a syscall. A
+// woken thread takes the lock as contended too, since it cannot know whether
+// others still sleep.
+static void
+_mutex_lock_contended(struct libd_platform_mutex* mutex)
+{
+  u32 state = _mutex_spin(mutex);
+
+  if (state == _MUTEX_UNLOCKED) {
+    if (LIBD_ATOMIC_CAS_STRONG(
+          &mutex->state,
+          &state,
+          _MUTEX_LOCKED,
+          LIBD_ATOMIC_ACQUIRE,
+          LIBD_ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+
+  for (;;) {
+    if (
+      state != _MUTEX_CONTENDED &&
+      LIBD_ATOMIC_EXCHANGE(
+        &mutex->state, _MUTEX_CONTENDED, LIBD_ATOMIC_ACQUIRE) ==
+        _MUTEX_UNLOCKED) {
+      return;
+    }
+
+    libd_platform_futex_wait(&mutex->state, _MUTEX_CONTENDED);
+    state = _mutex_spin(mutex);
+  }
+}
+
+// Spins while the holder has no sleepers queued behind it. Once there are,
+// spinning only delays this thread's place in the queue.
+static u32
+_mutex_spin(struct libd_platform_mutex* mutex)
+{
+  u32 rounds = _spin_rounds();
+  u32 state  = LIBD_ATOMIC_LOAD(&mutex->state, LIBD_ATOMIC_RELAXED);
+  for (u32 i = 0; i < rounds && state == _MUTEX_LOCKED; i += 1) {
+    LIBD_CPU_RELAX();
+    state = LIBD_ATOMIC_LOAD(&mutex->state, LIBD_ATOMIC_RELAXED);
+  }
+
+  return state;
+}
+
+//==============================================================================
+// Reader-Writer Lock
+//==============================================================================
+
+enum libd_result
+libd_platform_rwlock_init(struct libd_platform_rwlock* rwlock)
+{
+  if (rwlock == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  LIBD_ATOMIC_STORE(&rwlock->state, 0, LIBD_ATOMIC_RELAXED);
+  LIBD_ATOMIC_STORE(&rwlock->writer_notify, 0, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+void
+libd_platform_rwlock_read_lock(struct libd_platform_rwlock* rwlock)
+{
+  u32 state = LIBD_ATOMIC_LOAD(&rwlock->state, LIBD_ATOMIC_RELAXED);
+  if (
+    _rw_can_read(state) &&
+    LIBD_ATOMIC_CAS_WEAK(
+      &rwlock->state,
+      &state,
+      state + _RW_READ_LOCKED,
+      LIBD_ATOMIC_ACQUIRE,
+      LIBD_ATOMIC_RELAXED)) {
+    return;
+  }
+
+  _rwlock_read_contended(rwlock);
+}
+
+void
+libd_platform_rwlock_read_unlock(struct libd_platform_rwlock* rwlock)
+{
+  u32 state = LIBD_ATOMIC_FETCH_SUB(
+                &rwlock->state, _RW_READ_LOCKED, LIBD_ATOMIC_RELEASE) -
+              _RW_READ_LOCKED;
+
+  if ((state & _RW_MASK) == 0 && (state & _RW_WAITING) != 0) {
+    _rwlock_wake(rwlock, state);
+  }
+}
+
+void
+libd_platform_rwlock_write_lock(struct libd_platform_rwlock* rwlock)
+{
+  u32 expected = 0;
+  if (LIBD_ATOMIC_CAS_STRONG(
+        &rwlock->state,
+        &expected,
+        _RW_WRITE_LOCKED,
+        LIBD_ATOMIC_ACQUIRE,
+        LIBD_ATOMIC_RELAXED)) {
+    return;
+  }
+
+  _rwlock_write_contended(rwlock);
+}
+
+void
+libd_platform_rwlock_write_unlock(struct libd_platform_rwlock* rwlock)
+{
+  u32 state = LIBD_ATOMIC_FETCH_SUB(
+                &rwlock->state, _RW_WRITE_LOCKED, LIBD_ATOMIC_RELEASE) -
+              _RW_WRITE_LOCKED;
+
+  if ((state & _RW_WAITING) != 0) {
+    _rwlock_wake(rwlock, state);
+  }
+}
+
+static bool
+_rw_can_read(u32 state)
+{
+  return (state & _RW_MASK) < _RW_MAX_READERS && (state & _RW_WAITING) == 0;
+}
+
+static void
+_rwlock_read_contended(struct libd_platform_rwlock* rwlock)
+{
+  u32 state = _rwlock_spin(rwlock, true);
+
+  for (;;) {
+    if (_rw_can_read(state)) {
+      if (LIBD_ATOMIC_CAS_WEAK(
+            &rwlock->state,
+            &state,
+            state + _RW_READ_LOCKED,
+            LIBD_ATOMIC_ACQUIRE,
+            LIBD_ATOMIC_RELAXED)) {
+        return;
+      }
+      continue;
+    }
+
+    if ((state & _RW_READERS_WAITING) == 0) {
+      if (!LIBD_ATOMIC_CAS_WEAK(
+            &rwlock->state,
+            &state,
+            state | _RW_READERS_WAITING,
+            LIBD_ATOMIC_RELAXED,
+            LIBD_ATOMIC_RELAXED)) {
+        continue;
+      }
+      state |= _RW_READERS_WAITING;
+    }
+
+    libd_platform_futex_wait(&rwlock->state, state);
+    state = _rwlock_spin(rwlock, true);
+  }
+}
+
+// A writer reads writer_notify after flagging itself and re-checks the state
+// before sleeping. A wake that clears the flag bumps writer_notify afterwards,
+// so either the re-check sees the flag gone or the sleep sees the new value.
+static void
+_rwlock_write_contended(struct libd_platform_rwlock* rwlock)
+{
+  u32 state = _rwlock_spin(rwlock, false);
+
+  for (;;) {
+    if ((state & _RW_MASK) == 0) {
+      if (LIBD_ATOMIC_CAS_WEAK(
+            &rwlock->state,
+            &state,
+            state | _RW_WRITE_LOCKED,
+            LIBD_ATOMIC_ACQUIRE,
+            LIBD_ATOMIC_RELAXED)) {
+        return;
+      }
+      continue;
+    }
+
+    if ((state & _RW_WRITERS_WAITING) == 0) {
+      if (!LIBD_ATOMIC_CAS_WEAK(
+            &rwlock->state,
+            &state,
+            state | _RW_WRITERS_WAITING,
+            LIBD_ATOMIC_RELAXED,
+            LIBD_ATOMIC_RELAXED)) {
+        continue;
+      }
+    }
+
+    u32 seq = LIBD_ATOMIC_LOAD(&rwlock->writer_notify, LIBD_ATOMIC_ACQUIRE);
+    state   = LIBD_ATOMIC_LOAD(&rwlock->state, LIBD_ATOMIC_RELAXED);
+    if ((state & _RW_MASK) == 0 || (state & _RW_WRITERS_WAITING) == 0) {
+      continue;
+    }
+
+    libd_platform_futex_wait(&rwlock->writer_notify, seq);
+    state = _rwlock_spin(rwlock, false);
+  }
+}
+
+// Spins while a holder is running and nobody sleeps yet: readers wait out a
+// writer, writers wait out anyone.
+static u32
+_rwlock_spin(
+  struct libd_platform_rwlock* rwlock,
+  bool reader)
+{
+  u32 rounds = _spin_rounds();
+  u32 state  = LIBD_ATOMIC_LOAD(&rwlock->state, LIBD_ATOMIC_RELAXED);
+  for (u32 i = 0; i < rounds; i += 1) {
+    bool held = reader ? (state & _RW_MASK) == _RW_WRITE_LOCKED
+                       : (state & _RW_MASK) != 0;
+    if (!held || (state & _RW_WAITING) != 0) {
+      break;
+    }
+    LIBD_CPU_RELAX();
+    state = LIBD_ATOMIC_LOAD(&rwlock->state, LIBD_ATOMIC_RELAXED);
+  }
+
+  return state;
+}
+
+// Called with the lock free and someone waiting. Writers go first: their flag
+// is cleared and all of them are woken to race for the lock, and those that
+// lose flag themselves again. Readers are woken once no writer waits, by the
+// unlock of the writer that ran.
+static void
+_rwlock_wake(
+  struct libd_platform_rwlock* rwlock,
+  u32 state)
+{
+  for (;;) {
+    if ((state & _RW_MASK) != 0) {
+      // someone took the lock in the meantime and wakes on its unlock.
+      return;
+    }
+
+    if ((state & _RW_WRITERS_WAITING) != 0) {
+      if (!LIBD_ATOMIC_CAS_STRONG(
+            &rwlock->state,
+            &state,
+            state & ~_RW_WRITERS_WAITING,
+            LIBD_ATOMIC_RELAXED,
+            LIBD_ATOMIC_RELAXED)) {
+        continue;
+      }
+      LIBD_ATOMIC_FETCH_ADD(&rwlock->writer_notify, 1, LIBD_ATOMIC_RELEASE);
+      libd_platform_futex_wake(&rwlock->writer_notify, U32_MAX);
+      return;
+    }
+
+    if ((state & _RW_READERS_WAITING) != 0) {
+      if (!LIBD_ATOMIC_CAS_STRONG(
+            &rwlock->state,
+            &state,
+            state & ~_RW_READERS_WAITING,
+            LIBD_ATOMIC_RELAXED,
+            LIBD_ATOMIC_RELAXED)) {
+        continue;
+      }
+      libd_platform_futex_wake(&rwlock->state, U32_MAX);
+    }
+
+    return;
+  }
+}
+
+//==============================================================================
+// Event
+//==============================================================================
+
+enum libd_result
+libd_platform_event_init(struct libd_platform_event* event)
+{
+  if (event == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  LIBD_ATOMIC_STORE(&event->state, _EVENT_UNSET, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+void
+libd_platform_event_set(struct libd_platform_event* event)
+{
+  u32 prev =
+    LIBD_ATOMIC_EXCHANGE(&event->state, _EVENT_SET, LIBD_ATOMIC_RELEASE);
+  if (prev == _EVENT_WAITING) {
+    libd_platform_futex_wake(&event->state, U32_MAX);
+  }
+}
+
+bool
+libd_platform_event_is_set(struct libd_platform_event* event)
+{
+  return LIBD_ATOMIC_LOAD(&event->state, LIBD_ATOMIC_ACQUIRE) == _EVENT_SET;
+}
+
+void
+libd_platform_event_wait(struct libd_platform_event* event)
+{
+  u32 rounds = _spin_rounds();
+  u32 state  = LIBD_ATOMIC_LOAD(&event->state, LIBD_ATOMIC_ACQUIRE);
+  for (u32 i = 0; i < rounds && state != _EVENT_SET; i += 1) {
+    LIBD_CPU_RELAX();
+    state = LIBD_ATOMIC_LOAD(&event->state, LIBD_ATOMIC_ACQUIRE);
+  }
+
+  while (state != _EVENT_SET) {
+    if (
+      state == _EVENT_UNSET &&
+      !LIBD_ATOMIC_CAS_WEAK(
+        &event->state,
+        &state,
+        _EVENT_WAITING,
+        LIBD_ATOMIC_ACQUIRE,
+        LIBD_ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    libd_platform_futex_wait(&event->state, _EVENT_WAITING);
+    state = LIBD_ATOMIC_LOAD(&event->state, LIBD_ATOMIC_ACQUIRE);
+  }
+}
+
+//==============================================================================
+// Latch
+//==============================================================================
+
+enum libd_result
+libd_platform_latch_init(
+  struct libd_platform_latch* latch,
+  u32 count)
+{
+  if (latch == NULL || count > U32_MAX / _LATCH_ONE) {
+    return libd_invalid_parameter;
+  }
+
+  LIBD_ATOMIC_STORE(&latch->state, count * _LATCH_ONE, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+void
+libd_platform_latch_add(
+  struct libd_platform_latch* latch,
+  u32 n)
+{
+  LIBD_ATOMIC_FETCH_ADD(&latch->state, n * _LATCH_ONE, LIBD_ATOMIC_RELAXED);
+}
+
+void
+libd_platform_latch_count_down(
+  struct libd_platform_latch* latch,
+  u32 n)
+{
+  u32 state = LIBD_ATOMIC_FETCH_SUB(
+                &latch->state, n * _LATCH_ONE, LIBD_ATOMIC_RELEASE) -
+              n * _LATCH_ONE;
+
+  if (state == _LATCH_SLEEPING) {
+    // the waiters re-check the count, so they go back to sleep if it was
+    // raised again in between.
+    u32 expected = _LATCH_SLEEPING;
+    LIBD_ATOMIC_CAS_STRONG(
+      &latch->state, &expected, 0, LIBD_ATOMIC_RELAXED, LIBD_ATOMIC_RELAXED);
+    libd_platform_futex_wake(&latch->state, U32_MAX);
+  }
+}
+
+void
+libd_platform_latch_wait(struct libd_platform_latch* latch)
+{
+  u32 rounds = _spin_rounds();
+  u32 state  = LIBD_ATOMIC_LOAD(&latch->state, LIBD_ATOMIC_ACQUIRE);
+  for (u32 i = 0; i < rounds && state >= _LATCH_ONE; i += 1) {
+    LIBD_CPU_RELAX();
+    state = LIBD_ATOMIC_LOAD(&latch->state, LIBD_ATOMIC_ACQUIRE);
+  }
+
+  while (state >= _LATCH_ONE) {
+    if (
+      (state & _LATCH_SLEEPING) == 0 &&
+      !LIBD_ATOMIC_CAS_WEAK(
+        &latch->state,
+        &state,
+        state | _LATCH_SLEEPING,
+        LIBD_ATOMIC_ACQUIRE,
+        LIBD_ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    libd_platform_futex_wait(&latch->state, state | _LATCH_SLEEPING);
+    state = LIBD_ATOMIC_LOAD(&latch->state, LIBD_ATOMIC_ACQUIRE);
+  }
+}
+
+//==============================================================================
+// Barrier
+//==============================================================================
+
+enum libd_result
+libd_platform_barrier_init(
+  struct libd_platform_barrier* barrier,
+  u32 threshold)
+{
+  if (barrier == NULL || threshold == 0) {
+    return libd_invalid_parameter;
+  }
+
+  barrier->threshold = threshold;
+  LIBD_ATOMIC_STORE(&barrier->arrived, 0, LIBD_ATOMIC_RELAXED);
+  LIBD_ATOMIC_STORE(&barrier->generation, 0, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+// The generation cannot move before this thread arrives, so reading it first
+// gives the phase being waited for. The last thread to arrive resets the
+// count before it publishes the next phase, and threads only arrive for that
+// phase after seeing it.
+bool
+libd_platform_barrier_wait(struct libd_platform_barrier* barrier)
+{
+  u32 generation =
+    LIBD_ATOMIC_LOAD(&barrier->generation, LIBD_ATOMIC_ACQUIRE);
+  u32 phase = _PHASE_OF(generation);
+
+  u32 arrived =
+    LIBD_ATOMIC_FETCH_ADD(&barrier->arrived, 1, LIBD_ATOMIC_ACQ_REL) + 1;
+  if (arrived == barrier->threshold) {
+    LIBD_ATOMIC_STORE(&barrier->arrived, 0, LIBD_ATOMIC_RELAXED);
+    u32 prev = LIBD_ATOMIC_EXCHANGE(
+      &barrier->generation, phase + _BARRIER_PHASE, LIBD_ATOMIC_RELEASE);
+    if ((prev & _BARRIER_SLEEPING) != 0) {
+      libd_platform_futex_wake(&barrier->generation, U32_MAX);
+    }
+    return true;
+  }
+
+  u32 rounds = _spin_rounds();
+  for (u32 i = 0; i < rounds && _PHASE_OF(generation) == phase; i += 1) {
+    LIBD_CPU_RELAX();
+    generation = LIBD_ATOMIC_LOAD(&barrier->generation, LIBD_ATOMIC_ACQUIRE);
+  }
+
+  while (_PHASE_OF(generation) == phase) {
+    if (
+      (generation & _BARRIER_SLEEPING) == 0 &&
+      !LIBD_ATOMIC_CAS_WEAK(
+        &barrier->generation,
+        &generation,
+        generation | _BARRIER_SLEEPING,
+        LIBD_ATOMIC_ACQUIRE,
+        LIBD_ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    libd_platform_futex_wait(
+      &barrier->generation, phase | _BARRIER_SLEEPING);
+    generation = LIBD_ATOMIC_LOAD(&barrier->generation, LIBD_ATOMIC_ACQUIRE);
+  }
+
+  return false;
+}
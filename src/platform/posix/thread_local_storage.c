@@ -1,27 +1,121 @@
 #include "../../../include/libd/platform/threads.h"
+#include "../../../include/libd/utils/align_compat.h"
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <stddef.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Handles past the first _N_FAST_SLOTS live ones, or that no longer fit in
+// the block, only use their own pthread key.
+#define _N_FAST_SLOTS     LIBD_PLATFORM_TLS_FAST_SLOTS
+#define _NO_SLOT          _N_FAST_SLOTS
+#define _BLOCK_SIZE       (4 * KiB)
+#define _DESTRUCTOR_ROUNDS 4
+
+// Every handle with a slot owns a range of _BLOCK_SIZE bytes at the same
+// offset in each thread's block, resolved when the handle is created. A thread
+// allocates its block on the first get of any handle and frees it once at
+// exit, so the data of all those handles sits together in one allocation.
+//
+// libd_platform_tls_slots caches the address of each range, so a get is a
+// lookup in compiler TLS, inlined in threads.h. A slot only belongs to the
+// handle whose generation it holds: generations are never reused, so entries
+// left behind by a destroyed handle are ignored by whichever handle reuses the
+// slot, and a zeroed slot matches nothing. Handles without a slot point at the
+// extra entry past the last slot, which stays zeroed. The range is zeroed when
+// the entry is filled.
+//
+// Cleanups run on exiting threads without the lock held. Each one counts as
+// busy on its slot, or on its handle for keyed storage, while it runs, and
+// destroy waits for that count to drop so the cleanup never outlives the
+// handle. A busy slot is not handed out again until then.
 struct thread_local_storage_handle {
+  // read by the inline get, so it stays first.
+  struct libd_platform_thread_local_storage_prefix prefix;
   pthread_key_t key;
   size_t data_size;
+  libd_platform_thread_local_storage_cleanup_f cleanup;
+  u32 offset;
+  // keyed handles only, guarded by g_slots_lock.
+  u32 busy;
+  struct thread_local_storage_handle* next_keyed;
+};
+
+// what a handle without a slot stores under its key.
+struct keyed_storage {
+  libd_platform_thread_local_storage_cleanup_f cleanup;
+  size_t size;
+  u64 generation;
+  LIBD_MAX_ALIGN_T data[];
 };
 
+LIBD_PLATFORM_THREAD_LOCAL struct libd_platform_thread_local_storage_slot
+  libd_platform_tls_slots[_N_FAST_SLOTS + 1];
+static LIBD_PLATFORM_THREAD_LOCAL u8* t_block;
+// generation of the cleanup this thread is running, 0 if none.
+static LIBD_PLATFORM_THREAD_LOCAL u64 t_cleanup_generation;
+
+// a slot is free while its generation is 0.
+static pthread_mutex_t g_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static u64 g_next_generation        = 1;
+static u64 g_slot_generations[_N_FAST_SLOTS];
+static u32 g_slot_offsets[_N_FAST_SLOTS];
+static u32 g_slot_sizes[_N_FAST_SLOTS];
+static size_t g_slot_data_sizes[_N_FAST_SLOTS];
+static libd_platform_thread_local_storage_cleanup_f
+  g_slot_cleanups[_N_FAST_SLOTS];
+static u32 g_slot_busy[_N_FAST_SLOTS];
+
+// live handles without a slot, so their destructor can tell if one is gone.
+static struct thread_local_storage_handle* g_keyed_handles = NULL;
+static pthread_cond_t g_cleanups_done = PTHREAD_COND_INITIALIZER;
+
+// frees the block at thread exit.
+static pthread_key_t g_block_key;
+static pthread_once_t g_block_once = PTHREAD_ONCE_INIT;
+static bool g_block_key_valid      = false;
+
 // singleton storage slot variables
 static struct thread_local_storage_handle* g_static_handle = NULL;
-static pthread_once_t g_static_once                        = PTHREAD_ONCE_INIT;
-static size_t g_static_size                                = 0;
-static libd_platform_thread_local_storage_destructor_f g_static_destructor =
-  NULL;
+
+static void
+_acquire_slot(struct thread_local_storage_handle* handle);
+
+static void
+_release_slot(struct thread_local_storage_handle* handle);
+
+static bool
+_find_offset(
+  u32 size,
+  u32* out_offset);
+
+static void
+_create_block_key(void);
+
+static void
+_block_destructor(void* block);
+
+static void
+_keyed_destructor(void* storage);
+
+static void
+_run_cleanup(
+  libd_platform_thread_local_storage_cleanup_f cleanup,
+  void* data,
+  size_t size,
+  u64 generation);
+
+static void
+_wait_for_cleanups(
+  const u32* busy,
+  u64 generation);
 
 enum libd_result
 libd_platform_thread_local_storage_create(
   struct thread_local_storage_handle** p_handle,
-  libd_platform_thread_local_storage_destructor_f destructor,
+  libd_platform_thread_local_storage_cleanup_f cleanup,
   size_t size)
 {
   struct thread_local_storage_handle* handle =
@@ -32,10 +126,22 @@ libd_platform_thread_local_storage_create(
   }
 
   handle->data_size = size;
+  handle->cleanup   = cleanup;
 
-  if (pthread_key_create(&handle->key, destructor) != 0) {
-    free(handle);
-    return libd_no_memory;
+  handle->busy      = 0;
+
+  pthread_once(&g_block_once, _create_block_key);
+  _acquire_slot(handle);
+
+  if (handle->prefix.slot == _NO_SLOT) {
+    if (pthread_key_create(&handle->key, _keyed_destructor) != 0) {
+      free(handle);
+      return libd_no_memory;
+    }
+    pthread_mutex_lock(&g_slots_lock);
+    handle->next_keyed = g_keyed_handles;
+    g_keyed_handles    = handle;
+    pthread_mutex_unlock(&g_slots_lock);
   }
 
   *p_handle = handle;
@@ -51,14 +157,29 @@ libd_platform_thread_local_storage_destroy(
     return libd_invalid_parameter;
   }
 
-  pthread_key_delete(handle->key);
+  if (handle->prefix.slot != _NO_SLOT) {
+    _release_slot(handle);
+  } else {
+    pthread_mutex_lock(&g_slots_lock);
+    struct thread_local_storage_handle** p_next = &g_keyed_handles;
+    while (*p_next != handle) {
+      p_next = &(*p_next)->next_keyed;
+    }
+    *p_next = handle->next_keyed;
+    _wait_for_cleanups(&handle->busy, handle->prefix.generation);
+    pthread_mutex_unlock(&g_slots_lock);
+
+    free(pthread_getspecific(handle->key));
+    pthread_key_delete(handle->key);
+  }
   free(handle);
 
   return libd_ok;
 }
 
+// First access from this thread, or a handle without a slot.
 enum libd_result
-libd_platform_thread_local_storage_get(
+libd_platform_thread_local_storage_get_slow(
   struct thread_local_storage_handle* handle,
   void** pp_data)
 {
@@ -66,21 +187,48 @@ libd_platform_thread_local_storage_get(
     return libd_invalid_parameter;
   }
 
-  void* p_data = pthread_getspecific(handle->key);
+  if (handle->prefix.slot != _NO_SLOT) {
+    if (t_block == NULL) {
+      void* block;
+      if (posix_memalign(&block, LIBD_CACHE_LINE_SIZE, _BLOCK_SIZE) != 0) {
+        return libd_no_memory;
+      }
+      if (pthread_setspecific(g_block_key, block) != 0) {
+        free(block);
+        return libd_no_memory;
+      }
+      t_block = block;
+    }
+
+    void* p_data = t_block + handle->offset;
+    memset(p_data, 0, handle->data_size);
+    libd_platform_tls_slots[handle->prefix.slot] =
+      (struct libd_platform_thread_local_storage_slot){
+        .data       = p_data,
+        .generation = handle->prefix.generation,
+      };
+    *pp_data = p_data;
 
-  if (p_data == NULL) {
-    p_data = malloc(handle->data_size);
-    if (p_data == NULL) {
+    return libd_ok;
+  }
+
+  struct keyed_storage* storage = pthread_getspecific(handle->key);
+  if (storage == NULL) {
+    storage = calloc(1, sizeof(*storage) + handle->data_size);
+    if (storage == NULL) {
       return libd_no_memory;
     }
-    if (pthread_setspecific(handle->key, p_data) != 0) {
-      free(p_data);
+    storage->cleanup    = handle->cleanup;
+    storage->size       = handle->data_size;
+    storage->generation = handle->prefix.generation;
+    if (pthread_setspecific(handle->key, storage) != 0) {
+      free(storage);
       // TODO:
       return 1;
     }
   }
 
-  *pp_data = p_data;
+  *pp_data = storage->data;
 
   return libd_ok;
 }
@@ -112,23 +260,20 @@ libd_platform_thread_local_storage_set(
   return libd_ok;
 }
 
-static void
-_init_static_thread_local_storage(void);
-
 enum libd_result
 libd_platform_thread_local_static_init(
-  libd_platform_thread_local_storage_destructor_f destructor,
+  libd_platform_thread_local_storage_cleanup_f cleanup,
   size_t size)
 {
   if (g_static_handle != NULL) {
     return libd_ok;
   }
 
-  g_static_destructor = destructor;
-  g_static_size       = size;
-  pthread_once(&g_static_once, _init_static_thread_local_storage);
-
-  if (g_static_handle == NULL) {
+  // init is not called concurrently, so the handle is simply created here and
+  // can be created again after cleanup.
+  if (
+    libd_platform_thread_local_storage_create(
+      &g_static_handle, cleanup, size) != libd_ok) {
     return libd_thread_init_failed;
   }
 
@@ -161,20 +306,217 @@ libd_platform_thread_local_static_cleanup(void)
   if (g_static_handle == NULL) {
     return libd_not_initialized;
   }
-  return libd_platform_thread_local_storage_destroy(g_static_handle);
+
+  enum libd_result result =
+    libd_platform_thread_local_storage_destroy(g_static_handle);
+  g_static_handle = NULL;
+
+  return result;
 }
 
 static void
-_init_static_thread_local_storage(void)
+_acquire_slot(struct thread_local_storage_handle* handle)
 {
-  enum libd_result result = libd_platform_thread_local_storage_create(
-    &g_static_handle, g_static_destructor, g_static_size);
+  u32 size = (u32)MIN(MAX(handle->data_size, 1), _BLOCK_SIZE + 1);
 
-  if (result != libd_ok) {
-    fprintf(
-      stderr,
-      "Failed to create thread-local storage for the singleton "
-      "storage element.\n");
-    exit(result);
+  pthread_mutex_lock(&g_slots_lock);
+
+  handle->prefix.slot        = _NO_SLOT;
+  handle->prefix.generation  = g_next_generation;
+  g_next_generation         += 1;
+  for (u32 i = 0; g_block_key_valid && i < _N_FAST_SLOTS; i += 1) {
+    if (g_slot_generations[i] != 0 || g_slot_busy[i] != 0) {
+      continue;
+    }
+    if (_find_offset(size, &handle->offset)) {
+      g_slot_generations[i] = handle->prefix.generation;
+      g_slot_offsets[i]     = handle->offset;
+      g_slot_sizes[i]       = size;
+      g_slot_data_sizes[i]  = handle->data_size;
+      g_slot_cleanups[i]    = handle->cleanup;
+      handle->prefix.slot   = i;
+    }
+    break;
+  }
+
+  pthread_mutex_unlock(&g_slots_lock);
+}
+
+static void
+_release_slot(struct thread_local_storage_handle* handle)
+{
+  u32 slot = handle->prefix.slot;
+
+  pthread_mutex_lock(&g_slots_lock);
+  g_slot_generations[slot] = 0;
+  g_slot_cleanups[slot]    = NULL;
+  _wait_for_cleanups(&g_slot_busy[slot], handle->prefix.generation);
+  pthread_mutex_unlock(&g_slots_lock);
+}
+
+// Called with g_slots_lock held. A cleanup may destroy its own handle, so the
+// one this thread is running does not count.
+static void
+_wait_for_cleanups(
+  const u32* busy,
+  u64 generation)
+{
+  u32 own = t_cleanup_generation == generation ? 1 : 0;
+  while (*busy > own) {
+    pthread_cond_wait(&g_cleanups_done, &g_slots_lock);
+  }
+}
+
+static void
+_run_cleanup(
+  libd_platform_thread_local_storage_cleanup_f cleanup,
+  void* data,
+  size_t size,
+  u64 generation)
+{
+  u64 outer            = t_cleanup_generation;
+  t_cleanup_generation = generation;
+  cleanup(data, size);
+  t_cleanup_generation = outer;
+}
+
+// First fit over the ranges of the live slots. Called with g_slots_lock held.
+static bool
+_find_offset(
+  u32 size,
+  u32* out_offset)
+{
+  u32 offset = 0;
+  u32 i      = 0;
+  while (i < _N_FAST_SLOTS) {
+    if (offset + size > _BLOCK_SIZE) {
+      return false;
+    }
+
+    // a busy range still holds data its cleanup is using.
+    u32 end    = g_slot_offsets[i] + g_slot_sizes[i];
+    bool taken = g_slot_generations[i] != 0 || g_slot_busy[i] != 0;
+    if (
+      taken && offset < end &&
+      g_slot_offsets[i] < offset + size) {
+      // restart the scan past the range in the way.
+      offset = (end + LIBD_MAX_ALIGN - 1) & ~(u32)(LIBD_MAX_ALIGN - 1);
+      i      = 0;
+      continue;
+    }
+    i += 1;
+  }
+
+  *out_offset = offset;
+
+  return true;
+}
+
+static void
+_create_block_key(void)
+{
+  g_block_key_valid = pthread_key_create(&g_block_key, _block_destructor) == 0;
+}
+
+// Runs the cleanups of every range this thread touched, then frees the block.
+// The cleanups are called without the lock held, so they may use other
+// handles; ranges they touch again are cleaned up in the next round. A handle
+// destroyed before its cleanup is reached is skipped.
+static void
+_block_destructor(void* block)
+{
+  struct {
+    libd_platform_thread_local_storage_cleanup_f cleanup;
+    void* data;
+    size_t size;
+    u32 slot;
+    u64 generation;
+  } pending[_N_FAST_SLOTS];
+  struct libd_platform_thread_local_storage_slot* slots =
+    libd_platform_tls_slots;
+
+  for (u32 round = 0; round < _DESTRUCTOR_ROUNDS; round += 1) {
+    u32 n_pending = 0;
+
+    pthread_mutex_lock(&g_slots_lock);
+    for (u32 i = 0; i < _N_FAST_SLOTS; i += 1) {
+      if (
+        slots[i].generation == 0 ||
+        slots[i].generation != g_slot_generations[i]) {
+        continue;
+      }
+      if (g_slot_cleanups[i] != NULL) {
+        pending[n_pending].cleanup     = g_slot_cleanups[i];
+        pending[n_pending].data        = slots[i].data;
+        pending[n_pending].size        = g_slot_data_sizes[i];
+        pending[n_pending].slot        = i;
+        pending[n_pending].generation  = slots[i].generation;
+        n_pending                     += 1;
+      }
+      slots[i] = (struct libd_platform_thread_local_storage_slot){ 0 };
+    }
+    pthread_mutex_unlock(&g_slots_lock);
+
+    if (n_pending == 0) {
+      break;
+    }
+    for (u32 i = 0; i < n_pending; i += 1) {
+      u32 slot = pending[i].slot;
+
+      pthread_mutex_lock(&g_slots_lock);
+      bool live = g_slot_generations[slot] == pending[i].generation;
+      if (live) {
+        g_slot_busy[slot] += 1;
+      }
+      pthread_mutex_unlock(&g_slots_lock);
+      if (!live) {
+        continue;
+      }
+
+      _run_cleanup(
+        pending[i].cleanup,
+        pending[i].data,
+        pending[i].size,
+        pending[i].generation);
+
+      pthread_mutex_lock(&g_slots_lock);
+      g_slot_busy[slot] -= 1;
+      pthread_cond_broadcast(&g_cleanups_done);
+      pthread_mutex_unlock(&g_slots_lock);
+    }
+  }
+
+  memset(libd_platform_tls_slots, 0, sizeof(libd_platform_tls_slots));
+  t_block = NULL;
+  free(block);
+}
+
+static void
+_keyed_destructor(void* storage)
+{
+  struct keyed_storage* s = storage;
+  if (s->cleanup == NULL) {
+    free(s);
+    return;
+  }
+
+  pthread_mutex_lock(&g_slots_lock);
+  struct thread_local_storage_handle* handle = g_keyed_handles;
+  while (handle != NULL && handle->prefix.generation != s->generation) {
+    handle = handle->next_keyed;
+  }
+  if (handle != NULL) {
+    handle->busy += 1;
+  }
+  pthread_mutex_unlock(&g_slots_lock);
+
+  if (handle != NULL) {
+    _run_cleanup(s->cleanup, s->data, s->size, s->generation);
+
+    pthread_mutex_lock(&g_slots_lock);
+    handle->busy -= 1;
+    pthread_cond_broadcast(&g_cleanups_done);
+    pthread_mutex_unlock(&g_slots_lock);
   }
+  free(s);
 }
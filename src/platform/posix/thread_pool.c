@@ -0,0 +1,781 @@
+#include "../../../include/libd/memory.h"
+#include "../../../include/libd/platform/sync.h"
+#include "../../../include/libd/platform/threads.h"
+#include "../../../include/libd/utils/align_compat.h"
+#include "../../../include/libd/utils/atomic_compat.h"
+#include "./internal/thread_pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define _THREAD_LOCAL __thread
+#else
+  #define _THREAD_LOCAL _Thread_local
+#endif
+
+#define _DEFAULT_MAX_TASKS      4096
+#define _DEFAULT_DEQUE_CAPACITY 1024
+#define _DEFAULT_SCRATCH_SIZE   (256 * KiB)
+#define _MAX_MAGAZINE_SIZE      64
+// rounds of looking for work, with a pause in between, before a worker parks.
+#define _SPIN_ROUNDS 64
+
+struct task {
+  libd_platform_thread_pool_task_f fn;
+  void* arg;
+  struct libd_platform_task_group* group;
+  struct task* next;
+};
+
+// Chase-Lev work-stealing deque over a fixed ring, with the orderings of Le et
+// al., "Correct and Efficient Work-Stealing for Weak Memory Models". The owner
+// pushes and takes at the bottom, thieves steal from the top, and the two only
+// race for the last task, which they settle with a CAS on top.
+struct deque {
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) s64 top;
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) s64 bottom;
+  struct task** buffer;
+  s64 mask;
+};
+
+struct worker {
+  struct deque deque;
+  struct thread_pool* pool;
+  pthread_t thread;
+  u64 rng;
+};
+
+// field order matters: the counters written by every thread get a cache line
+// each, away from the read-mostly fields.
+struct thread_pool {
+  struct worker* workers;
+  u32 n_workers;
+  libd_concurrent_pool_allocator_h* tasks;
+  libd_scratch_h* scratch;
+
+  // tasks submitted from outside the pool.
+  pthread_mutex_t injected_lock;
+  struct task* injected_head;
+  struct task* injected_tail;
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) u32 n_injected;
+
+  // submitted tasks that have not finished, waited on by wait.
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) u32 pending;
+
+  // parked workers sleep on wake_epoch, which is bumped to wake them. Its low
+  // bit is set while a wake is in flight, so a burst of submissions makes one
+  // futex call rather than one each. Only a worker that is awake and about to
+  // look for work clears the bit, and it passes the wake up along if there is
+  // more.
+  LIBD_ALIGNAS(LIBD_CACHE_LINE_SIZE) u32 wake_epoch;
+  u32 sleepers;
+  u32 stopping;
+};
+
+// the worker running on this thread, if any.
+static _THREAD_LOCAL struct worker* t_worker;
+// the pool whose task this thread is running, if any. Set on workers and on
+// threads helping out in wait.
+static _THREAD_LOCAL struct thread_pool* t_running;
+
+static enum libd_result
+_submit(
+  struct thread_pool* pool,
+  libd_platform_thread_pool_task_f fn,
+  void* arg,
+  struct libd_platform_task_group* group);
+
+static bool
+_deque_push(
+  struct deque* d,
+  struct task* task);
+
+static struct task*
+_deque_take(struct deque* d);
+
+static struct task*
+_deque_steal(
+  struct deque* d,
+  bool* out_contended);
+
+static bool
+_deque_is_empty(struct deque* d);
+
+static struct task*
+_pop_injected(struct thread_pool* pool);
+
+static struct task*
+_find_task(
+  struct thread_pool* pool,
+  struct worker* self);
+
+static void
+_run(
+  struct thread_pool* pool,
+  struct task* task);
+
+static bool
+_has_work(struct thread_pool* pool);
+
+static void
+_notify(struct thread_pool* pool);
+
+static void
+_take_wake(struct thread_pool* pool);
+
+static void
+_park(struct thread_pool* pool);
+
+static void*
+_worker_main(void* arg);
+
+static void
+_stop_workers(
+  struct thread_pool* pool,
+  u32 n_started);
+
+static void
+_free_pool(struct thread_pool* pool);
+
+enum libd_result
+libd_platform_thread_pool_create(
+  struct thread_pool** out,
+  u32 n_workers)
+{
+  return libd_platform_thread_pool_create_with_options(out, n_workers, NULL);
+}
+
+enum libd_result
+libd_platform_thread_pool_create_with_options(
+  struct thread_pool** out,
+  u32 n_workers,
+  const struct libd_platform_thread_pool_options* options)
+{
+  struct libd_platform_thread_pool_options opts = { 0 };
+  if (options != NULL) {
+    opts = *options;
+  }
+  if (opts.max_tasks == 0) {
+    opts.max_tasks = _DEFAULT_MAX_TASKS;
+  }
+  if (opts.deque_capacity == 0) {
+    opts.deque_capacity = _DEFAULT_DEQUE_CAPACITY;
+  }
+  if (opts.scratch_size == 0) {
+    opts.scratch_size = _DEFAULT_SCRATCH_SIZE;
+  }
+
+  if (out == NULL || (opts.deque_capacity & (opts.deque_capacity - 1)) != 0) {
+    return libd_invalid_parameter;
+  }
+
+  if (n_workers == 0) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_workers   = n_cpus > 0 ? (u32)n_cpus : 1;
+  }
+
+  void* mem;
+  if (
+    posix_memalign(&mem, LIBD_CACHE_LINE_SIZE, sizeof(struct thread_pool)) !=
+    0) {
+    return libd_no_memory;
+  }
+  struct thread_pool* pool = mem;
+  *pool                    = (struct thread_pool){ .n_workers = n_workers };
+
+  if (pthread_mutex_init(&pool->injected_lock, NULL) != 0) {
+    free(pool);
+    return libd_init_failed;
+  }
+
+  // the magazines hide free tasks from other threads, so they stay small
+  // next to max_tasks.
+  u32 magazine_size = opts.max_tasks / (n_workers + 1);
+  magazine_size     = MAX(2u, MIN(magazine_size, (u32)_MAX_MAGAZINE_SIZE));
+  enum libd_result r = libd_concurrent_pool_allocator_create(
+    &pool->tasks,
+    opts.max_tasks,
+    sizeof(struct task),
+    LIBD_ALIGNOF(struct task),
+    magazine_size);
+  if (r != libd_ok) {
+    _free_pool(pool);
+    return r;
+  }
+
+  r = libd_scratch_create(&pool->scratch, opts.scratch_size);
+  if (r != libd_ok) {
+    _free_pool(pool);
+    return r;
+  }
+
+  if (
+    posix_memalign(
+      &mem, LIBD_CACHE_LINE_SIZE, n_workers * sizeof(struct worker)) != 0) {
+    _free_pool(pool);
+    return libd_no_memory;
+  }
+  pool->workers = mem;
+  memset(pool->workers, 0, n_workers * sizeof(struct worker));
+
+  for (u32 i = 0; i < n_workers; i += 1) {
+    struct worker* w = &pool->workers[i];
+    w->pool          = pool;
+    w->rng           = 0x9e3779b97f4a7c15ull * (i + 1);
+    w->deque.mask    = opts.deque_capacity - 1;
+    w->deque.buffer  = malloc(opts.deque_capacity * sizeof(struct task*));
+    if (w->deque.buffer == NULL) {
+      _free_pool(pool);
+      return libd_no_memory;
+    }
+  }
+
+  for (u32 i = 0; i < n_workers; i += 1) {
+    struct worker* w = &pool->workers[i];
+    if (pthread_create(&w->thread, NULL, _worker_main, w) != 0) {
+      _stop_workers(pool, i);
+      _free_pool(pool);
+      return libd_thread_init_failed;
+    }
+  }
+
+  *out = pool;
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_platform_thread_pool_destroy(struct thread_pool* pool)
+{
+  if (pool == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  libd_platform_thread_pool_wait(pool);
+  _stop_workers(pool, pool->n_workers);
+  _free_pool(pool);
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_platform_thread_pool_submit(
+  struct thread_pool* pool,
+  libd_platform_thread_pool_task_f fn,
+  void* arg)
+{
+  if (pool == NULL || fn == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  return _submit(pool, fn, arg, NULL);
+}
+
+enum libd_result
+libd_platform_thread_pool_wait(struct thread_pool* pool)
+{
+  if (pool == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  u32 pending;
+  while ((pending = LIBD_ATOMIC_LOAD(&pool->pending, LIBD_ATOMIC_ACQUIRE))) {
+    struct task* task = _find_task(pool, NULL);
+    if (task != NULL) {
+      _run(pool, task);
+      continue;
+    }
+    // pending is only woken on when it reaches zero.
+    libd_platform_futex_wait(&pool->pending, pending);
+  }
+
+  return libd_ok;
+}
+
+u32
+libd_platform_thread_pool_worker_count(struct thread_pool* pool)
+{
+  if (pool == NULL) {
+    return 0;
+  }
+
+  return pool->n_workers;
+}
+
+libd_scratch_h*
+libd_platform_thread_pool_scratch(struct thread_pool* pool)
+{
+  return pool->scratch;
+}
+
+enum libd_result
+libd_platform_task_group_init(
+  struct libd_platform_task_group* group,
+  struct thread_pool* pool)
+{
+  if (group == NULL || pool == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  *group = (struct libd_platform_task_group){ .pool = pool };
+
+  return libd_ok;
+}
+
+enum libd_result
+libd_platform_task_group_spawn(
+  struct libd_platform_task_group* group,
+  libd_platform_thread_pool_task_f fn,
+  void* arg)
+{
+  if (group == NULL || group->pool == NULL || fn == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  return _submit(group->pool, fn, arg, group);
+}
+
+// Runs tasks until the group's are all done, then spins a little and sleeps
+// once there is nothing left to run. The low bit of state tells the last task
+// to wake this thread.
+enum libd_result
+libd_platform_task_group_wait(struct libd_platform_task_group* group)
+{
+  if (group == NULL || group->pool == NULL) {
+    return libd_invalid_parameter;
+  }
+
+  struct thread_pool* pool = group->pool;
+  struct worker* self      = t_worker;
+  if (self != NULL && self->pool != pool) {
+    self = NULL;
+  }
+
+  u32 idle_rounds = 0;
+  u32 state;
+  while ((state = LIBD_ATOMIC_LOAD(&group->state, LIBD_ATOMIC_ACQUIRE)) >= 2) {
+    struct task* task = _find_task(pool, self);
+    if (task != NULL) {
+      _run(pool, task);
+      idle_rounds = 0;
+      continue;
+    }
+    if (idle_rounds < _SPIN_ROUNDS) {
+      idle_rounds += 1;
+      LIBD_CPU_RELAX();
+      continue;
+    }
+
+    if (
+      (state & 1) == 0 &&
+      !LIBD_ATOMIC_CAS_STRONG(
+        &group->state,
+        &state,
+        state | 1,
+        LIBD_ATOMIC_ACQ_REL,
+        LIBD_ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    libd_platform_futex_wait(&group->state, state | 1);
+  }
+
+  LIBD_ATOMIC_STORE(&group->state, 0, LIBD_ATOMIC_RELAXED);
+
+  return libd_ok;
+}
+
+// A task that cannot be queued runs inline when the caller is going to wait
+// for it anyway: it belongs to a group, or it is the subtask of a running task.
+static enum libd_result
+_submit(
+  struct thread_pool* pool,
+  libd_platform_thread_pool_task_f fn,
+  void* arg,
+  struct libd_platform_task_group* group)
+{
+  struct worker* self = t_worker;
+  if (self != NULL && self->pool != pool) {
+    self = NULL;
+  }
+
+  struct task* task;
+  if (
+    libd_concurrent_pool_allocator_alloc(pool->tasks, (void**)&task) !=
+    libd_ok) {
+    if (group == NULL && t_running != pool) {
+      return libd_no_memory;
+    }
+    fn(arg);
+    return libd_ok;
+  }
+  task->fn    = fn;
+  task->arg   = arg;
+  task->group = group;
+  task->next  = NULL;
+
+  LIBD_ATOMIC_FETCH_ADD(&pool->pending, 1, LIBD_ATOMIC_RELAXED);
+  if (group != NULL) {
+    LIBD_ATOMIC_FETCH_ADD(&group->state, 2, LIBD_ATOMIC_RELAXED);
+  }
+
+  if (self != NULL) {
+    if (!_deque_push(&self->deque, task)) {
+      // workers only submit from a task, which keeps both counts above zero
+      // so nobody sees them drop.
+      if (group != NULL) {
+        LIBD_ATOMIC_FETCH_SUB(&group->state, 2, LIBD_ATOMIC_RELAXED);
+      }
+      LIBD_ATOMIC_FETCH_SUB(&pool->pending, 1, LIBD_ATOMIC_RELAXED);
+      libd_concurrent_pool_allocator_free(pool->tasks, task);
+      fn(arg);
+      return libd_ok;
+    }
+  } else {
+    pthread_mutex_lock(&pool->injected_lock);
+    if (pool->injected_tail == NULL) {
+      pool->injected_head = task;
+    } else {
+      pool->injected_tail->next = task;
+    }
+    pool->injected_tail = task;
+    LIBD_ATOMIC_FETCH_ADD(&pool->n_injected, 1, LIBD_ATOMIC_RELEASE);
+    pthread_mutex_unlock(&pool->injected_lock);
+  }
+
+  _notify(pool);
+
+  return libd_ok;
+}
+
+static bool
+_deque_push(
+  struct deque* d,
+  struct task* task)
+{
+  s64 b = LIBD_ATOMIC_LOAD(&d->bottom, LIBD_ATOMIC_RELAXED);
+  s64 t = LIBD_ATOMIC_LOAD(&d->top, LIBD_ATOMIC_ACQUIRE);
+  if (b - t > d->mask) {
+    return false;
+  }
+
+  // a release store rather than the paper's release fence; same ordering.
+  LIBD_ATOMIC_STORE(&d->buffer[b & d->mask], task, LIBD_ATOMIC_RELAXED);
+  LIBD_ATOMIC_STORE(&d->bottom, b + 1, LIBD_ATOMIC_RELEASE);
+
+  return true;
+}
+
+static struct task*
+_deque_take(struct deque* d)
+{
+  s64 b = LIBD_ATOMIC_LOAD(&d->bottom, LIBD_ATOMIC_RELAXED) - 1;
+  LIBD_ATOMIC_STORE(&d->bottom, b, LIBD_ATOMIC_RELAXED);
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+  s64 t = LIBD_ATOMIC_LOAD(&d->top, LIBD_ATOMIC_RELAXED);
+
+  if (t > b) {
+    LIBD_ATOMIC_STORE(&d->bottom, b + 1, LIBD_ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  struct task* task =
+    LIBD_ATOMIC_LOAD(&d->buffer[b & d->mask], LIBD_ATOMIC_RELAXED);
+  if (t == b) {
+    // the last task, which a thief may be stealing too.
+    if (!LIBD_ATOMIC_CAS_STRONG(
+          &d->top, &t, t + 1, LIBD_ATOMIC_SEQ_CST, LIBD_ATOMIC_RELAXED)) {
+      task = NULL;
+    }
+    LIBD_ATOMIC_STORE(&d->bottom, b + 1, LIBD_ATOMIC_RELAXED);
+  }
+
+  return task;
+}
+
+static struct task*
+_deque_steal(
+  struct deque* d,
+  bool* out_contended)
+{
+  s64 t = LIBD_ATOMIC_LOAD(&d->top, LIBD_ATOMIC_ACQUIRE);
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+  s64 b = LIBD_ATOMIC_LOAD(&d->bottom, LIBD_ATOMIC_ACQUIRE);
+
+  if (t >= b) {
+    return NULL;
+  }
+
+  struct task* task =
+    LIBD_ATOMIC_LOAD(&d->buffer[t & d->mask], LIBD_ATOMIC_RELAXED);
+  if (!LIBD_ATOMIC_CAS_STRONG(
+        &d->top, &t, t + 1, LIBD_ATOMIC_SEQ_CST, LIBD_ATOMIC_RELAXED)) {
+    *out_contended = true;
+    return NULL;
+  }
+
+  return task;
+}
+
+static bool
+_deque_is_empty(struct deque* d)
+{
+  s64 t = LIBD_ATOMIC_LOAD(&d->top, LIBD_ATOMIC_ACQUIRE);
+  s64 b = LIBD_ATOMIC_LOAD(&d->bottom, LIBD_ATOMIC_ACQUIRE);
+
+  return t >= b;
+}
+
+static struct task*
+_pop_injected(struct thread_pool* pool)
+{
+  if (LIBD_ATOMIC_LOAD(&pool->n_injected, LIBD_ATOMIC_ACQUIRE) == 0) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&pool->injected_lock);
+  struct task* task = pool->injected_head;
+  if (task != NULL) {
+    pool->injected_head = task->next;
+    if (pool->injected_head == NULL) {
+      pool->injected_tail = NULL;
+    }
+    LIBD_ATOMIC_FETCH_SUB(&pool->n_injected, 1, LIBD_ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&pool->injected_lock);
+
+  return task;
+}
+
+// Own deque first, then the shared queue, then every other worker from a
+// random starting point. self is NULL for threads outside the pool.
+static struct task*
+_find_task(
+  struct thread_pool* pool,
+  struct worker* self)
+{
+  struct task* task;
+  if (self != NULL) {
+    task = _deque_take(&self->deque);
+    if (task != NULL) {
+      return task;
+    }
+  }
+
+  task = _pop_injected(pool);
+  if (task != NULL) {
+    return task;
+  }
+
+  u32 start = 0;
+  if (self != NULL) {
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 7;
+    self->rng ^= self->rng << 17;
+    start      = (u32)(self->rng % pool->n_workers);
+  }
+
+  bool contended;
+  do {
+    contended = false;
+    for (u32 i = 0; i < pool->n_workers; i += 1) {
+      struct worker* victim = &pool->workers[(start + i) % pool->n_workers];
+      if (victim == self) {
+        continue;
+      }
+      task = _deque_steal(&victim->deque, &contended);
+      if (task != NULL) {
+        return task;
+      }
+    }
+  } while (contended);
+
+  return NULL;
+}
+
+// The task goes back to the allocator before it runs, so max_tasks bounds the
+// tasks waiting to start rather than the ones in flight.
+static void
+_run(
+  struct thread_pool* pool,
+  struct task* task)
+{
+  libd_platform_thread_pool_task_f fn     = task->fn;
+  void* arg                               = task->arg;
+  struct libd_platform_task_group* group = task->group;
+  libd_concurrent_pool_allocator_free(pool->tasks, task);
+
+  struct thread_pool* outer = t_running;
+  t_running                 = pool;
+  fn(arg);
+  t_running = outer;
+
+  // the group may be gone as soon as its count drops, so the wake only uses
+  // its address.
+  if (
+    group != NULL &&
+    LIBD_ATOMIC_FETCH_SUB(&group->state, 2, LIBD_ATOMIC_ACQ_REL) == 3) {
+    libd_platform_futex_wake(&group->state, 1);
+  }
+
+  if (LIBD_ATOMIC_FETCH_SUB(&pool->pending, 1, LIBD_ATOMIC_ACQ_REL) == 1) {
+    libd_platform_futex_wake(&pool->pending, U32_MAX);
+  }
+}
+
+static bool
+_has_work(struct thread_pool* pool)
+{
+  if (LIBD_ATOMIC_LOAD(&pool->n_injected, LIBD_ATOMIC_ACQUIRE) != 0) {
+    return true;
+  }
+  for (u32 i = 0; i < pool->n_workers; i += 1) {
+    if (!_deque_is_empty(&pool->workers[i].deque)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Pairs with _park: either the parking worker sees the new task, or this sees
+// the worker's sleepers increment and wakes it. While a wake is in flight the
+// worker that takes it is bound to see the task instead, see _take_wake.
+static void
+_notify(struct thread_pool* pool)
+{
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+  if (LIBD_ATOMIC_LOAD(&pool->sleepers, LIBD_ATOMIC_RELAXED) == 0) {
+    return;
+  }
+
+  u32 epoch = LIBD_ATOMIC_LOAD(&pool->wake_epoch, LIBD_ATOMIC_RELAXED);
+  if (
+    (epoch & 1) != 0 ||
+    !LIBD_ATOMIC_CAS_STRONG(
+      &pool->wake_epoch,
+      &epoch,
+      epoch + 1,
+      LIBD_ATOMIC_SEQ_CST,
+      LIBD_ATOMIC_RELAXED)) {
+    return;
+  }
+  libd_platform_futex_wake(&pool->wake_epoch, 1);
+}
+
+// Clears the in-flight bit if it is set. The caller goes on to look for work,
+// and the fence orders that search after the clear: a notify that saw the bit
+// set, and so skipped its wake, published its task before this clear.
+static void
+_take_wake(struct thread_pool* pool)
+{
+  u32 epoch = LIBD_ATOMIC_LOAD(&pool->wake_epoch, LIBD_ATOMIC_RELAXED);
+  if ((epoch & 1) != 0) {
+    LIBD_ATOMIC_CAS_STRONG(
+      &pool->wake_epoch,
+      &epoch,
+      epoch + 1,
+      LIBD_ATOMIC_SEQ_CST,
+      LIBD_ATOMIC_RELAXED);
+  }
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+}
+
+static void
+_park(struct thread_pool* pool)
+{
+  u32 epoch = LIBD_ATOMIC_LOAD(&pool->wake_epoch, LIBD_ATOMIC_ACQUIRE);
+  if ((epoch & 1) != 0) {
+    // a wake nobody has taken yet: take it rather than sleep.
+    _take_wake(pool);
+    return;
+  }
+
+  LIBD_ATOMIC_FETCH_ADD(&pool->sleepers, 1, LIBD_ATOMIC_RELAXED);
+  LIBD_ATOMIC_FENCE(LIBD_ATOMIC_SEQ_CST);
+
+  if (
+    !_has_work(pool) &&
+    !LIBD_ATOMIC_LOAD(&pool->stopping, LIBD_ATOMIC_ACQUIRE)) {
+    libd_platform_futex_wait(&pool->wake_epoch, epoch);
+  }
+
+  LIBD_ATOMIC_FETCH_SUB(&pool->sleepers, 1, LIBD_ATOMIC_RELAXED);
+  // whether or not this worker was the one woken, it looks for work next.
+  _take_wake(pool);
+}
+
+static void*
+_worker_main(void* arg)
+{
+  struct worker* self      = arg;
+  struct thread_pool* pool = self->pool;
+  t_worker                 = self;
+
+  while (true) {
+    struct task* task = NULL;
+    for (u32 i = 0; i < _SPIN_ROUNDS && task == NULL; i += 1) {
+      task = _find_task(pool, self);
+      if (task == NULL) {
+        LIBD_CPU_RELAX();
+      }
+    }
+
+    if (task != NULL) {
+      // pass the wake up along while there is more work than awake workers.
+      if (
+        LIBD_ATOMIC_LOAD(&pool->sleepers, LIBD_ATOMIC_RELAXED) != 0 &&
+        _has_work(pool)) {
+        _notify(pool);
+      }
+      _run(pool, task);
+      continue;
+    }
+
+    if (LIBD_ATOMIC_LOAD(&pool->stopping, LIBD_ATOMIC_ACQUIRE)) {
+      break;
+    }
+    _park(pool);
+  }
+
+  t_worker = NULL;
+
+  return NULL;
+}
+
+static void
+_stop_workers(
+  struct thread_pool* pool,
+  u32 n_started)
+{
+  LIBD_ATOMIC_STORE(&pool->stopping, 1, LIBD_ATOMIC_RELEASE);
+  // by 2, so a wake in flight stays in flight.
+  LIBD_ATOMIC_FETCH_ADD(&pool->wake_epoch, 2, LIBD_ATOMIC_SEQ_CST);
+  libd_platform_futex_wake(&pool->wake_epoch, U32_MAX);
+
+  for (u32 i = 0; i < n_started; i += 1) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+}
+
+static void
+_free_pool(struct thread_pool* pool)
+{
+  if (pool->workers != NULL) {
+    for (u32 i = 0; i < pool->n_workers; i += 1) {
+      free(pool->workers[i].deque.buffer);
+    }
+    free(pool->workers);
+  }
+  if (pool->tasks != NULL) {
+    libd_concurrent_pool_allocator_destroy(pool->tasks);
+  }
+  if (pool->scratch != NULL) {
+    libd_scratch_destroy(pool->scratch);
+  }
+  pthread_mutex_destroy(&pool->injected_lock);
+  free(pool);
+}
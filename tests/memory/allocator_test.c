@@ -0,0 +1,129 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/testing.h"
+#include "../../include/libd/utils/darray.h"
+
+#include <stdint.h>
+#include <string.h>
+
+DEFINE_LIBD_DARRAY_HEADER(int)
+DEFINE_LIBD_DARRAY_IMPL(int)
+
+TEST(allocator_invalid_params)
+{
+  struct libd_allocator a;
+  libd_linear_allocator_h* la;
+  libd_pool_allocator_h* pa;
+  ASSERT_OK(libd_linear_allocator_create(&la, 4 * KiB, 4 * KiB, 8));
+  ASSERT_OK(libd_pool_allocator_create(&pa, 4, 16, 8));
+
+  ASSERT_EQ_U(libd_allocator_from_linear(NULL, la), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_allocator_from_linear(&a, NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_allocator_from_pool(NULL, pa), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_allocator_from_pool(&a, NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_allocator_system(NULL), libd_invalid_parameter);
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(allocator_linear)
+{
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create(&la, 64 * KiB, 4 * KiB, 8));
+  struct libd_allocator a;
+  ASSERT_OK(libd_allocator_from_linear(&a, la));
+
+  char* s;
+  ASSERT_OK(libd_allocator_alloc(&a, (void**)&s, 5));
+  memcpy(s, "hello", 5);
+  ASSERT_OK(libd_allocator_resize(&a, (void**)&s, s, 5, 32));
+  ASSERT_TRUE(memcmp(s, "hello", 5) == 0);
+
+  // freeing the newest allocation hands its space straight back.
+  ASSERT_OK(libd_allocator_free(&a, s, 32));
+  char* again;
+  ASSERT_OK(libd_allocator_alloc(&a, (void**)&again, 8));
+  ASSERT_EQ_PTR(again, s);
+
+  ASSERT_OK(libd_allocator_reset(&a));
+  ASSERT_OK(libd_allocator_alloc(&a, (void**)&again, 8));
+  ASSERT_EQ_PTR(again, s);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(allocator_pool)
+{
+  libd_pool_allocator_h* pa;
+  ASSERT_OK(libd_pool_allocator_create(&pa, 2, 16, 8));
+  struct libd_allocator a;
+  ASSERT_OK(libd_allocator_from_pool(&a, pa));
+
+  void* p;
+  void* q;
+  ASSERT_OK(libd_allocator_alloc(&a, &p, 16));
+  ASSERT_EQ_U(libd_allocator_alloc(&a, &q, 17), libd_invalid_parameter);
+  ASSERT_OK(libd_allocator_resize(&a, &q, p, 16, 4));
+  ASSERT_EQ_PTR(q, p);
+  ASSERT_EQ_U(
+    libd_allocator_resize(&a, &q, p, 16, 32), libd_invalid_parameter);
+
+  ASSERT_OK(libd_allocator_free(&a, p, 16));
+  ASSERT_OK(libd_allocator_alloc(&a, &q, 8));
+  ASSERT_EQ_PTR(q, p);
+  ASSERT_OK(libd_allocator_reset(&a));
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+}
+
+TEST(allocator_system)
+{
+  struct libd_allocator a;
+  ASSERT_OK(libd_allocator_system(&a));
+
+  u8* p;
+  ASSERT_OK(libd_allocator_alloc(&a, (void**)&p, 16));
+  p[15] = 1;
+  ASSERT_OK(libd_allocator_resize(&a, (void**)&p, p, 16, 4 * KiB));
+  ASSERT_EQ_U(p[15], 1);
+  ASSERT_OK(libd_allocator_free(&a, p, 4 * KiB));
+  ASSERT_EQ_U(libd_allocator_reset(&a), libd_mem_not_implemented);
+}
+
+TEST(allocator_darray_on_arena)
+{
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create(&la, 64 * KiB, 4 * KiB, 8));
+  struct libd_allocator a;
+  ASSERT_OK(libd_allocator_from_linear(&a, la));
+
+  libd_type_darray_t* arr = libd_type_darray_create_with_allocator(2, &a);
+  ASSERT_NE_PTR(arr, NULL);
+  for (int i = 0; i < 1000; i += 1) {
+    ASSERT_EQ_U(libd_type_darray_append(arr, &i), 0);
+  }
+  for (int i = 0; i < 1000; i += 1) {
+    ASSERT_EQ_U(*libd_type_darray_at(arr, i), i);
+  }
+
+  // the array was the newest allocation every time it grew, so it grew in
+  // place instead of leaving copies behind.
+  void* p;
+  ASSERT_OK(libd_linear_allocator_alloc(la, &p, 8));
+  ASSERT_TRUE((uintptr_t)p - (uintptr_t)arr < 8 * KiB);
+  ASSERT_OK(libd_linear_allocator_resize(la, &p, p, 8, 0));
+
+  // and destroying it rewinds the arena entirely.
+  libd_type_darray_destroy(arr);
+  ASSERT_OK(libd_linear_allocator_alloc(la, &p, 8));
+  ASSERT_EQ_PTR(p, arr);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+
+  // the default still runs on the system heap.
+  arr = libd_type_darray_create(4);
+  ASSERT_NE_PTR(arr, NULL);
+  int v = 7;
+  ASSERT_EQ_U(libd_type_darray_append(arr, &v), 0);
+  libd_type_darray_destroy(arr);
+}
@@ -0,0 +1,190 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/testing.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+TEST(concurrent_pool_allocator_invalid_params)
+{
+  struct {
+    const char* name;
+    u32 input_max_allocations;
+    u32 input_magazine_size;
+    enum libd_result expected;
+  } tcs[] = {
+    {
+      .name                  = "valid\0",
+      .input_max_allocations = 16,
+      .input_magazine_size   = 4,
+      .expected              = libd_ok,
+    },
+    {
+      .name                  = "zero max allocations\0",
+      .input_max_allocations = 0,
+      .input_magazine_size   = 4,
+      .expected              = libd_invalid_parameter,
+    },
+    {
+      .name                  = "magazine too small\0",
+      .input_max_allocations = 16,
+      .input_magazine_size   = 1,
+      .expected              = libd_invalid_parameter,
+    },
+    {
+      .name                  = "magazine too big\0",
+      .input_max_allocations = 16,
+      .input_magazine_size   = LIBD_CONCURRENT_POOL_MAX_MAGAZINE_SIZE + 1,
+      .expected              = libd_invalid_parameter,
+    },
+  };
+
+  ASSERT_EQ_U(
+    libd_concurrent_pool_allocator_create(NULL, 16, 8, 8, 4),
+    libd_invalid_parameter);
+
+  for (size_t i = 0; i < ARR_LEN(tcs); i += 1) {
+    libd_concurrent_pool_allocator_h* cpa = NULL;
+    ASSERT_EQ_U(
+      libd_concurrent_pool_allocator_create(
+        &cpa, tcs[i].input_max_allocations, 8, 8, tcs[i].input_magazine_size),
+      tcs[i].expected,
+      "name=%s\n",
+      tcs[i].name);
+
+    if (cpa != NULL) {
+      ASSERT_OK(libd_concurrent_pool_allocator_destroy(cpa));
+    }
+  }
+}
+
+TEST(concurrent_pool_allocator_exhaust_and_reuse)
+{
+  const u32 max_allocations = 16;
+  libd_concurrent_pool_allocator_h* cpa;
+  ASSERT_OK(
+    libd_concurrent_pool_allocator_create(&cpa, max_allocations, 8, 8, 4));
+
+  u64* slots[16];
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_OK(libd_concurrent_pool_allocator_alloc(cpa, (void**)&slots[i]));
+    *slots[i] = i;
+  }
+
+  void* extra;
+  ASSERT_EQ_U(
+    libd_concurrent_pool_allocator_alloc(cpa, &extra), libd_no_memory);
+
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_EQ_U(*slots[i], i);
+    ASSERT_OK(libd_concurrent_pool_allocator_free(cpa, slots[i]));
+  }
+
+  int not_owned;
+  ASSERT_EQ_U(
+    libd_concurrent_pool_allocator_free(cpa, &not_owned),
+    libd_invalid_pointer);
+
+  // everything must be reachable again once the magazine is flushed.
+  ASSERT_OK(libd_concurrent_pool_allocator_thread_flush(cpa));
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_OK(libd_concurrent_pool_allocator_alloc(cpa, (void**)&slots[i]));
+  }
+
+  ASSERT_OK(libd_concurrent_pool_allocator_destroy(cpa));
+}
+
+TEST(concurrent_pool_allocator_rejects_unallocated)
+{
+  const u32 max_allocations = 64;
+  libd_concurrent_pool_allocator_h* cpa;
+  ASSERT_OK(
+    libd_concurrent_pool_allocator_create(&cpa, max_allocations, 8, 8, 4));
+
+  // the first refill hands out 2 slots, so 32 slots on is in the pool but was
+  // never allocated.
+  u64* p;
+  ASSERT_OK(libd_concurrent_pool_allocator_alloc(cpa, (void**)&p));
+  ASSERT_EQ_U(
+    libd_concurrent_pool_allocator_free(cpa, p + 32), libd_invalid_pointer);
+  ASSERT_OK(libd_concurrent_pool_allocator_free(cpa, p));
+
+  // nothing was lost on the way back to the pool.
+  ASSERT_OK(libd_concurrent_pool_allocator_thread_flush(cpa));
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_OK(libd_concurrent_pool_allocator_alloc(cpa, (void**)&p));
+  }
+  ASSERT_EQ_U(
+    libd_concurrent_pool_allocator_alloc(cpa, (void**)&p), libd_no_memory);
+
+  ASSERT_OK(libd_concurrent_pool_allocator_destroy(cpa));
+}
+
+#define CPA_TEST_THREADS    4
+#define CPA_TEST_PER_THREAD 64
+#define CPA_TEST_ROUNDS     2000
+
+struct cpa_worker_args {
+  libd_concurrent_pool_allocator_h* cpa;
+  uintptr_t id;
+  bool failed;
+};
+
+static void*
+_cpa_worker(void* arg)
+{
+  struct cpa_worker_args* args = arg;
+  uintptr_t* held[CPA_TEST_PER_THREAD];
+
+  for (u32 round = 0; round < CPA_TEST_ROUNDS; round += 1) {
+    for (u32 i = 0; i < CPA_TEST_PER_THREAD; i += 1) {
+      void** out = (void**)&held[i];
+      if (libd_concurrent_pool_allocator_alloc(args->cpa, out) != libd_ok) {
+        args->failed = true;
+        return NULL;
+      }
+      *held[i] = args->id;
+    }
+    for (u32 i = 0; i < CPA_TEST_PER_THREAD; i += 1) {
+      // another thread holding the same slot would have overwritten it.
+      if (*held[i] != args->id) {
+        args->failed = true;
+      }
+      libd_concurrent_pool_allocator_free(args->cpa, held[i]);
+    }
+  }
+
+  return NULL;
+}
+
+TEST(concurrent_pool_allocator_threads_never_share_slots)
+{
+  // room for every thread's working set plus a full magazine each.
+  const u32 magazine_size = 16;
+  const u32 max_allocations =
+    CPA_TEST_THREADS * (CPA_TEST_PER_THREAD + magazine_size);
+
+  libd_concurrent_pool_allocator_h* cpa;
+  ASSERT_OK(libd_concurrent_pool_allocator_create(
+    &cpa, max_allocations, sizeof(uintptr_t), 8, magazine_size));
+
+  pthread_t threads[CPA_TEST_THREADS];
+  struct cpa_worker_args args[CPA_TEST_THREADS];
+  for (uintptr_t i = 0; i < CPA_TEST_THREADS; i += 1) {
+    args[i] = (struct cpa_worker_args){ .cpa = cpa, .id = i, .failed = false };
+    ASSERT_OK(pthread_create(&threads[i], NULL, _cpa_worker, &args[i]));
+  }
+
+  for (u32 i = 0; i < CPA_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+    ASSERT_FALSE(args[i].failed);
+  }
+
+  // exited threads return their magazines, so the whole pool is available.
+  void* p;
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_OK(libd_concurrent_pool_allocator_alloc(cpa, &p));
+  }
+
+  ASSERT_OK(libd_concurrent_pool_allocator_destroy(cpa));
+}
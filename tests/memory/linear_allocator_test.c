@@ -1,14 +1,56 @@
 #include "../../include/libd/memory.h"
 #include "../../include/libd/testing.h"
 #include "../../include/libd/utils/align_compat.h"
+#include "../../src/memory/internal/helpers.h"
 
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 static const size_t DEFAULT_CAPACITY = 128;
 
+// Arena space taken up by one allocation, including the redzone that follows
+// it in memory_debug builds.
+static size_t
+helper_linear_span(
+  size_t size,
+  size_t alignment)
+{
+#ifdef LIBD_MEMORY_DEBUG
+  size += LIBD_MEMORY_REDZONE_SIZE;
+#endif
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+#ifdef LIBD_MEMORY_DEBUG
+// Whether a debug build released [ptr, ptr + size) with the given pattern.
+// Under ASan the region is checked for poisoning instead, since reading it
+// would be reported.
+static bool
+helper_released(
+  const u8* ptr,
+  size_t size,
+  u8 pattern)
+{
+  for (size_t i = 0; i < size; i += 1) {
+  #ifdef LIBD_HAS_ASAN
+    (void)pattern;
+    if (!__asan_address_is_poisoned(ptr + i)) {
+      return false;
+    }
+  #else
+    if (ptr[i] != pattern) {
+      return false;
+    }
+  #endif
+  }
+
+  return true;
+}
+#endif
+
 static libd_linear_allocator_h*
 helper_create_linear_allocator(
   u32 reserve,
@@ -102,7 +144,7 @@ TEST(linear_allocator_single_size)
   const u32 cap           = 32;
   const size_t alloc_size = sizeof(struct hex_hex);
   const u8 align          = 2;
-  const size_t num_loops  = reserve / alloc_size;
+  const size_t num_loops  = reserve / helper_linear_span(alloc_size, align);
 
   libd_linear_allocator_h* la =
     helper_create_linear_allocator(cap, reserve, align);
@@ -178,3 +220,441 @@ TEST(linear_allocator_variable_size_alignment_one)
 
   ASSERT_OK(libd_linear_allocator_destroy(la));
 }
+
+TEST(linear_allocator_alloc_fast)
+{
+  const u32 reserve = 64 * KiB;
+  const u32 cap     = 64;
+  const u8 align    = 8;
+
+  libd_linear_allocator_h* la =
+    helper_create_linear_allocator(reserve, cap, align);
+
+  // the inline path agrees with the out-of-line one, including across
+  // growth of the committed region.
+  void* prev;
+  void* p;
+  ASSERT_OK(libd_linear_allocator_alloc_fast(la, &prev, 3));
+  for (u32 i = 0; i < 2 * KiB; i += 1) {
+    if (i % 2 == 0) {
+      ASSERT_OK(libd_linear_allocator_alloc_fast(la, &p, 13));
+    } else {
+      ASSERT_OK(libd_linear_allocator_alloc(la, &p, 13));
+    }
+    ASSERT_EQ_U((uptr)p % align, 0);
+    ASSERT_EQ_U(
+      (uptr)p - (uptr)prev,
+      helper_linear_span(i == 0 ? 3 : 13, align));
+    memset(p, 0xAB, 13);
+    prev = p;
+  }
+
+  size_t bytes_free;
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_EQ_U(bytes_free % align, 0);
+
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc_fast(la, &p, reserve), libd_no_memory);
+
+  ASSERT_OK(libd_linear_allocator_reset(la));
+  ASSERT_OK(libd_linear_allocator_alloc_fast(la, &p, 1));
+  ASSERT_OK(libd_linear_allocator_alloc_fast(la, &p, 1));
+  ASSERT_EQ_U((uptr)p % align, 0);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_alloc_aligned)
+{
+  const u32 page_size = sysconf(_SC_PAGE_SIZE);
+  libd_linear_allocator_h* la =
+    helper_create_linear_allocator(64 * KiB, 64, 1);
+
+  void* p;
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc_aligned(la, &p, 8, 0), libd_invalid_alignment);
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc_aligned(la, &p, 8, 48), libd_invalid_alignment);
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc_aligned(la, &p, 8, page_size * 2),
+    libd_invalid_alignment);
+
+  // byte-packed strings interleaved with cache line and page aligned buffers.
+  u32 alignments[] = { 64, 256, page_size, 16, 64 };
+  void* prev;
+  ASSERT_OK(libd_linear_allocator_alloc(la, &prev, 3));
+  for (u32 i = 0; i < ARR_LEN(alignments); i += 1) {
+    ASSERT_OK(libd_linear_allocator_alloc_aligned(la, &p, 100, alignments[i]));
+    ASSERT_EQ_U((uptr)p % alignments[i], 0);
+    ASSERT_TRUE((uptr)p >= (uptr)prev + 3);
+    memset(p, 0xAB, 100);
+
+    ASSERT_OK(libd_linear_allocator_alloc(la, &prev, 3));
+    ASSERT_EQ_PTR(prev, (u8*)p + helper_linear_span(100, 1));
+  }
+
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc_aligned(la, &p, 64 * KiB, 64), libd_no_memory);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+static size_t
+helper_resident_pages(
+  void* start,
+  size_t size)
+{
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  size_t n_pages         = size / page_size;
+  unsigned char vec[256];
+  ASSERT_TRUE(n_pages <= sizeof(vec));
+  ASSERT_OK(mincore(start, size, vec));
+
+  size_t resident = 0;
+  for (size_t i = 0; i < n_pages; i += 1) {
+    resident += vec[i] & 1;
+  }
+  return resident;
+}
+
+TEST(linear_allocator_trim)
+{
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  const u32 spike        = 64 * page_size;
+
+  libd_linear_allocator_h* la =
+    helper_create_linear_allocator(128 * page_size, page_size, 16);
+
+  // a spike commits and touches 64 pages.
+  void* small;
+  void* big;
+  ASSERT_OK(libd_linear_allocator_alloc(la, &small, 32));
+  memset(small, 0xAB, 32);
+  ASSERT_OK(libd_linear_allocator_alloc(la, &big, spike));
+  memset(big, 0xAB, spike);
+  // well past the 4 pages kept on reset below.
+  uptr tail_addr = (uptr)big + 8 * page_size;
+  void* spike_tail =
+    (void*)((tail_addr + page_size - 1) & ~(uptr)(page_size - 1));
+  ASSERT_EQ_U(helper_resident_pages(spike_tail, 32 * page_size), 32);
+
+  // trimming keeps everything below the head.
+  size_t before;
+  size_t after;
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &before));
+  ASSERT_OK(libd_linear_allocator_trim(la, 0));
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &after));
+  ASSERT_TRUE(after <= before);
+  ASSERT_EQ_U(((u8*)big)[spike - 1], 0xAB);
+
+  // a reset with trimming enabled drops the spike from the resident set.
+  ASSERT_OK(libd_linear_allocator_set_trim_on_reset(la, 4 * page_size));
+  ASSERT_OK(libd_linear_allocator_reset(la));
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &after));
+  ASSERT_TRUE(after < 5 * page_size);
+  ASSERT_EQ_U(helper_resident_pages(spike_tail, 32 * page_size), 0);
+#ifndef LIBD_MEMORY_DEBUG
+  // debug builds overwrite released memory, kept or not.
+  ASSERT_EQ_U(((u8*)small)[31], 0xAB);
+#endif
+
+  // trimmed pages are committed again on demand.
+  ASSERT_OK(libd_linear_allocator_alloc(la, &small, 32));
+  ASSERT_OK(libd_linear_allocator_alloc(la, &big, spike));
+  memset(big, 0xCD, spike);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_64bit_sizes)
+{
+  if (sizeof(usize) < 8) {
+    return;
+  }
+
+  const usize reserve = (usize)8 * GiB;
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create(&la, reserve, 64 * KiB, 16));
+
+  // commits past 4 GiB without touching the pages in between.
+  u8* big;
+  u8* small;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&big, (usize)5 * GiB));
+  big[0]                  = 1;
+  big[(usize)5 * GiB - 1] = 2;
+  ASSERT_OK(libd_linear_allocator_alloc_fast(la, (void**)&small, 16));
+  ASSERT_EQ_PTR(small, big + helper_linear_span((usize)5 * GiB, 16));
+  small[15] = 3;
+
+  size_t bytes_free;
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_TRUE(bytes_free < reserve - (usize)5 * GiB);
+
+  // sizes that would wrap the head are refused instead.
+  void* p;
+  ASSERT_EQ_U(libd_linear_allocator_alloc(la, &p, SIZE_MAX), libd_no_memory);
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc_fast(la, &p, SIZE_MAX - 1), libd_no_memory);
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc(la, &p, (usize)4 * GiB), libd_no_memory);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_chained)
+{
+  struct libd_linear_allocator_options options = {
+    .chained        = true,
+    .max_block_size = 16 * KiB,
+  };
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create_with_options(
+    &la, 4 * KiB, 4 * KiB, 8, &options));
+
+  // fills the reservation, then moves on to a new block instead of failing.
+  const size_t fill = 4 * KiB - helper_linear_span(0, 8);
+  u8* first;
+  u8* chained;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&first, fill));
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&chained, 8));
+  ASSERT_TRUE(chained < first || chained >= first + 4 * KiB);
+  chained[7] = 1;
+
+  libd_linear_allocator_savepoint_h sp;
+  ASSERT_OK(libd_linear_allocator_set_savepoint(la, &sp));
+
+  // larger than the block cap: gets a block of its own.
+  u8* big;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&big, 64 * KiB));
+  big[0]            = 2;
+  big[64 * KiB - 1] = 3;
+  u8* aligned;
+  ASSERT_OK(
+    libd_linear_allocator_alloc_aligned(la, (void**)&aligned, 4 * KiB, 256));
+  ASSERT_EQ_U((uptr)aligned % 256, 0);
+  aligned[4 * KiB - 1] = 4;
+  for (u32 i = 0; i < 64; i += 1) {
+    u8* p;
+    ASSERT_OK(libd_linear_allocator_alloc_fast(la, (void**)&p, 512));
+    p[511] = (u8)i;
+  }
+
+  // unwinds across blocks to right after the savepoint.
+  u8* p;
+  ASSERT_OK(libd_linear_allocator_restore_savepoint(la, &sp));
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&p, 8));
+  ASSERT_EQ_PTR(p, chained + helper_linear_span(8, 8));
+
+  // reset releases every chained block and starts over in the first one.
+  ASSERT_OK(libd_linear_allocator_reset(la));
+  size_t bytes_free;
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_EQ_U(bytes_free, 4 * KiB);
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&p, 8));
+  ASSERT_EQ_PTR(p, first);
+
+  ASSERT_EQ_U(
+    libd_linear_allocator_alloc(la, (void**)&p, SIZE_MAX), libd_no_memory);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+
+  // without the option the reservation stays a hard limit.
+  ASSERT_OK(libd_linear_allocator_create(&la, 4 * KiB, 4 * KiB, 8));
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&first, fill));
+  ASSERT_EQ_U(libd_linear_allocator_alloc(la, (void**)&p, 8), libd_no_memory);
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_commit_ahead)
+{
+  const usize page = sysconf(_SC_PAGE_SIZE);
+  struct libd_linear_allocator_options options = {
+    .commit_ahead_bytes = 16 * page,
+  };
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create_with_options(
+    &la, 1024 * page, page, 8, &options));
+
+  // growth commits and prefaults a fixed step past the allocation.
+  u8* p;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&p, 2 * page));
+  size_t bytes_free;
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_TRUE(bytes_free >= 16 * page);
+  u8* first_page = (u8*)(((uptr)p + page - 1) & ~(uptr)(page - 1));
+  ASSERT_EQ_U(helper_resident_pages(first_page, 17 * page), 17);
+
+  // an explicit prefault readies memory without moving the head.
+  ASSERT_OK(libd_linear_allocator_reset(la));
+  ASSERT_OK(libd_linear_allocator_prefault(la, 64 * page));
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_TRUE(bytes_free >= 64 * page);
+  ASSERT_EQ_U(helper_resident_pages(first_page, 63 * page), 63);
+  u8* q;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&q, 8));
+  ASSERT_EQ_PTR(q, p);
+
+  // clamped to the reservation.
+  ASSERT_OK(libd_linear_allocator_prefault(la, SIZE_MAX));
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_TRUE(bytes_free >= 1024 * page - 8);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_resize)
+{
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create(&la, 64 * KiB, 4 * KiB, 8));
+
+  // a NULL pointer allocates.
+  char* s;
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&s, NULL, 0, 5));
+  memcpy(s, "hello", 5);
+
+  // the newest allocation grows in place, past the committed size too.
+  char* grown;
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&grown, s, 5, 16 * KiB));
+  ASSERT_EQ_PTR(grown, s);
+  size_t bytes_free;
+  ASSERT_OK(libd_linear_allocator_bytes_free(la, &bytes_free));
+  ASSERT_TRUE(bytes_free < 64 * KiB - 16 * KiB);
+
+  // and shrinks in place, giving the space back.
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&grown, s, 16 * KiB, 6));
+  ASSERT_EQ_PTR(grown, s);
+  char* next;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&next, 8));
+  ASSERT_EQ_PTR(next, s + helper_linear_span(6, 8));
+
+  // anything else is copied to a new allocation when it grows.
+  char* moved;
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&moved, s, 5, 32));
+  ASSERT_TRUE(moved > next);
+  ASSERT_TRUE(memcmp(moved, "hello", 5) == 0);
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&next, next, 8, 4));
+  ASSERT_EQ_PTR(next, s + helper_linear_span(6, 8));
+
+  // beyond the reservation the allocation is left untouched.
+  ASSERT_EQ_U(
+    libd_linear_allocator_resize(la, (void**)&grown, moved, 32, 128 * KiB),
+    libd_no_memory);
+  ASSERT_EQ_U(
+    libd_linear_allocator_resize(NULL, (void**)&grown, moved, 32, 64),
+    libd_invalid_parameter);
+  ASSERT_EQ_U(
+    libd_linear_allocator_resize(la, NULL, moved, 32, 64),
+    libd_invalid_parameter);
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+
+  // a chained allocator moves the newest allocation to a new block once the
+  // current one is full.
+  struct libd_linear_allocator_options options = { .chained = true };
+  ASSERT_OK(libd_linear_allocator_create_with_options(
+    &la, 4 * KiB, 4 * KiB, 8, &options));
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&s, NULL, 0, 5));
+  memcpy(s, "hello", 5);
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&moved, s, 5, 8 * KiB));
+  ASSERT_NE_PTR(moved, s);
+  ASSERT_TRUE(memcmp(moved, "hello", 5) == 0);
+  moved[8 * KiB - 1] = 1;
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_stats)
+{
+  struct libd_linear_allocator_options options = {
+    .chained        = true,
+    .max_block_size = 16 * KiB,
+  };
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create_with_options(
+    &la, 8 * KiB, 4 * KiB, 8, &options));
+
+  struct libd_linear_allocator_stats stats;
+  enum libd_result result = libd_linear_allocator_get_stats(la, &stats);
+  if (result == libd_mem_not_implemented) {
+    // built without the memory_stats option.
+    ASSERT_OK(libd_linear_allocator_destroy(la));
+    return;
+  }
+  ASSERT_OK(result);
+  ASSERT_EQ_U(stats.alloc_count, 0);
+  ASSERT_EQ_U(stats.chained_blocks, 0);
+
+  void* p;
+  ASSERT_OK(libd_linear_allocator_alloc(la, &p, 3));
+  ASSERT_OK(libd_linear_allocator_alloc_aligned(la, &p, 8, 64));
+  ASSERT_OK(libd_linear_allocator_alloc(la, &p, 6 * KiB));
+  ASSERT_OK(libd_linear_allocator_alloc_fast(la, &p, 8));
+
+  ASSERT_OK(libd_linear_allocator_get_stats(la, &stats));
+  ASSERT_EQ_U(stats.alloc_count, 4);
+  ASSERT_EQ_U(stats.bytes_requested, 3 + 8 + 6 * KiB + 8);
+  ASSERT_TRUE(stats.bytes_consumed > stats.bytes_requested);
+  ASSERT_TRUE(stats.peak_head_index >= 6 * KiB);
+  ASSERT_EQ_U(stats.grow_count, 1);
+  ASSERT_EQ_U(stats.chained_blocks, 0);
+
+  // the new block's memory is counted, and its head makes the new peak.
+  ASSERT_OK(libd_linear_allocator_alloc(la, &p, 8 * KiB));
+  ASSERT_OK(libd_linear_allocator_get_stats(la, &stats));
+  ASSERT_EQ_U(stats.chained_blocks, 1);
+  ASSERT_EQ_U(stats.peak_head_index, helper_linear_span(8 * KiB, 8));
+  ASSERT_TRUE(stats.committed_bytes >= 8 * KiB + 16 * KiB);
+
+  ASSERT_OK(libd_linear_allocator_reset(la));
+  ASSERT_OK(libd_linear_allocator_get_stats(la, &stats));
+  ASSERT_EQ_U(stats.chained_blocks, 0);
+  ASSERT_EQ_U(stats.peak_head_index, helper_linear_span(8 * KiB, 8));
+  ASSERT_TRUE(stats.committed_bytes < 16 * KiB);
+
+  ASSERT_EQ_U(
+    libd_linear_allocator_get_stats(la, NULL), libd_invalid_parameter);
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+}
+
+TEST(linear_allocator_debug)
+{
+#ifndef LIBD_MEMORY_DEBUG
+  // built without the memory_debug option.
+  return;
+#else
+  libd_linear_allocator_h* la;
+  ASSERT_OK(libd_linear_allocator_create(&la, 64 * KiB, 4 * KiB, 8));
+
+  // allocations are kept apart by a guarded redzone.
+  u8* a;
+  u8* b;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&a, 10));
+  ASSERT_OK(libd_linear_allocator_alloc_aligned(la, (void**)&b, 10, 64));
+  ASSERT_TRUE(b >= a + 10 + LIBD_MEMORY_REDZONE_SIZE);
+  ASSERT_TRUE(
+    helper_released(a + 10, LIBD_MEMORY_REDZONE_SIZE, LIBD_MEMORY_GUARD_BYTE));
+  memset(a, 1, 10);
+  memset(b, 2, 10);
+
+  // shrinking in place moves the redzone down.
+  ASSERT_OK(libd_linear_allocator_resize(la, (void**)&b, b, 10, 4));
+  ASSERT_TRUE(
+    helper_released(b + 4, LIBD_MEMORY_REDZONE_SIZE, LIBD_MEMORY_GUARD_BYTE));
+  ASSERT_EQ_U(b[3], 2);
+
+  // restoring a savepoint releases everything after it.
+  libd_linear_allocator_savepoint_h sp;
+  ASSERT_OK(libd_linear_allocator_set_savepoint(la, &sp));
+  u8* c;
+  ASSERT_OK(libd_linear_allocator_alloc(la, (void**)&c, 32));
+  memset(c, 3, 32);
+  ASSERT_OK(libd_linear_allocator_restore_savepoint(la, &sp));
+  ASSERT_TRUE(helper_released(c, 32, LIBD_MEMORY_FREED_BYTE));
+
+  // and a reset releases everything.
+  ASSERT_OK(libd_linear_allocator_reset(la));
+  ASSERT_TRUE(helper_released(a, 10, LIBD_MEMORY_FREED_BYTE));
+  ASSERT_TRUE(helper_released(b, 4, LIBD_MEMORY_FREED_BYTE));
+
+  ASSERT_OK(libd_linear_allocator_destroy(la));
+#endif
+}
@@ -0,0 +1,190 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/testing.h"
+#include "../../include/libd/utils/align_compat.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+TEST(lockfree_pool_allocator_invalid_params)
+{
+  struct {
+    const char* name;
+    u32 input_max_allocations;
+    u32 input_bytes_per_allocation;
+    u8 input_alignment;
+    enum libd_result expected;
+  } tcs[] = {
+    {
+      .name                       = "valid\0",
+      .input_max_allocations      = 16,
+      .input_bytes_per_allocation = 1,
+      .input_alignment            = 1,
+      .expected                   = libd_ok,
+    },
+    {
+      .name                       = "zero max allocations\0",
+      .input_max_allocations      = 0,
+      .input_bytes_per_allocation = 8,
+      .input_alignment            = 8,
+      .expected                   = libd_invalid_parameter,
+    },
+    {
+      .name                       = "zero bytes per allocation\0",
+      .input_max_allocations      = 16,
+      .input_bytes_per_allocation = 0,
+      .input_alignment            = 8,
+      .expected                   = libd_invalid_parameter,
+    },
+    {
+      .name                       = "too big alignment\0",
+      .input_max_allocations      = 16,
+      .input_bytes_per_allocation = 8,
+      .input_alignment            = LIBD_MAX_ALIGN * 2,
+      .expected                   = libd_invalid_alignment,
+    },
+  };
+
+  ASSERT_EQ_U(
+    libd_lockfree_pool_allocator_create(NULL, 8, 8, 8), libd_invalid_parameter);
+
+  for (size_t i = 0; i < ARR_LEN(tcs); i += 1) {
+    libd_lockfree_pool_allocator_h* pa = NULL;
+    ASSERT_EQ_U(
+      libd_lockfree_pool_allocator_create(
+        &pa,
+        tcs[i].input_max_allocations,
+        tcs[i].input_bytes_per_allocation,
+        tcs[i].input_alignment),
+      tcs[i].expected,
+      "name=%s\n",
+      tcs[i].name);
+
+    if (pa != NULL) {
+      ASSERT_OK(libd_lockfree_pool_allocator_destroy(pa));
+    }
+  }
+}
+
+TEST(lockfree_pool_allocator_lifo_reuse)
+{
+  libd_lockfree_pool_allocator_h* pa;
+  ASSERT_OK(libd_lockfree_pool_allocator_create(&pa, 4, 8, 8));
+
+  void* slots[4];
+  for (u32 i = 0; i < 4; i += 1) {
+    ASSERT_OK(libd_lockfree_pool_allocator_alloc(pa, &slots[i]));
+  }
+  void* extra;
+  ASSERT_EQ_U(libd_lockfree_pool_allocator_alloc(pa, &extra), libd_no_memory);
+
+  int not_owned;
+  ASSERT_EQ_U(
+    libd_lockfree_pool_allocator_free(pa, &not_owned), libd_invalid_pointer);
+  ASSERT_EQ_U(
+    libd_lockfree_pool_allocator_free(pa, (u8*)slots[0] + 1),
+    libd_invalid_pointer);
+
+  // the most recently freed slot is handed out first.
+  ASSERT_OK(libd_lockfree_pool_allocator_free(pa, slots[1]));
+  ASSERT_OK(libd_lockfree_pool_allocator_free(pa, slots[3]));
+  ASSERT_OK(libd_lockfree_pool_allocator_alloc(pa, &extra));
+  ASSERT_EQ_PTR(extra, slots[3]);
+  ASSERT_OK(libd_lockfree_pool_allocator_alloc(pa, &extra));
+  ASSERT_EQ_PTR(extra, slots[1]);
+
+  ASSERT_OK(libd_lockfree_pool_allocator_reset(pa));
+  for (u32 i = 0; i < 4; i += 1) {
+    ASSERT_OK(libd_lockfree_pool_allocator_alloc(pa, &slots[i]));
+  }
+
+  ASSERT_OK(libd_lockfree_pool_allocator_destroy(pa));
+}
+
+#define LFPA_TEST_THREADS    4
+#define LFPA_TEST_PER_THREAD 32
+#define LFPA_TEST_ROUNDS     5000
+
+struct lfpa_worker_args {
+  libd_lockfree_pool_allocator_h* pa;
+  uintptr_t id;
+  void** to_free;
+  u32 to_free_count;
+  bool failed;
+};
+
+static void*
+_lfpa_churn_worker(void* arg)
+{
+  struct lfpa_worker_args* args = arg;
+  uintptr_t* held[LFPA_TEST_PER_THREAD];
+
+  // free the share of slots allocated by the main thread first.
+  for (u32 i = 0; i < args->to_free_count; i += 1) {
+    void* p = args->to_free[i];
+    if (libd_lockfree_pool_allocator_free(args->pa, p) != libd_ok) {
+      args->failed = true;
+    }
+  }
+
+  for (u32 round = 0; round < LFPA_TEST_ROUNDS; round += 1) {
+    for (u32 i = 0; i < LFPA_TEST_PER_THREAD; i += 1) {
+      void** out = (void**)&held[i];
+      if (libd_lockfree_pool_allocator_alloc(args->pa, out) != libd_ok) {
+        args->failed = true;
+        return NULL;
+      }
+      *held[i] = args->id;
+    }
+    for (u32 i = 0; i < LFPA_TEST_PER_THREAD; i += 1) {
+      if (*held[i] != args->id) {
+        args->failed = true;
+      }
+      libd_lockfree_pool_allocator_free(args->pa, held[i]);
+    }
+  }
+
+  return NULL;
+}
+
+TEST(lockfree_pool_allocator_cross_thread_free)
+{
+  const u32 max_allocations = LFPA_TEST_THREADS * LFPA_TEST_PER_THREAD;
+  libd_lockfree_pool_allocator_h* pa;
+  ASSERT_OK(libd_lockfree_pool_allocator_create(
+    &pa, max_allocations, sizeof(uintptr_t), 8));
+
+  void* all[LFPA_TEST_THREADS * LFPA_TEST_PER_THREAD];
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_OK(libd_lockfree_pool_allocator_alloc(pa, &all[i]));
+  }
+
+  pthread_t threads[LFPA_TEST_THREADS];
+  struct lfpa_worker_args args[LFPA_TEST_THREADS];
+  for (uintptr_t i = 0; i < LFPA_TEST_THREADS; i += 1) {
+    args[i] = (struct lfpa_worker_args){
+      .pa            = pa,
+      .id            = i,
+      .to_free       = &all[i * LFPA_TEST_PER_THREAD],
+      .to_free_count = LFPA_TEST_PER_THREAD,
+      .failed        = false,
+    };
+    ASSERT_OK(
+      pthread_create(&threads[i], NULL, _lfpa_churn_worker, &args[i]));
+  }
+
+  for (u32 i = 0; i < LFPA_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+    ASSERT_FALSE(args[i].failed);
+  }
+
+  // every slot made it back exactly once.
+  for (u32 i = 0; i < max_allocations; i += 1) {
+    ASSERT_OK(libd_lockfree_pool_allocator_alloc(pa, &all[i]));
+  }
+  void* extra;
+  ASSERT_EQ_U(libd_lockfree_pool_allocator_alloc(pa, &extra), libd_no_memory);
+
+  ASSERT_OK(libd_lockfree_pool_allocator_destroy(pa));
+}
@@ -3,6 +3,7 @@
 #include "../../include/libd/utils/align_compat.h"
 
 #include <stdbool.h>
+#include <string.h>
 
 static libd_pool_allocator_h*
 helper_pool_allocator_create(
@@ -70,7 +71,7 @@ TEST(pool_allocator_invalid_params)
   const char* name;
   for (size_t i = 0; i < num_tests; i += 1) {
     enum libd_result result;
-    libd_pool_allocator_h* pa;
+    libd_pool_allocator_h* pa = NULL;
     name = tcs[i].name;
 
     result = libd_pool_allocator_create(
@@ -81,7 +82,9 @@ TEST(pool_allocator_invalid_params)
 
     ASSERT_EQ_U(result, tcs[i].expected, "name=%s\n", tcs[i].name);
 
-    libd_pool_allocator_destroy(pa);
+    if (pa != NULL) {
+      ASSERT_OK(libd_pool_allocator_destroy(pa));
+    }
   }
 }
 
@@ -94,3 +97,383 @@ TEST(pool_allocator_allocating)
   u32 bytes_per_allocation = 4;
   u8 alignment             = LIBD_ALIGNOF(struct item);
 }
+
+TEST(pool_allocator_lifo_free_order)
+{
+  libd_pool_allocator_h* pa = helper_pool_allocator_create(8, 8, 8);
+
+  void* slots[8];
+  for (u32 i = 0; i < 8; i += 1) {
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &slots[i]));
+  }
+  void* p;
+  ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &p), libd_no_memory);
+
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[2]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[6]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[4]));
+
+  // most recently freed first.
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+  ASSERT_EQ_PTR(p, slots[4]);
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+  ASSERT_EQ_PTR(p, slots[6]);
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+  ASSERT_EQ_PTR(p, slots[2]);
+  ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &p), libd_no_memory);
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+}
+
+TEST(pool_allocator_address_ordered_free_order)
+{
+  struct libd_pool_allocator_options options = {
+    .free_order = libd_pool_free_address_ordered,
+  };
+  libd_pool_allocator_h* pa;
+  ASSERT_OK(libd_pool_allocator_create_with_options(&pa, 8, 8, 8, &options));
+
+  void* slots[8];
+  for (u32 i = 0; i < 8; i += 1) {
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &slots[i]));
+  }
+
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[6]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[2]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[7]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[4]));
+
+  // lowest address first, regardless of free order.
+  void* p;
+  u32 expected[] = { 2, 4, 6, 7 };
+  for (u32 i = 0; i < ARR_LEN(expected); i += 1) {
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+    ASSERT_EQ_PTR(p, slots[expected[i]]);
+  }
+  ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &p), libd_no_memory);
+
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[3]));
+  ASSERT_EQ_U(libd_pool_allocator_free(pa, slots[3]), libd_invalid_free);
+
+  options.free_order = 42;
+  libd_pool_allocator_h* invalid = NULL;
+  ASSERT_EQ_U(
+    libd_pool_allocator_create_with_options(&invalid, 8, 8, 8, &options),
+    libd_invalid_parameter);
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+}
+
+TEST(pool_allocator_lazy_initialization)
+{
+  enum libd_pool_allocator_free_order orders[] = {
+    libd_pool_free_lifo,
+    libd_pool_free_address_ordered,
+  };
+
+  for (u32 o = 0; o < ARR_LEN(orders); o += 1) {
+    struct libd_pool_allocator_options options = { .free_order = orders[o] };
+    libd_pool_allocator_h* pa;
+    ASSERT_OK(
+      libd_pool_allocator_create_with_options(&pa, 1 << 20, 8, 8, &options));
+
+    // untouched slots are handed out in address order.
+    void* slots[4];
+    for (u32 i = 0; i < ARR_LEN(slots); i += 1) {
+      ASSERT_OK(libd_pool_allocator_alloc(pa, &slots[i]));
+      ASSERT_EQ_PTR(slots[i], (u8*)slots[0] + i * 8);
+    }
+
+    // a slot past the high-water mark was never handed out.
+    ASSERT_EQ_U(
+      libd_pool_allocator_free(pa, (u8*)slots[3] + 8), libd_invalid_pointer);
+
+    // freed slots are reused before new ones are touched.
+    void* p;
+    ASSERT_OK(libd_pool_allocator_free(pa, slots[1]));
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+    ASSERT_EQ_PTR(p, slots[1]);
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+    ASSERT_EQ_PTR(p, (u8*)slots[3] + 8);
+
+    ASSERT_OK(libd_pool_allocator_free(pa, slots[2]));
+    ASSERT_OK(libd_pool_allocator_reset(pa));
+    ASSERT_EQ_U(libd_pool_allocator_free(pa, slots[0]), libd_invalid_pointer);
+    for (u32 i = 0; i < ARR_LEN(slots); i += 1) {
+      ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+      ASSERT_EQ_PTR(p, slots[i]);
+    }
+
+    ASSERT_OK(libd_pool_allocator_destroy(pa));
+  }
+}
+
+TEST(pool_allocator_mmap_backing)
+{
+  struct {
+    const char* name;
+    struct libd_pool_allocator_options options;
+    enum libd_result expected;
+  } tcs[] = {
+    {
+      .name     = "mmap\0",
+      .options  = { .backing = libd_pool_backing_mmap },
+      .expected = libd_ok,
+    },
+    {
+      .name     = "mmap address ordered\0",
+      .options  = {
+        .free_order = libd_pool_free_address_ordered,
+        .backing    = libd_pool_backing_mmap,
+      },
+      .expected = libd_ok,
+    },
+    {
+      .name     = "transparent huge pages\0",
+      .options  = {
+        .backing    = libd_pool_backing_mmap,
+        .huge_pages = libd_pool_huge_pages_transparent,
+      },
+      .expected = libd_ok,
+    },
+    {
+      .name     = "explicit huge pages\0",
+      .options  = {
+        .backing    = libd_pool_backing_mmap,
+        .huge_pages = libd_pool_huge_pages_explicit,
+      },
+      .expected = libd_ok,
+    },
+    {
+      .name     = "huge pages on the heap\0",
+      .options  = { .huge_pages = libd_pool_huge_pages_transparent },
+      .expected = libd_invalid_parameter,
+    },
+    {
+      .name     = "invalid backing\0",
+      .options  = { .backing = 42 },
+      .expected = libd_invalid_parameter,
+    },
+  };
+
+  // spans several commits of the reservation, with and without huge pages.
+  const u32 max_allocations = 1 << 16;
+  const u32 bytes_per_alloc = 64;
+
+  for (size_t i = 0; i < ARR_LEN(tcs); i += 1) {
+    libd_pool_allocator_h* pa = NULL;
+    ASSERT_EQ_U(
+      libd_pool_allocator_create_with_options(
+        &pa, max_allocations, bytes_per_alloc, 8, &tcs[i].options),
+      tcs[i].expected,
+      "name=%s\n",
+      tcs[i].name);
+    if (pa == NULL) {
+      continue;
+    }
+
+    void* first;
+    void* p;
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &first));
+    memset(first, 0xAB, bytes_per_alloc);
+    for (u32 j = 1; j < max_allocations; j += 1) {
+      ASSERT_OK(libd_pool_allocator_alloc(pa, &p), "name=%s\n", tcs[i].name);
+      ASSERT_EQ_PTR(p, (u8*)first + (usize)j * bytes_per_alloc);
+      memset(p, 0xAB, bytes_per_alloc);
+    }
+    ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &p), libd_no_memory);
+
+    ASSERT_OK(libd_pool_allocator_free(pa, p));
+    ASSERT_OK(libd_pool_allocator_reset(pa));
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+    ASSERT_EQ_PTR(p, first);
+
+    ASSERT_OK(libd_pool_allocator_destroy(pa));
+  }
+}
+
+TEST(pool_allocator_growable)
+{
+  struct libd_pool_allocator_options options = { .growable = true };
+  libd_pool_allocator_h* pa;
+  ASSERT_OK(libd_pool_allocator_create_with_options(&pa, 4, 8, 8, &options));
+
+  // 4 + 4 + 8 + 16: three chunks chained past the first.
+  void* slots[32];
+  for (u32 i = 0; i < ARR_LEN(slots); i += 1) {
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &slots[i]));
+    *(u32*)slots[i] = i;
+  }
+
+  // earlier slots never moved.
+  bool owns;
+  for (u32 i = 0; i < ARR_LEN(slots); i += 1) {
+    ASSERT_EQ_U(*(u32*)slots[i], i);
+    ASSERT_OK(libd_pool_allocator_owns(pa, slots[i], &owns));
+    ASSERT_TRUE(owns);
+  }
+  ASSERT_OK(libd_pool_allocator_owns(pa, (u8*)slots[20] + 1, &owns));
+  ASSERT_FALSE(owns);
+  int not_owned;
+  ASSERT_OK(libd_pool_allocator_owns(pa, &not_owned, &owns));
+  ASSERT_FALSE(owns);
+
+  // slots in any chunk are freed and reused.
+  void* p;
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[2]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[13]));
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[31]));
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+  ASSERT_EQ_PTR(p, slots[31]);
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+  ASSERT_EQ_PTR(p, slots[13]);
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+  ASSERT_EQ_PTR(p, slots[2]);
+
+  // reset keeps the chunks, so the same slots come back in order.
+  ASSERT_OK(libd_pool_allocator_reset(pa));
+  for (u32 i = 0; i < ARR_LEN(slots); i += 1) {
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+    ASSERT_EQ_PTR(p, slots[i]);
+  }
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+
+  libd_pool_allocator_h* invalid = NULL;
+  options.free_order = libd_pool_free_address_ordered;
+  ASSERT_EQ_U(
+    libd_pool_allocator_create_with_options(&invalid, 4, 8, 8, &options),
+    libd_invalid_parameter);
+  options.free_order = libd_pool_free_lifo;
+  options.backing    = libd_pool_backing_mmap;
+  ASSERT_EQ_U(
+    libd_pool_allocator_create_with_options(&invalid, 4, 8, 8, &options),
+    libd_invalid_parameter);
+}
+
+TEST(pool_allocator_batch)
+{
+  enum libd_pool_allocator_free_order orders[] = {
+    libd_pool_free_lifo,
+    libd_pool_free_address_ordered,
+  };
+
+  for (u32 o = 0; o < ARR_LEN(orders); o += 1) {
+    struct libd_pool_allocator_options options = { .free_order = orders[o] };
+    libd_pool_allocator_h* pa;
+    ASSERT_OK(libd_pool_allocator_create_with_options(&pa, 64, 8, 8, &options));
+
+    ASSERT_EQ_U(
+      libd_pool_allocator_alloc_n(pa, NULL, 4), libd_invalid_parameter);
+    ASSERT_EQ_U(
+      libd_pool_allocator_free_n(pa, NULL, 4), libd_invalid_parameter);
+
+    // a batch spanning the free list and the never-used slots.
+    void* first[48];
+    ASSERT_OK(libd_pool_allocator_alloc_n(pa, first, ARR_LEN(first)));
+    ASSERT_OK(libd_pool_allocator_free_n(pa, first, 16));
+
+    void* batch[16];
+    ASSERT_OK(libd_pool_allocator_alloc_n(pa, batch, ARR_LEN(batch)));
+    for (u32 i = 0; i < ARR_LEN(batch); i += 1) {
+      for (u32 j = i + 1; j < ARR_LEN(batch); j += 1) {
+        ASSERT_NE_PTR(batch[i], batch[j]);
+      }
+      for (u32 j = 16; j < ARR_LEN(first); j += 1) {
+        ASSERT_NE_PTR(batch[i], first[j]);
+      }
+    }
+
+    // all or nothing: 32 more would exceed the pool.
+    void* too_many[32];
+    void* p;
+    ASSERT_EQ_U(
+      libd_pool_allocator_alloc_n(pa, too_many, ARR_LEN(too_many)),
+      libd_no_memory);
+    ASSERT_OK(libd_pool_allocator_alloc_n(pa, too_many, 16));
+    ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &p), libd_no_memory);
+
+    // freeing stops at the first invalid pointer, keeping what came before.
+    int not_owned;
+    void* mixed[3] = { too_many[0], &not_owned, too_many[1] };
+    ASSERT_EQ_U(libd_pool_allocator_free_n(pa, mixed, 3), libd_invalid_pointer);
+    ASSERT_OK(libd_pool_allocator_alloc(pa, &p));
+    ASSERT_EQ_PTR(p, too_many[0]);
+    ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &p), libd_no_memory);
+
+    ASSERT_OK(libd_pool_allocator_destroy(pa));
+  }
+}
+
+TEST(pool_allocator_stats)
+{
+  libd_pool_allocator_h* pa;
+  ASSERT_OK(libd_pool_allocator_create(&pa, 4, 16, 8));
+
+  struct libd_pool_allocator_stats stats;
+  enum libd_result result = libd_pool_allocator_get_stats(pa, &stats);
+  if (result == libd_mem_not_implemented) {
+    // built without the memory_stats option.
+    ASSERT_OK(libd_pool_allocator_destroy(pa));
+    return;
+  }
+  ASSERT_OK(result);
+  ASSERT_EQ_U(stats.live_slots, 0);
+  ASSERT_EQ_U(stats.committed_bytes, 4 * 16);
+
+  void* slots[4];
+  ASSERT_OK(libd_pool_allocator_alloc(pa, &slots[0]));
+  ASSERT_OK(libd_pool_allocator_alloc_n(pa, &slots[1], 3));
+  void* extra;
+  ASSERT_EQ_U(libd_pool_allocator_alloc(pa, &extra), libd_no_memory);
+  ASSERT_EQ_U(libd_pool_allocator_alloc_n(pa, &extra, 1), libd_no_memory);
+  ASSERT_OK(libd_pool_allocator_free(pa, slots[0]));
+  ASSERT_OK(libd_pool_allocator_free_n(pa, &slots[1], 2));
+
+  ASSERT_OK(libd_pool_allocator_get_stats(pa, &stats));
+  ASSERT_EQ_U(stats.alloc_count, 4);
+  ASSERT_EQ_U(stats.free_count, 3);
+  ASSERT_EQ_U(stats.failed_alloc_count, 2);
+  ASSERT_EQ_U(stats.live_slots, 1);
+  ASSERT_EQ_U(stats.peak_live_slots, 4);
+
+  ASSERT_OK(libd_pool_allocator_reset(pa));
+  ASSERT_OK(libd_pool_allocator_get_stats(pa, &stats));
+  ASSERT_EQ_U(stats.live_slots, 0);
+  ASSERT_EQ_U(stats.peak_live_slots, 4);
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+}
+
+TEST(pool_allocator_debug)
+{
+#ifndef LIBD_MEMORY_DEBUG
+  // built without the memory_debug option.
+  return;
+#else
+  libd_pool_allocator_h* pa = helper_pool_allocator_create(4, 32, 8);
+
+  // a freed slot is released past the free list link in its first bytes.
+  u8* p;
+  u8* q;
+  ASSERT_OK(libd_pool_allocator_alloc(pa, (void**)&p));
+  ASSERT_OK(libd_pool_allocator_alloc(pa, (void**)&q));
+  memset(p, 1, 32);
+  memset(q, 2, 32);
+  ASSERT_OK(libd_pool_allocator_free(pa, p));
+  ASSERT_TRUE(helper_released(p + 8, 24, LIBD_MEMORY_FREED_BYTE));
+
+  // handed out again, it is usable.
+  u8* r;
+  ASSERT_OK(libd_pool_allocator_alloc(pa, (void**)&r));
+  ASSERT_EQ_PTR(r, p);
+  memset(r, 3, 32);
+
+  // a reset releases every slot.
+  ASSERT_OK(libd_pool_allocator_reset(pa));
+  ASSERT_TRUE(helper_released(q, 32, LIBD_MEMORY_FREED_BYTE));
+  ASSERT_TRUE(helper_released(r, 32, LIBD_MEMORY_FREED_BYTE));
+
+  ASSERT_OK(libd_pool_allocator_destroy(pa));
+#endif
+}
@@ -0,0 +1,205 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/testing.h"
+#include "../../include/libd/utils/align_compat.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+TEST(scratch_invalid_params)
+{
+  libd_scratch_h* s;
+  ASSERT_EQ_U(libd_scratch_create(NULL, 4 * KiB), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_scratch_create(&s, 0), libd_invalid_parameter);
+  ASSERT_OK(libd_scratch_create(&s, 4 * KiB));
+
+  struct libd_scratch_scope scope;
+  ASSERT_EQ_U(
+    libd_scratch_begin(NULL, NULL, 0, &scope), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_scratch_begin(s, NULL, 0, NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_scratch_begin(s, NULL, 1, &scope), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_scratch_end(NULL), libd_invalid_parameter);
+
+  ASSERT_OK(libd_scratch_destroy(s));
+  ASSERT_EQ_U(libd_scratch_destroy(NULL), libd_invalid_parameter);
+}
+
+TEST(scratch_nested_scopes)
+{
+  libd_scratch_h* s;
+  ASSERT_OK(libd_scratch_create(&s, 4 * KiB));
+
+  struct libd_scratch_scope outer;
+  ASSERT_OK(libd_scratch_begin(s, NULL, 0, &outer));
+  u8* kept;
+  ASSERT_OK(libd_linear_allocator_alloc(outer.arena, (void**)&kept, 64));
+
+  // a nested scope without conflicts reuses the same arena and only frees
+  // what was allocated inside it, including past the first block.
+  struct libd_scratch_scope inner;
+  ASSERT_OK(libd_scratch_begin(s, NULL, 0, &inner));
+  ASSERT_EQ_PTR(inner.arena, outer.arena);
+  u8* temp;
+  ASSERT_OK(libd_linear_allocator_alloc(inner.arena, (void**)&temp, 64 * KiB));
+  temp[64 * KiB - 1] = 1;
+  ASSERT_OK(libd_scratch_end(&inner));
+
+  u8* next;
+  ASSERT_OK(libd_linear_allocator_alloc(outer.arena, (void**)&next, 64));
+  ASSERT_EQ_PTR(next, kept + helper_linear_span(64, LIBD_MAX_ALIGN));
+
+  ASSERT_OK(libd_scratch_end(&outer));
+  ASSERT_OK(libd_linear_allocator_alloc(outer.arena, (void**)&next, 64));
+  ASSERT_EQ_PTR(next, kept);
+
+  ASSERT_OK(libd_scratch_destroy(s));
+}
+
+TEST(scratch_conflicts)
+{
+  libd_scratch_h* s;
+  ASSERT_OK(libd_scratch_create(&s, 4 * KiB));
+
+  // the caller allocates results in one arena...
+  struct libd_scratch_scope results;
+  ASSERT_OK(libd_scratch_begin(s, NULL, 0, &results));
+  u8* result;
+  ASSERT_OK(libd_linear_allocator_alloc(results.arena, (void**)&result, 8));
+
+  // ...and the callee's temporaries go to the other one.
+  struct libd_scratch_scope temps;
+  ASSERT_OK(libd_scratch_begin(s, &results.arena, 1, &temps));
+  ASSERT_NE_PTR(temps.arena, results.arena);
+  u8* temp;
+  ASSERT_OK(libd_linear_allocator_alloc(temps.arena, (void**)&temp, 8));
+  ASSERT_OK(libd_linear_allocator_alloc(results.arena, (void**)&result, 8));
+  ASSERT_OK(libd_scratch_end(&temps));
+
+  u8* after;
+  ASSERT_OK(libd_linear_allocator_alloc(results.arena, (void**)&after, 8));
+  ASSERT_EQ_PTR(after, result + helper_linear_span(8, LIBD_MAX_ALIGN));
+
+  libd_linear_allocator_h* both[] = { results.arena, temps.arena };
+  struct libd_scratch_scope none;
+  ASSERT_EQ_U(
+    libd_scratch_begin(s, both, ARR_LEN(both), &none), libd_invalid_parameter);
+
+  ASSERT_OK(libd_scratch_end(&results));
+  ASSERT_OK(libd_scratch_destroy(s));
+}
+
+#define SCRATCH_TEST_THREADS 4
+
+struct scratch_worker_args {
+  libd_scratch_h* s;
+  pthread_barrier_t* checked;
+  libd_linear_allocator_h* arena;
+  bool failed;
+};
+
+static void*
+_scratch_worker(void* arg)
+{
+  struct scratch_worker_args* args = arg;
+
+  struct libd_scratch_scope scope;
+  if (libd_scratch_begin(args->s, NULL, 0, &scope) != libd_ok) {
+    args->failed = true;
+  } else {
+    args->arena = scope.arena;
+  }
+
+  // hold the arenas until the main thread has compared them.
+  pthread_barrier_wait(args->checked);
+  pthread_barrier_wait(args->checked);
+
+  if (!args->failed) {
+    libd_scratch_end(&scope);
+  }
+
+  return NULL;
+}
+
+TEST(scratch_per_thread_arenas)
+{
+  libd_scratch_h* s;
+  ASSERT_OK(libd_scratch_create(&s, 4 * KiB));
+
+  pthread_barrier_t checked;
+  pthread_barrier_init(&checked, NULL, SCRATCH_TEST_THREADS + 1);
+
+  pthread_t threads[SCRATCH_TEST_THREADS];
+  struct scratch_worker_args args[SCRATCH_TEST_THREADS];
+  for (u32 i = 0; i < SCRATCH_TEST_THREADS; i += 1) {
+    args[i] = (struct scratch_worker_args){ .s = s, .checked = &checked };
+    ASSERT_OK(pthread_create(&threads[i], NULL, _scratch_worker, &args[i]));
+  }
+
+  pthread_barrier_wait(&checked);
+  struct libd_scratch_scope mine;
+  ASSERT_OK(libd_scratch_begin(s, NULL, 0, &mine));
+  for (u32 i = 0; i < SCRATCH_TEST_THREADS; i += 1) {
+    ASSERT_FALSE(args[i].failed);
+    ASSERT_NE_PTR(args[i].arena, mine.arena);
+    for (u32 j = i + 1; j < SCRATCH_TEST_THREADS; j += 1) {
+      ASSERT_NE_PTR(args[i].arena, args[j].arena);
+    }
+  }
+  ASSERT_OK(libd_scratch_end(&mine));
+  pthread_barrier_wait(&checked);
+
+  // exiting threads release their arenas through the storage cleanup.
+  for (u32 i = 0; i < SCRATCH_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+  }
+  pthread_barrier_destroy(&checked);
+
+  ASSERT_OK(libd_scratch_destroy(s));
+}
+
+static void*
+_scratch_idle_worker(void* arg)
+{
+  struct scratch_worker_args* args = arg;
+
+  struct libd_scratch_scope scope;
+  if (libd_scratch_begin(args->s, NULL, 0, &scope) != libd_ok) {
+    args->failed = true;
+  } else {
+    libd_scratch_end(&scope);
+  }
+
+  // stay alive until the main thread has destroyed the scratch.
+  pthread_barrier_wait(args->checked);
+  pthread_barrier_wait(args->checked);
+
+  return NULL;
+}
+
+TEST(scratch_destroy_with_live_threads)
+{
+  libd_scratch_h* s;
+  ASSERT_OK(libd_scratch_create(&s, 4 * KiB));
+
+  pthread_barrier_t checked;
+  pthread_barrier_init(&checked, NULL, SCRATCH_TEST_THREADS + 1);
+
+  pthread_t threads[SCRATCH_TEST_THREADS];
+  struct scratch_worker_args args[SCRATCH_TEST_THREADS];
+  for (u32 i = 0; i < SCRATCH_TEST_THREADS; i += 1) {
+    args[i] = (struct scratch_worker_args){ .s = s, .checked = &checked };
+    ASSERT_OK(
+      pthread_create(&threads[i], NULL, _scratch_idle_worker, &args[i]));
+  }
+  pthread_barrier_wait(&checked);
+
+  // the arenas of the threads still running are released here, not leaked.
+  ASSERT_OK(libd_scratch_destroy(s));
+
+  pthread_barrier_wait(&checked);
+  for (u32 i = 0; i < SCRATCH_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+    ASSERT_FALSE(args[i].failed);
+  }
+  pthread_barrier_destroy(&checked);
+}
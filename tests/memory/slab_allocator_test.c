@@ -0,0 +1,100 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/testing.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+TEST(slab_allocator_invalid_params)
+{
+  libd_slab_allocator_h* sa;
+  ASSERT_EQ_U(libd_slab_allocator_create(NULL, MiB), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_slab_allocator_create(&sa, 0), libd_invalid_parameter);
+
+  ASSERT_OK(libd_slab_allocator_create(&sa, MiB));
+
+  void* p;
+  ASSERT_EQ_U(libd_slab_allocator_alloc(sa, &p, 0), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_slab_allocator_alloc(sa, NULL, 8), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_slab_allocator_free(sa, NULL), libd_invalid_parameter);
+
+  ASSERT_OK(libd_slab_allocator_alloc(sa, &p, 24));
+  ASSERT_EQ_U(
+    libd_slab_allocator_free(sa, (u8*)p + 16), libd_invalid_pointer);
+
+  ASSERT_OK(libd_slab_allocator_destroy(sa));
+}
+
+TEST(slab_allocator_size_classes)
+{
+  struct {
+    const char* name;
+    usize input_size;
+    usize expected_class_size;
+  } tcs[] = {
+    { .name = "one\0", .input_size = 1, .expected_class_size = 16 },
+    { .name = "small\0", .input_size = 17, .expected_class_size = 32 },
+    { .name = "small limit\0", .input_size = 128, .expected_class_size = 128 },
+    { .name = "first step\0", .input_size = 129, .expected_class_size = 160 },
+    { .name = "power of 2\0", .input_size = 256, .expected_class_size = 256 },
+    { .name = "past 256\0", .input_size = 257, .expected_class_size = 320 },
+    { .name = "mid group\0", .input_size = 700, .expected_class_size = 768 },
+    { .name = "limit\0", .input_size = 4096, .expected_class_size = 4096 },
+  };
+
+  libd_slab_allocator_h* sa;
+  ASSERT_OK(libd_slab_allocator_create(&sa, MiB));
+
+  // consecutive allocations from a fresh class sit one class size apart.
+  for (size_t i = 0; i < ARR_LEN(tcs); i += 1) {
+    void* a;
+    void* b;
+    ASSERT_OK(libd_slab_allocator_alloc(sa, &a, tcs[i].input_size));
+    ASSERT_OK(libd_slab_allocator_alloc(sa, &b, tcs[i].input_size));
+    ASSERT_EQ_U(
+      (uptr)b - (uptr)a,
+      tcs[i].expected_class_size,
+      "name=%s\n",
+      tcs[i].name);
+    ASSERT_EQ_U((uptr)a % 16, 0, "name=%s\n", tcs[i].name);
+    memset(a, 0xAB, tcs[i].input_size);
+  }
+
+  ASSERT_OK(libd_slab_allocator_destroy(sa));
+}
+
+TEST(slab_allocator_free_and_reuse)
+{
+  libd_slab_allocator_h* sa;
+  ASSERT_OK(libd_slab_allocator_create(&sa, 4 * MiB));
+
+  // every size up to the limit, each filled with its own pattern.
+  static void* ptrs[LIBD_SLAB_MAX_SIZE + 1];
+  for (usize size = 1; size <= LIBD_SLAB_MAX_SIZE; size += 1) {
+    ASSERT_OK(libd_slab_allocator_alloc(sa, &ptrs[size], size));
+    memset(ptrs[size], (u8)size, size);
+  }
+  for (usize size = 1; size <= LIBD_SLAB_MAX_SIZE; size += 1) {
+    u8* bytes = ptrs[size];
+    ASSERT_EQ_U(bytes[0], (u8)size);
+    ASSERT_EQ_U(bytes[size - 1], (u8)size);
+  }
+
+  // freed slots are reused by the same class.
+  void* p;
+  ASSERT_OK(libd_slab_allocator_free(sa, ptrs[1000]));
+  ASSERT_OK(libd_slab_allocator_alloc(sa, &p, 1000));
+  ASSERT_EQ_PTR(p, ptrs[1000]);
+
+  // large requests fall through to malloc and back to free.
+  void* large;
+  ASSERT_OK(libd_slab_allocator_alloc(sa, &large, LIBD_SLAB_MAX_SIZE + 1));
+  memset(large, 0, LIBD_SLAB_MAX_SIZE + 1);
+  ASSERT_OK(libd_slab_allocator_free(sa, large));
+
+  ASSERT_OK(libd_slab_allocator_reset(sa));
+  ASSERT_OK(libd_slab_allocator_alloc(sa, &p, 1));
+  ASSERT_EQ_PTR(p, ptrs[1]);
+
+  ASSERT_OK(libd_slab_allocator_destroy(sa));
+}
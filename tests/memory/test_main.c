@@ -1,15 +1,67 @@
 #include "../../include/libd/testing.h"
+#include "./allocator_test.c"
+#include "./concurrent_pool_allocator_test.c"
 #include "./linear_allocator_test.c"
+#include "./lockfree_pool_allocator_test.c"
 #include "./pool_allocator_test.c"
+#include "./scratch_test.c"
+#include "./slab_allocator_test.c"
 
 TEST_MAIN
 
 // pool allocator
 REGISTER(pool_allocator_invalid_params);
+REGISTER(pool_allocator_lifo_free_order);
+REGISTER(pool_allocator_address_ordered_free_order);
+REGISTER(pool_allocator_lazy_initialization);
+REGISTER(pool_allocator_mmap_backing);
+REGISTER(pool_allocator_growable);
+REGISTER(pool_allocator_batch);
+REGISTER(pool_allocator_stats);
+REGISTER(pool_allocator_debug);
+
+// slab allocator
+REGISTER(slab_allocator_invalid_params);
+REGISTER(slab_allocator_size_classes);
+REGISTER(slab_allocator_free_and_reuse);
+
+// concurrent pool allocator
+REGISTER(concurrent_pool_allocator_invalid_params);
+REGISTER(concurrent_pool_allocator_exhaust_and_reuse);
+REGISTER(concurrent_pool_allocator_rejects_unallocated);
+REGISTER(concurrent_pool_allocator_threads_never_share_slots);
+
+// lock-free pool allocator
+REGISTER(lockfree_pool_allocator_invalid_params);
+REGISTER(lockfree_pool_allocator_lifo_reuse);
+REGISTER(lockfree_pool_allocator_cross_thread_free);
 
 // linear allocator
 REGISTER(linear_allocator_invalid_params);
 REGISTER(linear_allocator_single_size);
 REGISTER(linear_allocator_variable_size_alignment_one);
+REGISTER(linear_allocator_alloc_fast);
+REGISTER(linear_allocator_alloc_aligned);
+REGISTER(linear_allocator_trim);
+REGISTER(linear_allocator_64bit_sizes);
+REGISTER(linear_allocator_chained);
+REGISTER(linear_allocator_commit_ahead);
+REGISTER(linear_allocator_resize);
+REGISTER(linear_allocator_stats);
+REGISTER(linear_allocator_debug);
+
+// scratch arenas
+REGISTER(scratch_invalid_params);
+REGISTER(scratch_nested_scopes);
+REGISTER(scratch_conflicts);
+REGISTER(scratch_per_thread_arenas);
+REGISTER(scratch_destroy_with_live_threads);
+
+// allocator interface
+REGISTER(allocator_invalid_params);
+REGISTER(allocator_linear);
+REGISTER(allocator_pool);
+REGISTER(allocator_system);
+REGISTER(allocator_darray_on_arena);
 
 END_TEST_MAIN
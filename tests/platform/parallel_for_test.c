@@ -0,0 +1,157 @@
+#include "../../include/libd/memory.h"
+#include "../../include/libd/platform/threads.h"
+#include "../../include/libd/testing.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct visits {
+  u32* counts;
+  libd_platform_thread_pool_h* pool;
+};
+
+static void
+_test_visit_f(
+  struct libd_platform_range range,
+  void* ctx,
+  libd_linear_allocator_h* scratch)
+{
+  struct visits* v = ctx;
+  (void)scratch;
+
+  for (usize i = range.begin; i < range.end; i += 1) {
+    __atomic_fetch_add(&v->counts[i], 1, __ATOMIC_RELAXED);
+  }
+}
+
+TEST(parallel_for_covers_range)
+{
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create(&pool, 4));
+
+  const usize n    = 100000;
+  struct visits v  = { .counts = malloc(n * sizeof(u32)), .pool = pool };
+  const usize grains[] = { 0, 1, 7, 4096, n, 2 * n, SIZE_MAX };
+
+  for (u32 g = 0; g < ARR_LEN(grains); g += 1) {
+    memset(v.counts, 0, n * sizeof(u32));
+    struct libd_platform_range range = { .begin = 10, .end = n };
+    ASSERT_OK(libd_platform_parallel_for(
+      pool, range, grains[g], _test_visit_f, &v));
+
+    // every index of the range once, nothing outside it.
+    for (usize i = 0; i < n; i += 1) {
+      ASSERT_EQ_U(v.counts[i], i >= 10, "grain=%zu i=%zu\n", grains[g], i);
+    }
+  }
+
+  struct libd_platform_range empty = { .begin = 5, .end = 5 };
+  ASSERT_OK(libd_platform_parallel_for(pool, empty, 0, _test_visit_f, &v));
+  struct libd_platform_range reversed = { .begin = 6, .end = 5 };
+  ASSERT_EQ_U(
+    libd_platform_parallel_for(pool, reversed, 0, _test_visit_f, &v),
+    libd_invalid_parameter);
+  ASSERT_EQ_U(
+    libd_platform_parallel_for(NULL, empty, 0, _test_visit_f, &v),
+    libd_invalid_parameter);
+  ASSERT_EQ_U(
+    libd_platform_parallel_for(pool, empty, 0, NULL, &v),
+    libd_invalid_parameter);
+
+  free(v.counts);
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+}
+
+struct sums {
+  const u32* values;
+  u64 total;
+  u32 bad_scratch;
+};
+
+// copies the chunk into scratch before summing it, so each chunk depends on
+// its own temporaries.
+static void
+_test_sum_f(
+  struct libd_platform_range range,
+  void* ctx,
+  libd_linear_allocator_h* scratch)
+{
+  struct sums* s = ctx;
+  usize len      = range.end - range.begin;
+
+  u32* copy;
+  if (
+    scratch == NULL ||
+    libd_linear_allocator_alloc(scratch, (void**)&copy, len * sizeof(u32)) !=
+      libd_ok) {
+    __atomic_fetch_add(&s->bad_scratch, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  memcpy(copy, &s->values[range.begin], len * sizeof(u32));
+
+  u64 sum = 0;
+  for (usize i = 0; i < len; i += 1) {
+    sum += copy[i];
+  }
+  __atomic_fetch_add(&s->total, sum, __ATOMIC_RELAXED);
+}
+
+struct outer {
+  libd_platform_thread_pool_h* pool;
+  struct sums* sums;
+  usize inner_n;
+};
+
+static void
+_test_nested_f(
+  struct libd_platform_range range,
+  void* ctx,
+  libd_linear_allocator_h* scratch)
+{
+  struct outer* o = ctx;
+  (void)scratch;
+
+  for (usize i = range.begin; i < range.end; i += 1) {
+    struct libd_platform_range inner = { .begin = 0, .end = o->inner_n };
+    libd_platform_parallel_for(o->pool, inner, 64, _test_sum_f, o->sums);
+  }
+}
+
+TEST(parallel_for_scratch_and_nesting)
+{
+  // small first blocks, so the arenas have to chain.
+  struct libd_platform_thread_pool_options options = { .scratch_size = 4096 };
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create_with_options(&pool, 3, &options));
+
+  const usize n = 50000;
+  u32* values   = malloc(n * sizeof(u32));
+  u64 expected  = 0;
+  for (usize i = 0; i < n; i += 1) {
+    values[i]  = (u32)(i * 2654435761u);
+    expected  += values[i];
+  }
+
+  struct sums s                    = { .values = values };
+  struct libd_platform_range range = { .begin = 0, .end = n };
+  ASSERT_OK(libd_platform_parallel_for(pool, range, 2000, _test_sum_f, &s));
+  ASSERT_EQ_U(s.total, expected);
+  ASSERT_ZERO(s.bad_scratch);
+
+  // parallel_for from inside a chunk, on workers and on the caller.
+  s.total             = 0;
+  struct outer o      = { .pool = pool, .sums = &s, .inner_n = 1000 };
+  u64 inner_expected  = 0;
+  for (usize i = 0; i < o.inner_n; i += 1) {
+    inner_expected += values[i];
+  }
+  struct libd_platform_range outer_range = { .begin = 0, .end = 32 };
+  ASSERT_OK(
+    libd_platform_parallel_for(pool, outer_range, 1, _test_nested_f, &o));
+  ASSERT_EQ_U(s.total, 32 * inner_expected);
+  ASSERT_ZERO(s.bad_scratch);
+
+  free(values);
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+}
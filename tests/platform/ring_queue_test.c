@@ -0,0 +1,227 @@
+#include "../../include/libd/testing.h"
+#include "../../include/libd/utils/ring_queue.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+DEFINE_LIBD_RING_QUEUE_HEADER(u64, u64)
+DEFINE_LIBD_RING_QUEUE_IMPL(u64, u64)
+
+#define RING_QUEUE_TEST_ITEMS   100000
+#define RING_QUEUE_TEST_THREADS 3
+
+TEST(ring_queue_single_thread)
+{
+  ASSERT_EQ_PTR(libd_u64_spsc_queue_create(SIZE_MAX), NULL);
+  ASSERT_EQ_PTR(libd_u64_mpmc_queue_create_with_allocator(8, NULL), NULL);
+  ASSERT_EQ_U(libd_u64_spsc_queue_capacity(NULL), 0);
+
+  libd_u64_spsc_queue_t* spsc = libd_u64_spsc_queue_create(5);
+  libd_u64_mpmc_queue_t* mpmc = libd_u64_mpmc_queue_create(1);
+  ASSERT_NE_PTR(spsc, NULL);
+  ASSERT_NE_PTR(mpmc, NULL);
+  ASSERT_EQ_U(libd_u64_spsc_queue_capacity(spsc), 8);
+  ASSERT_EQ_U(libd_u64_mpmc_queue_capacity(mpmc), 2);
+  libd_u64_mpmc_queue_destroy(mpmc);
+  mpmc = libd_u64_mpmc_queue_create(8);
+
+  u64 v = 0;
+  ASSERT_FALSE(libd_u64_spsc_queue_try_dequeue(spsc, &v));
+  ASSERT_FALSE(libd_u64_mpmc_queue_try_dequeue(mpmc, &v));
+
+  // several laps, so batches wrap around the end of the ring.
+  u64 next_in  = 0;
+  u64 next_out = 0;
+  for (u32 lap = 0; lap < 10; lap += 1) {
+    u64 items[8];
+    for (u32 i = 0; i < 8; i += 1) {
+      items[i] = next_in + i;
+    }
+    ASSERT_TRUE(libd_u64_spsc_queue_try_enqueue(spsc, &items[0]));
+    ASSERT_TRUE(libd_u64_mpmc_queue_try_enqueue(mpmc, &items[0]));
+    ASSERT_EQ_U(libd_u64_spsc_queue_try_enqueue_n(spsc, &items[1], 7), 7);
+    ASSERT_EQ_U(libd_u64_mpmc_queue_try_enqueue_n(mpmc, &items[1], 7), 7);
+    next_in += 8;
+
+    // full: nothing more goes in.
+    ASSERT_FALSE(libd_u64_spsc_queue_try_enqueue(spsc, &v));
+    ASSERT_FALSE(libd_u64_mpmc_queue_try_enqueue(mpmc, &v));
+    ASSERT_ZERO(libd_u64_spsc_queue_try_enqueue_n(spsc, items, 3));
+    ASSERT_ZERO(libd_u64_mpmc_queue_try_enqueue_n(mpmc, items, 3));
+
+    u64 spsc_out[8];
+    u64 mpmc_out[8];
+    u32 take = 3 + lap % 4;
+    ASSERT_EQ_U(libd_u64_spsc_queue_try_dequeue_n(spsc, spsc_out, take), take);
+    ASSERT_EQ_U(libd_u64_mpmc_queue_try_dequeue_n(mpmc, mpmc_out, take), take);
+    for (u32 i = 0; i < take; i += 1) {
+      ASSERT_EQ_U(spsc_out[i], next_out + i);
+      ASSERT_EQ_U(mpmc_out[i], next_out + i);
+    }
+
+    // only what is left comes out of a larger batch.
+    u32 rest = 8 - take;
+    ASSERT_EQ_U(libd_u64_spsc_queue_try_dequeue_n(spsc, spsc_out, 8), rest);
+    ASSERT_EQ_U(libd_u64_mpmc_queue_try_dequeue_n(mpmc, mpmc_out, 8), rest);
+    for (u32 i = 0; i < rest; i += 1) {
+      ASSERT_EQ_U(spsc_out[i], next_out + take + i);
+      ASSERT_EQ_U(mpmc_out[i], next_out + take + i);
+    }
+    next_out += 8;
+  }
+
+  libd_u64_spsc_queue_destroy(spsc);
+  libd_u64_mpmc_queue_destroy(mpmc);
+  libd_u64_spsc_queue_destroy(NULL);
+}
+
+static void*
+_test_spsc_producer_f(void* arg)
+{
+  libd_u64_spsc_queue_t* q = arg;
+
+  u64 next = 1;
+  while (next <= RING_QUEUE_TEST_ITEMS) {
+    if (next % 7 == 0) {
+      libd_u64_spsc_queue_enqueue(q, &next);
+      next += 1;
+      continue;
+    }
+    u64 batch[5];
+    u32 n = 0;
+    for (; n < 5 && next <= RING_QUEUE_TEST_ITEMS; n += 1) {
+      batch[n]  = next;
+      next     += 1;
+    }
+    libd_u64_spsc_queue_enqueue_n(q, batch, n);
+  }
+
+  return NULL;
+}
+
+TEST(ring_queue_spsc_threads)
+{
+  // small enough that both sides block.
+  libd_u64_spsc_queue_t* q = libd_u64_spsc_queue_create(16);
+  pthread_t producer;
+  ASSERT_OK(pthread_create(&producer, NULL, _test_spsc_producer_f, q));
+
+  u64 expected = 1;
+  while (expected <= RING_QUEUE_TEST_ITEMS) {
+    u64 out[6];
+    usize n = libd_u64_spsc_queue_dequeue_n(q, out, 6);
+    ASSERT_TRUE(n >= 1);
+    for (usize i = 0; i < n; i += 1) {
+      ASSERT_EQ_U(out[i], expected);
+      expected += 1;
+    }
+  }
+
+  ASSERT_OK(pthread_join(producer, NULL));
+  u64 v;
+  ASSERT_FALSE(libd_u64_spsc_queue_try_dequeue(q, &v));
+  libd_u64_spsc_queue_destroy(q);
+}
+
+struct mpmc_args {
+  libd_u64_mpmc_queue_t* q;
+  u32 id;
+  u32* seen;
+  u32 out_of_order;
+};
+
+// items carry their producer in the high bits and a sequence number below.
+static void*
+_test_mpmc_producer_f(void* arg)
+{
+  struct mpmc_args* args = arg;
+
+  u64 i = 0;
+  while (i < RING_QUEUE_TEST_ITEMS) {
+    u64 batch[3];
+    u32 n = i % 2 == 0 ? 1 : 3;
+    n     = MIN((u64)n, RING_QUEUE_TEST_ITEMS - i);
+    for (u32 k = 0; k < n; k += 1) {
+      batch[k] = ((u64)args->id << 32) | (i + k);
+    }
+    if (n == 1) {
+      libd_u64_mpmc_queue_enqueue(args->q, batch);
+    } else {
+      libd_u64_mpmc_queue_enqueue_n(args->q, batch, n);
+    }
+    i += n;
+  }
+
+  return NULL;
+}
+
+// each consumer takes an equal share, and sees every producer's items in the
+// order they went in.
+static void*
+_test_mpmc_consumer_f(void* arg)
+{
+  struct mpmc_args* args = arg;
+  s64 last[RING_QUEUE_TEST_THREADS];
+  for (u32 i = 0; i < RING_QUEUE_TEST_THREADS; i += 1) {
+    last[i] = -1;
+  }
+
+  u64 taken = 0;
+  while (taken < RING_QUEUE_TEST_ITEMS) {
+    u64 out[4];
+    usize want = MIN((u64)4, RING_QUEUE_TEST_ITEMS - taken);
+    usize n    = libd_u64_mpmc_queue_dequeue_n(args->q, out, want);
+    for (usize i = 0; i < n; i += 1) {
+      u32 producer = (u32)(out[i] >> 32);
+      u32 seq      = (u32)out[i];
+      if ((s64)seq <= last[producer]) {
+        args->out_of_order += 1;
+      }
+      last[producer] = seq;
+      __atomic_fetch_add(
+        &args->seen[producer * RING_QUEUE_TEST_ITEMS + seq],
+        1,
+        __ATOMIC_RELAXED);
+    }
+    taken += n;
+  }
+
+  return NULL;
+}
+
+TEST(ring_queue_mpmc_threads)
+{
+  libd_u64_mpmc_queue_t* q = libd_u64_mpmc_queue_create(64);
+  u32* seen =
+    calloc(RING_QUEUE_TEST_THREADS * RING_QUEUE_TEST_ITEMS, sizeof(u32));
+
+  struct mpmc_args producers[RING_QUEUE_TEST_THREADS];
+  struct mpmc_args consumers[RING_QUEUE_TEST_THREADS];
+  pthread_t threads[2 * RING_QUEUE_TEST_THREADS];
+  for (u32 i = 0; i < RING_QUEUE_TEST_THREADS; i += 1) {
+    producers[i] = (struct mpmc_args){ .q = q, .id = i, .seen = seen };
+    consumers[i] = (struct mpmc_args){ .q = q, .id = i, .seen = seen };
+    ASSERT_OK(
+      pthread_create(&threads[i], NULL, _test_mpmc_consumer_f, &consumers[i]));
+    ASSERT_OK(pthread_create(
+      &threads[RING_QUEUE_TEST_THREADS + i],
+      NULL,
+      _test_mpmc_producer_f,
+      &producers[i]));
+  }
+  for (u32 i = 0; i < 2 * RING_QUEUE_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+  }
+
+  for (u32 i = 0; i < RING_QUEUE_TEST_THREADS; i += 1) {
+    ASSERT_ZERO(consumers[i].out_of_order);
+  }
+  for (u32 i = 0; i < RING_QUEUE_TEST_THREADS * RING_QUEUE_TEST_ITEMS; i += 1) {
+    ASSERT_EQ_U(seen[i], 1, "item %u\n", i);
+  }
+
+  free(seen);
+  libd_u64_mpmc_queue_destroy(q);
+}
@@ -0,0 +1,237 @@
+#include "../../include/libd/platform/sync.h"
+#include "../../include/libd/testing.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SYNC_TEST_THREADS 4
+
+TEST(sync_invalid_params)
+{
+  ASSERT_EQ_U(libd_platform_mutex_init(NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_platform_rwlock_init(NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_platform_event_init(NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_platform_latch_init(NULL, 1), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_platform_barrier_init(NULL, 1), libd_invalid_parameter);
+
+  struct libd_platform_latch latch;
+  ASSERT_EQ_U(
+    libd_platform_latch_init(&latch, U32_MAX), libd_invalid_parameter);
+  struct libd_platform_barrier barrier;
+  ASSERT_EQ_U(
+    libd_platform_barrier_init(&barrier, 0), libd_invalid_parameter);
+}
+
+struct mutex_args {
+  struct libd_platform_mutex* mutex;
+  u64* counter;
+};
+
+static void*
+_test_mutex_f(void* arg)
+{
+  struct mutex_args* args = arg;
+
+  for (u32 i = 0; i < 50000; i += 1) {
+    libd_platform_mutex_lock(args->mutex);
+    *args->counter += 1;
+    libd_platform_mutex_unlock(args->mutex);
+  }
+
+  return NULL;
+}
+
+TEST(sync_mutex)
+{
+  struct libd_platform_mutex mutex = LIBD_PLATFORM_MUTEX_INIT;
+
+  ASSERT_TRUE(libd_platform_mutex_try_lock(&mutex));
+  ASSERT_TRUE(!libd_platform_mutex_try_lock(&mutex));
+  libd_platform_mutex_unlock(&mutex);
+  ASSERT_TRUE(libd_platform_mutex_try_lock(&mutex));
+  libd_platform_mutex_unlock(&mutex);
+
+  u64 counter            = 0;
+  struct mutex_args args = { .mutex = &mutex, .counter = &counter };
+  pthread_t threads[SYNC_TEST_THREADS];
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_create(&threads[i], NULL, _test_mutex_f, &args));
+  }
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+  }
+
+  ASSERT_EQ_U(counter, SYNC_TEST_THREADS * 50000);
+  ASSERT_TRUE(libd_platform_mutex_try_lock(&mutex));
+}
+
+struct rwlock_args {
+  struct libd_platform_rwlock* rwlock;
+  u64 pair[2];
+  u32 torn;
+};
+
+// writers keep both halves of the pair equal, readers check they are.
+static void*
+_test_rwlock_f(void* arg)
+{
+  struct rwlock_args* args = arg;
+
+  for (u32 i = 0; i < 20000; i += 1) {
+    if (i % 8 == 0) {
+      libd_platform_rwlock_write_lock(args->rwlock);
+      args->pair[0] += 1;
+      args->pair[1] += 1;
+      libd_platform_rwlock_write_unlock(args->rwlock);
+    } else {
+      libd_platform_rwlock_read_lock(args->rwlock);
+      if (args->pair[0] != args->pair[1]) {
+        __atomic_fetch_add(&args->torn, 1, __ATOMIC_RELAXED);
+      }
+      libd_platform_rwlock_read_unlock(args->rwlock);
+    }
+  }
+
+  return NULL;
+}
+
+TEST(sync_rwlock)
+{
+  struct libd_platform_rwlock rwlock;
+  ASSERT_OK(libd_platform_rwlock_init(&rwlock));
+
+  // readers share the lock.
+  libd_platform_rwlock_read_lock(&rwlock);
+  libd_platform_rwlock_read_lock(&rwlock);
+  libd_platform_rwlock_read_unlock(&rwlock);
+  libd_platform_rwlock_read_unlock(&rwlock);
+
+  struct rwlock_args args = { .rwlock = &rwlock };
+  pthread_t threads[SYNC_TEST_THREADS];
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_create(&threads[i], NULL, _test_rwlock_f, &args));
+  }
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+  }
+
+  ASSERT_ZERO(args.torn);
+  ASSERT_EQ_U(args.pair[0], SYNC_TEST_THREADS * 20000 / 8);
+  ASSERT_EQ_U(args.pair[1], args.pair[0]);
+}
+
+struct signal_args {
+  struct libd_platform_event* go;
+  struct libd_platform_latch* done;
+  const u32* payload;
+  u32 seen[SYNC_TEST_THREADS];
+  u32 index;
+};
+
+static void*
+_test_signal_f(void* arg)
+{
+  struct signal_args* args = arg;
+  u32 index = __atomic_fetch_add(&args->index, 1, __ATOMIC_RELAXED);
+
+  libd_platform_event_wait(args->go);
+  args->seen[index] = *args->payload;
+  libd_platform_latch_count_down(args->done, 1);
+
+  return NULL;
+}
+
+TEST(sync_event_and_latch)
+{
+  struct libd_platform_event go = LIBD_PLATFORM_EVENT_INIT;
+  struct libd_platform_latch done;
+  ASSERT_OK(libd_platform_latch_init(&done, 0));
+
+  // a latch at 0 does not block.
+  libd_platform_latch_wait(&done);
+  libd_platform_latch_add(&done, SYNC_TEST_THREADS);
+
+  u32 payload             = 0;
+  struct signal_args args = { .go = &go, .done = &done, .payload = &payload };
+  pthread_t threads[SYNC_TEST_THREADS];
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_create(&threads[i], NULL, _test_signal_f, &args));
+  }
+
+  ASSERT_TRUE(!libd_platform_event_is_set(&go));
+  payload = 42;
+  libd_platform_event_set(&go);
+  libd_platform_event_set(&go);
+  ASSERT_TRUE(libd_platform_event_is_set(&go));
+
+  // the latch publishes what the threads wrote.
+  libd_platform_latch_wait(&done);
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_EQ_U(args.seen[i], 42);
+  }
+
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+  }
+  libd_platform_event_wait(&go);
+}
+
+#define SYNC_TEST_PHASES 200
+
+struct barrier_args {
+  struct libd_platform_barrier* barrier;
+  u32 slots[SYNC_TEST_PHASES][SYNC_TEST_THREADS];
+  u32 leaders[SYNC_TEST_PHASES];
+  u32 mismatches;
+  u32 index;
+};
+
+// every phase each thread fills its slot, then checks the others filled
+// theirs.
+static void*
+_test_barrier_f(void* arg)
+{
+  struct barrier_args* args = arg;
+  u32 self = __atomic_fetch_add(&args->index, 1, __ATOMIC_RELAXED);
+
+  for (u32 p = 0; p < SYNC_TEST_PHASES; p += 1) {
+    args->slots[p][self] = p + 1;
+    if (libd_platform_barrier_wait(args->barrier)) {
+      __atomic_fetch_add(&args->leaders[p], 1, __ATOMIC_RELAXED);
+    }
+    for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+      if (args->slots[p][i] != p + 1) {
+        __atomic_fetch_add(&args->mismatches, 1, __ATOMIC_RELAXED);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+TEST(sync_barrier)
+{
+  struct libd_platform_barrier barrier;
+  ASSERT_OK(libd_platform_barrier_init(&barrier, SYNC_TEST_THREADS));
+
+  static struct barrier_args args;
+  args.barrier = &barrier;
+  pthread_t threads[SYNC_TEST_THREADS];
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_create(&threads[i], NULL, _test_barrier_f, &args));
+  }
+  for (u32 i = 0; i < SYNC_TEST_THREADS; i += 1) {
+    ASSERT_OK(pthread_join(threads[i], NULL));
+  }
+
+  ASSERT_ZERO(args.mismatches);
+  for (u32 p = 0; p < SYNC_TEST_PHASES; p += 1) {
+    ASSERT_EQ_U(args.leaders[p], 1);
+  }
+
+  // a barrier of one never blocks.
+  ASSERT_OK(libd_platform_barrier_init(&barrier, 1));
+  ASSERT_TRUE(libd_platform_barrier_wait(&barrier));
+  ASSERT_TRUE(libd_platform_barrier_wait(&barrier));
+}
@@ -1,4 +1,49 @@
 #include "../../include/libd/testing.h"
 // #include "./path_test.c"
-// #include "./thread_local_storage_test.c"
 // #include "./unit/parsing_test.c"
+#include "./parallel_for_test.c"
+#include "./ring_queue_test.c"
+#include "./sync_test.c"
+#include "./thread_local_storage_test.c"
+#include "./thread_pool_test.c"
+
+TEST_MAIN
+
+// thread local storage
+REGISTER(thread_local_storage_flat_set_get);
+REGISTER(thread_local_storage_nested_set_get);
+REGISTER(thread_local_storage_global_state_init_cleanup);
+REGISTER(thread_local_static_flat_get_set);
+REGISTER(thread_local_static_nested_get_set);
+REGISTER(thread_local_storage_reused_slots);
+REGISTER(thread_local_storage_per_thread);
+REGISTER(thread_local_storage_destroy_waits_for_cleanups);
+REGISTER(thread_local_storage_many_handles);
+
+// thread pool
+REGISTER(thread_pool_invalid_params);
+REGISTER(thread_pool_runs_every_task);
+REGISTER(thread_pool_nested_submit);
+REGISTER(thread_pool_submit_no_memory);
+REGISTER(thread_pool_submit_then_block);
+
+// task groups
+REGISTER(task_group_fork_join);
+
+// parallel for
+REGISTER(parallel_for_covers_range);
+REGISTER(parallel_for_scratch_and_nesting);
+
+// ring queues
+REGISTER(ring_queue_single_thread);
+REGISTER(ring_queue_spsc_threads);
+REGISTER(ring_queue_mpmc_threads);
+
+// sync
+REGISTER(sync_invalid_params);
+REGISTER(sync_mutex);
+REGISTER(sync_rwlock);
+REGISTER(sync_event_and_latch);
+REGISTER(sync_barrier);
+
+END_TEST_MAIN
@@ -1,8 +1,12 @@
 #include "../../include/libd/common.h"
 #include "../../include/libd/platform/threads.h"
 #include "../../include/libd/testing.h"
+#include "../../include/libd/utils/align_compat.h"
 
+#include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
+#include <string.h>
 
 struct flat_storage {
   int member;
@@ -17,7 +21,7 @@ helper_create_thread_local_storage(void)
 {
   libd_platform_thread_local_storage_handle_h* handle;
   ASSERT_OK(libd_platform_thread_local_storage_create(
-    &handle, free, sizeof(struct flat_storage)));
+    &handle, NULL, sizeof(struct flat_storage)));
 
   return handle;
 }
@@ -27,7 +31,7 @@ TEST(thread_local_storage_flat_set_get)
   int test_val = 10;
   libd_platform_thread_local_storage_handle_h* handle;
   ASSERT_OK(libd_platform_thread_local_storage_create(
-    &handle, free, sizeof(struct flat_storage)));
+    &handle, NULL, sizeof(struct flat_storage)));
 
   struct flat_storage data_source = { .member = test_val };
   ASSERT_OK(libd_platform_thread_local_storage_set(handle, NULL, &data_source));
@@ -54,8 +58,11 @@ _test_nest_setter_f(
   return libd_ok;
 }
 static void
-_test_nest_destructor_f(void* dat)
+_test_nest_cleanup_f(
+  void* dat,
+  size_t size)
 {
+  (void)size;
   struct nested_storage* t = (struct nested_storage*)dat;
   if (t->payload != NULL) {
     free(t->payload);
@@ -67,7 +74,7 @@ TEST(thread_local_storage_nested_set_get)
   int test_val = 10;
   libd_platform_thread_local_storage_handle_h* handle;
   ASSERT_OK(libd_platform_thread_local_storage_create(
-    &handle, _test_nest_destructor_f, sizeof(struct nested_storage)));
+    &handle, _test_nest_cleanup_f, sizeof(struct nested_storage)));
 
   struct flat_storage* payload = malloc(sizeof(struct flat_storage));
   ASSERT_NOT_NULL(payload);
@@ -83,13 +90,15 @@ TEST(thread_local_storage_nested_set_get)
     libd_platform_thread_local_storage_get(handle, (void**)&p_data_dest));
   ASSERT_EQ_U(p_data_dest->payload->member, test_val);
 
+  // destroy leaves what this thread's data refers to to the caller.
+  free(payload);
   ASSERT_OK(libd_platform_thread_local_storage_destroy(handle));
 }
 
 TEST(thread_local_storage_global_state_init_cleanup)
 {
   ASSERT_OK(
-    libd_platform_thread_local_static_init(free, sizeof(struct flat_storage)));
+    libd_platform_thread_local_static_init(NULL, sizeof(struct flat_storage)));
   ASSERT_OK(libd_platform_thread_local_static_cleanup());
 }
 
@@ -97,7 +106,7 @@ TEST(thread_local_static_flat_get_set)
 {
   int test_val = 10;
   ASSERT_OK(
-    libd_platform_thread_local_static_init(free, sizeof(struct flat_storage)));
+    libd_platform_thread_local_static_init(NULL, sizeof(struct flat_storage)));
 
   struct flat_storage src = { .member = test_val };
   ASSERT_OK(libd_platform_thread_local_static_set(NULL, &src));
@@ -114,7 +123,7 @@ TEST(thread_local_static_nested_get_set)
 {
   int test_val = 10;
   ASSERT_OK(libd_platform_thread_local_static_init(
-    _test_nest_destructor_f, sizeof(struct nested_storage)));
+    _test_nest_cleanup_f, sizeof(struct nested_storage)));
 
   struct flat_storage* flat = malloc(sizeof(struct flat_storage));
   ASSERT_NOT_NULL(flat);
@@ -129,5 +138,165 @@ TEST(thread_local_static_nested_get_set)
   ASSERT_OK(libd_platform_thread_local_static_get((void**)&dest_data));
   ASSERT_EQ_U(dest_data->payload->member, test_val);
 
+  free(flat);
   ASSERT_OK(libd_platform_thread_local_static_cleanup());
 }
+
+TEST(thread_local_storage_reused_slots)
+{
+  // handles created after others are destroyed start out zeroed, whichever
+  // slot they end up with.
+  for (int round = 0; round < 200; round += 1) {
+    libd_platform_thread_local_storage_handle_h* handle =
+      helper_create_thread_local_storage();
+
+    struct flat_storage* data;
+    ASSERT_OK(libd_platform_thread_local_storage_get(handle, (void**)&data));
+    ASSERT_EQ_U(data->member, 0);
+    data->member = round + 1;
+
+    struct flat_storage* again;
+    ASSERT_OK(libd_platform_thread_local_storage_get(handle, (void**)&again));
+    ASSERT_EQ_PTR(again, data);
+
+    ASSERT_OK(libd_platform_thread_local_storage_destroy(handle));
+  }
+}
+
+static int g_cleanup_calls = 0;
+
+static void
+_test_counting_cleanup_f(
+  void* dat,
+  size_t size)
+{
+  (void)dat;
+  if (size == sizeof(struct flat_storage)) {
+    __atomic_fetch_add(&g_cleanup_calls, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static void*
+_test_thread_f(void* arg)
+{
+  libd_platform_thread_local_storage_handle_h* handle = arg;
+
+  struct flat_storage* data;
+  if (libd_platform_thread_local_storage_get(handle, (void**)&data) != 0) {
+    return NULL;
+  }
+  // every thread sees its own zeroed copy.
+  if (data->member != 0) {
+    return NULL;
+  }
+  data->member = 1;
+
+  return data;
+}
+
+TEST(thread_local_storage_per_thread)
+{
+  libd_platform_thread_local_storage_handle_h* handle;
+  ASSERT_OK(libd_platform_thread_local_storage_create(
+    &handle, _test_counting_cleanup_f, sizeof(struct flat_storage)));
+
+  struct flat_storage* mine;
+  ASSERT_OK(libd_platform_thread_local_storage_get(handle, (void**)&mine));
+
+  pthread_t threads[4];
+  void* theirs[4];
+  for (u32 i = 0; i < ARR_LEN(threads); i += 1) {
+    ASSERT_ZERO(pthread_create(&threads[i], NULL, _test_thread_f, handle));
+  }
+  for (u32 i = 0; i < ARR_LEN(threads); i += 1) {
+    ASSERT_ZERO(pthread_join(threads[i], &theirs[i]));
+    ASSERT_NE_PTR(theirs[i], NULL);
+    ASSERT_NE_PTR(theirs[i], mine);
+  }
+
+  // each thread's copy was handed to the cleanup as it exited.
+  ASSERT_EQ_S(__atomic_load_n(&g_cleanup_calls, __ATOMIC_RELAXED), 4);
+  ASSERT_EQ_U(mine->member, 0);
+
+  ASSERT_OK(libd_platform_thread_local_storage_destroy(handle));
+}
+
+static int g_slow_cleanup_started  = 0;
+static int g_slow_cleanup_finished = 0;
+
+static void
+_test_slow_cleanup_f(
+  void* dat,
+  size_t size)
+{
+  (void)dat;
+  (void)size;
+  __atomic_store_n(&g_slow_cleanup_started, 1, __ATOMIC_RELEASE);
+  for (int i = 0; i < 10000; i += 1) {
+    sched_yield();
+  }
+  __atomic_store_n(&g_slow_cleanup_finished, 1, __ATOMIC_RELEASE);
+}
+
+static void*
+_test_touch_thread_f(void* arg)
+{
+  void* data;
+  libd_platform_thread_local_storage_get(arg, &data);
+  return NULL;
+}
+
+TEST(thread_local_storage_destroy_waits_for_cleanups)
+{
+  // one handle in the shared block and one with its own key.
+  const size_t sizes[] = { sizeof(struct flat_storage), 8 * KiB };
+
+  for (u32 i = 0; i < ARR_LEN(sizes); i += 1) {
+    __atomic_store_n(&g_slow_cleanup_started, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_slow_cleanup_finished, 0, __ATOMIC_RELAXED);
+
+    libd_platform_thread_local_storage_handle_h* handle;
+    ASSERT_OK(libd_platform_thread_local_storage_create(
+      &handle, _test_slow_cleanup_f, sizes[i]));
+
+    pthread_t thread;
+    ASSERT_ZERO(pthread_create(&thread, NULL, _test_touch_thread_f, handle));
+    while (!__atomic_load_n(&g_slow_cleanup_started, __ATOMIC_ACQUIRE)) {
+      sched_yield();
+    }
+
+    // the exiting thread is inside the cleanup, destroy returns after it.
+    ASSERT_OK(libd_platform_thread_local_storage_destroy(handle));
+    ASSERT_EQ_S(
+      __atomic_load_n(&g_slow_cleanup_finished, __ATOMIC_ACQUIRE), 1);
+    ASSERT_ZERO(pthread_join(thread, NULL));
+  }
+}
+
+TEST(thread_local_storage_many_handles)
+{
+  // the last one is larger than the shared block and keeps its own storage.
+  const size_t sizes[] = { 1, 24, 64, 3, 256, 8 * KiB };
+  libd_platform_thread_local_storage_handle_h* handles[ARR_LEN(sizes)];
+  u8* data[ARR_LEN(sizes)];
+
+  for (u32 i = 0; i < ARR_LEN(sizes); i += 1) {
+    ASSERT_OK(
+      libd_platform_thread_local_storage_create(&handles[i], NULL, sizes[i]));
+    ASSERT_OK(
+      libd_platform_thread_local_storage_get(handles[i], (void**)&data[i]));
+    ASSERT_ZERO((uintptr_t)data[i] % LIBD_MAX_ALIGN);
+    for (size_t j = 0; j < sizes[i]; j += 1) {
+      ASSERT_ZERO(data[i][j]);
+    }
+    memset(data[i], (int)i + 1, sizes[i]);
+  }
+
+  // no handle's data overlaps another's.
+  for (u32 i = 0; i < ARR_LEN(sizes); i += 1) {
+    for (size_t j = 0; j < sizes[i]; j += 1) {
+      ASSERT_EQ_U(data[i][j], i + 1);
+    }
+    ASSERT_OK(libd_platform_thread_local_storage_destroy(handles[i]));
+  }
+}
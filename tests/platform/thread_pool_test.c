@@ -0,0 +1,232 @@
+#include "../../include/libd/platform/sync.h"
+#include "../../include/libd/platform/threads.h"
+#include "../../include/libd/testing.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+TEST(thread_pool_invalid_params)
+{
+  libd_platform_thread_pool_h* pool = NULL;
+
+  ASSERT_EQ_U(
+    libd_platform_thread_pool_create(NULL, 2), libd_invalid_parameter);
+
+  struct libd_platform_thread_pool_options options = { .deque_capacity = 3 };
+  ASSERT_EQ_U(
+    libd_platform_thread_pool_create_with_options(&pool, 2, &options),
+    libd_invalid_parameter);
+
+  ASSERT_OK(libd_platform_thread_pool_create(&pool, 2));
+  ASSERT_EQ_U(libd_platform_thread_pool_worker_count(pool), 2);
+  ASSERT_EQ_U(
+    libd_platform_thread_pool_submit(pool, NULL, NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(
+    libd_platform_thread_pool_submit(NULL, free, NULL), libd_invalid_parameter);
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+
+  ASSERT_EQ_U(libd_platform_thread_pool_worker_count(NULL), 0);
+  ASSERT_EQ_U(libd_platform_thread_pool_wait(NULL), libd_invalid_parameter);
+  ASSERT_EQ_U(libd_platform_thread_pool_destroy(NULL), libd_invalid_parameter);
+}
+
+static void
+_test_count_f(void* arg)
+{
+  __atomic_fetch_add((u32*)arg, 1, __ATOMIC_RELAXED);
+}
+
+TEST(thread_pool_runs_every_task)
+{
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create(&pool, 4));
+
+  u32 count = 0;
+  for (u32 round = 1; round <= 3; round += 1) {
+    for (u32 i = 0; i < 2000; i += 1) {
+      ASSERT_OK(libd_platform_thread_pool_submit(pool, _test_count_f, &count));
+    }
+    ASSERT_OK(libd_platform_thread_pool_wait(pool));
+    ASSERT_EQ_U(__atomic_load_n(&count, __ATOMIC_RELAXED), round * 2000);
+  }
+
+  // destroy runs whatever is still queued.
+  for (u32 i = 0; i < 1000; i += 1) {
+    ASSERT_OK(libd_platform_thread_pool_submit(pool, _test_count_f, &count));
+  }
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+  ASSERT_EQ_U(count, 7000);
+}
+
+// a binary tree laid out as a heap, where every node's task submits its two
+// children.
+struct tree {
+  libd_platform_thread_pool_h* pool;
+  struct tree_node* nodes;
+  u32 n_nodes;
+  u32 visited;
+};
+
+struct tree_node {
+  struct tree* tree;
+  u32 index;
+};
+
+static void
+_test_tree_f(void* arg)
+{
+  struct tree_node* node = arg;
+  struct tree* tree      = node->tree;
+  __atomic_fetch_add(&tree->visited, 1, __ATOMIC_RELAXED);
+
+  for (u32 child = 2 * node->index + 1;
+       child <= 2 * node->index + 2 && child < tree->n_nodes;
+       child += 1) {
+    libd_platform_thread_pool_submit(
+      tree->pool, _test_tree_f, &tree->nodes[child]);
+  }
+}
+
+TEST(thread_pool_nested_submit)
+{
+  // tiny deques and task budget, so workers also run children inline.
+  struct libd_platform_thread_pool_options options = {
+    .max_tasks      = 16,
+    .deque_capacity = 4,
+  };
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create_with_options(&pool, 4, &options));
+
+  struct tree tree = { .pool = pool, .n_nodes = (1 << 14) - 1 };
+  tree.nodes       = malloc(tree.n_nodes * sizeof(struct tree_node));
+  for (u32 i = 0; i < tree.n_nodes; i += 1) {
+    tree.nodes[i] = (struct tree_node){ .tree = &tree, .index = i };
+  }
+
+  ASSERT_OK(
+    libd_platform_thread_pool_submit(pool, _test_tree_f, &tree.nodes[0]));
+  ASSERT_OK(libd_platform_thread_pool_wait(pool));
+  ASSERT_EQ_U(__atomic_load_n(&tree.visited, __ATOMIC_RELAXED), tree.n_nodes);
+
+  free(tree.nodes);
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+}
+
+static void
+_test_block_f(void* arg)
+{
+  while (!__atomic_load_n((bool*)arg, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+TEST(thread_pool_submit_no_memory)
+{
+  struct libd_platform_thread_pool_options options = { .max_tasks = 8 };
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create_with_options(&pool, 1, &options));
+
+  bool release = false;
+  ASSERT_OK(libd_platform_thread_pool_submit(pool, _test_block_f, &release));
+
+  // with the only worker busy, tasks from outside the pool pile up.
+  u32 count          = 0;
+  u32 submitted      = 0;
+  enum libd_result r = libd_ok;
+  while (r == libd_ok && submitted < 64) {
+    r          = libd_platform_thread_pool_submit(pool, _test_count_f, &count);
+    submitted += r == libd_ok;
+  }
+  ASSERT_EQ_U(r, libd_no_memory);
+  ASSERT_TRUE(submitted <= options.max_tasks);
+
+  __atomic_store_n(&release, true, __ATOMIC_RELEASE);
+  ASSERT_OK(libd_platform_thread_pool_wait(pool));
+  ASSERT_EQ_U(count, submitted);
+
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+}
+
+static void
+_test_set_f(void* arg)
+{
+  libd_platform_event_set(arg);
+}
+
+TEST(thread_pool_submit_then_block)
+{
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create(&pool, 3));
+
+  // the caller sleeps on something the pool knows nothing about, so every
+  // task has to be picked up by a wake from submit. Workers park and wake
+  // between rounds, which is where a lost wake would hang.
+  for (u32 i = 0; i < 5000; i += 1) {
+    struct libd_platform_event event = LIBD_PLATFORM_EVENT_INIT;
+    ASSERT_OK(libd_platform_thread_pool_submit(pool, _test_set_f, &event));
+    libd_platform_event_wait(&event);
+  }
+
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+}
+
+struct fib {
+  libd_platform_thread_pool_h* pool;
+  u32 n;
+  u64 result;
+};
+
+static void
+_test_fib_f(void* arg)
+{
+  struct fib* f = arg;
+  if (f->n < 2) {
+    f->result = f->n;
+    return;
+  }
+
+  struct fib a = { .pool = f->pool, .n = f->n - 1 };
+  struct fib b = { .pool = f->pool, .n = f->n - 2 };
+
+  struct libd_platform_task_group group;
+  libd_platform_task_group_init(&group, f->pool);
+  libd_platform_task_group_spawn(&group, _test_fib_f, &a);
+  _test_fib_f(&b);
+  libd_platform_task_group_wait(&group);
+
+  f->result = a.result + b.result;
+}
+
+TEST(task_group_fork_join)
+{
+  // a small budget makes some spawns run inline.
+  struct libd_platform_thread_pool_options options = { .max_tasks = 64 };
+  libd_platform_thread_pool_h* pool;
+  ASSERT_OK(libd_platform_thread_pool_create_with_options(&pool, 4, &options));
+
+  struct libd_platform_task_group group;
+  ASSERT_EQ_U(
+    libd_platform_task_group_init(NULL, pool), libd_invalid_parameter);
+  ASSERT_EQ_U(
+    libd_platform_task_group_init(&group, NULL), libd_invalid_parameter);
+
+  // the root waits from outside the pool, every other level from a task.
+  struct fib f = { .pool = pool, .n = 22 };
+  ASSERT_OK(libd_platform_task_group_init(&group, pool));
+  ASSERT_OK(libd_platform_task_group_spawn(&group, _test_fib_f, &f));
+  ASSERT_OK(libd_platform_task_group_wait(&group));
+  ASSERT_EQ_U(f.result, 17711);
+
+  // groups are reusable once waited on.
+  u32 count = 0;
+  for (u32 round = 1; round <= 3; round += 1) {
+    for (u32 i = 0; i < 500; i += 1) {
+      ASSERT_OK(
+        libd_platform_task_group_spawn(&group, _test_count_f, &count));
+    }
+    ASSERT_OK(libd_platform_task_group_wait(&group));
+    ASSERT_EQ_U(count, round * 500);
+  }
+
+  ASSERT_OK(libd_platform_thread_pool_destroy(pool));
+}